@@ -0,0 +1,105 @@
+#include "AsyncExecutor.h"
+#include <boost/asio/post.hpp>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <iterator>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+AsyncExecutor::AsyncExecutor(std::size_t theThreads, std::size_t theMaxPerKey)
+    : itsMaxPerKey(theMaxPerKey), itsPool(theThreads)
+{
+}
+
+AsyncExecutor::~AsyncExecutor()
+{
+  shutdown();
+}
+
+void AsyncExecutor::shutdown()
+{
+  std::deque<Task> abandoned;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsShutdown = true;
+    for (auto& queue : itsQueues)
+      std::move(queue.second.pending.begin(),
+                queue.second.pending.end(),
+                std::back_inserter(abandoned));
+    itsQueues.clear();
+  }
+
+  // Destroying the tasks outside the lock breaks their promises
+  abandoned.clear();
+
+  itsPool.stop();
+  itsPool.join();
+}
+
+void AsyncExecutor::enqueue(const std::string& theKey, Task theTask)
+{
+  try
+  {
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      if (itsShutdown)
+        throw Fmi::Exception(BCP, "Engine is shutting down, request ignored");
+
+      auto& queue = itsQueues[theKey];
+      if (queue.running >= itsMaxPerKey)
+      {
+        queue.pending.push_back(std::move(theTask));
+        return;
+      }
+      ++queue.running;
+    }
+    start(theKey, std::move(theTask));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Run the task in the pool, the running count has been incremented already
+void AsyncExecutor::start(const std::string& theKey, Task theTask)
+{
+  boost::asio::post(itsPool,
+                    [this, theKey, task = std::move(theTask)]()
+                    {
+                      // packaged tasks store exceptions in the future
+                      task();
+                      finished(theKey);
+                    });
+}
+
+// Start the next queued task of the key, if any
+void AsyncExecutor::finished(const std::string& theKey)
+{
+  Task next;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto pos = itsQueues.find(theKey);
+    if (pos == itsQueues.end())
+      return;
+
+    auto& queue = pos->second;
+    if (queue.pending.empty())
+    {
+      if (--queue.running == 0)
+        itsQueues.erase(pos);
+      return;
+    }
+    next = std::move(queue.pending.front());
+    queue.pending.pop_front();
+  }
+  start(theKey, std::move(next));
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
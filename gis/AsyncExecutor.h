@@ -0,0 +1,81 @@
+// ======================================================================
+/*!
+ * \brief Executor for asynchronous engine calls
+ *
+ * Tasks are run by a fixed size thread pool. Each key (pgname) may have
+ * only a limited number of tasks running at the same time, the rest wait
+ * in a queue of their own so that a slow database does not occupy all
+ * the threads. Tasks which have not started when the executor is shut
+ * down are abandoned, their futures report a broken promise.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <boost/asio/thread_pool.hpp>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class AsyncExecutor
+{
+ public:
+  AsyncExecutor(std::size_t theThreads, std::size_t theMaxPerKey);
+  ~AsyncExecutor();
+
+  AsyncExecutor() = delete;
+  AsyncExecutor(const AsyncExecutor& other) = delete;
+  AsyncExecutor& operator=(const AsyncExecutor& other) = delete;
+
+  template <typename Function>
+  auto submit(const std::string& theKey, Function&& theFunction)
+      -> std::future<decltype(theFunction())>
+  {
+    using Result = decltype(theFunction());
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Function>(theFunction));
+    auto future = task->get_future();
+    enqueue(theKey, [task]() { (*task)(); });
+    return future;
+  }
+
+  // Abandon queued tasks and wait for the running ones
+  void shutdown();
+
+ private:
+  using Task = std::function<void()>;
+
+  void enqueue(const std::string& theKey, Task theTask);
+  void start(const std::string& theKey, Task theTask);
+  void finished(const std::string& theKey);
+
+  struct Queue
+  {
+    std::size_t running = 0;
+    std::deque<Task> pending;
+  };
+
+  const std::size_t itsMaxPerKey;
+  bool itsShutdown = false;
+
+  std::mutex itsMutex;
+  std::map<std::string, Queue> itsQueues;
+
+  boost::asio::thread_pool itsPool;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
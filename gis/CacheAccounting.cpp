@@ -0,0 +1,320 @@
+#include "CacheAccounting.h"
+#include <fmt/format.h>
+#include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+// Age percentile in seconds from sorted ages
+double percentile(const std::vector<double>& theAges, double theFraction)
+{
+  if (theAges.empty())
+    return 0;
+  auto pos = static_cast<std::size_t>(theFraction * (theAges.size() - 1));
+  return theAges[pos];
+}
+}  // namespace
+
+CacheAccounting::CacheAccounting(std::string theName) : itsName(std::move(theName)) {}
+
+void CacheAccounting::resize(std::size_t theMaxSize)
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  itsMaxSize = theMaxSize;
+  while (itsEntries.size() > itsMaxSize)
+    evict();
+}
+
+void CacheAccounting::trackEntries(bool theFlag)
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  itsTracking = theFlag;
+  while (!theFlag && !itsEntries.empty())
+    erase(itsEntries.begin(), false);
+}
+
+// Counters of a table, created when first needed
+std::pair<const std::string, CacheAccounting::Counters>& CacheAccounting::counters(
+    const std::string& theTable)
+{
+  {
+    std::shared_lock<std::shared_mutex> lock(itsTablesMutex);
+    auto pos = itsTables.find(theTable);
+    if (pos != itsTables.end())
+      return *pos;
+  }
+  std::unique_lock<std::shared_mutex> lock(itsTablesMutex);
+  return *itsTables.try_emplace(theTable).first;
+}
+
+// Move a found entry to the front like caches do
+void CacheAccounting::touch(std::size_t theKey)
+{
+  if (!itsTracking)
+    return;
+
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto pos = itsPositions.find(theKey);
+  if (pos != itsPositions.end())
+    itsEntries.splice(itsEntries.begin(), itsEntries, pos->second);
+}
+
+void CacheAccounting::hit(std::size_t theKey, const std::string& theTable)
+{
+  try
+  {
+    counters(theTable).second.hits.fetch_add(1, std::memory_order_relaxed);
+    touch(theKey);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CacheAccounting::hit(const std::string& theKey, const std::string& theTable)
+{
+  try
+  {
+    counters(theTable).second.hits.fetch_add(1, std::memory_order_relaxed);
+    if (itsTracking)
+      touch(Fmi::hash_value(theKey));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CacheAccounting::miss(const std::string& theTable)
+{
+  counters(theTable).second.misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CacheAccounting::stageHit(const std::string& theKey, const std::string& theTable)
+{
+  try
+  {
+    counters(theTable).second.stage_hits.fetch_add(1, std::memory_order_relaxed);
+    if (itsTracking)
+      touch(Fmi::hash_value(theKey));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CacheAccounting::stageMiss(const std::string& theTable)
+{
+  counters(theTable).second.stage_misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CacheAccounting::notCachedEmpty(const std::string& theTable)
+{
+  counters(theTable).second.not_cached_empty.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CacheAccounting::insert(std::size_t theKey, const std::string& theTable, std::size_t theBytes)
+{
+  try
+  {
+    if (!itsTracking)
+    {
+      counters(theTable).second.inserts.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto& table = counters(theTable);
+    auto& c = table.second;
+    c.inserts.fetch_add(1, std::memory_order_relaxed);
+
+    // A concurrent request may have inserted the same key already
+    auto pos = itsPositions.find(theKey);
+    if (pos != itsPositions.end())
+      erase(pos->second, false);
+
+    itsEntries.push_front(Entry{theKey, &table.first, theBytes, Clock::now()});
+    itsPositions[theKey] = itsEntries.begin();
+    ++c.entries;
+    c.bytes += theBytes;
+
+    while (itsEntries.size() > itsMaxSize)
+      evict();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CacheAccounting::insert(const std::string& theKey,
+                             const std::string& theTable,
+                             std::size_t theBytes)
+{
+  if (itsTracking)
+    insert(Fmi::hash_value(theKey), theTable, theBytes);
+  else
+    counters(theTable).second.inserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CacheAccounting::remove(std::size_t theKey, bool theEvicted)
+{
+  if (!itsTracking)
+    return;
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto pos = itsPositions.find(theKey);
+  if (pos != itsPositions.end())
+    erase(pos->second, theEvicted);
+}
+
+void CacheAccounting::remove(const std::string& theKey, bool theEvicted)
+{
+  if (itsTracking)
+    remove(Fmi::hash_value(theKey), theEvicted);
+}
+
+void CacheAccounting::evictAll()
+{
+  if (!itsTracking)
+    return;
+  std::lock_guard<std::mutex> lock(itsMutex);
+  while (!itsEntries.empty())
+    evict();
+}
+
+// Remove the least recently used entry, the mutex must be locked
+void CacheAccounting::evict()
+{
+  erase(std::prev(itsEntries.end()), true);
+}
+
+// Remove an entry, the mutex must be locked
+void CacheAccounting::erase(std::list<Entry>::iterator thePos, bool theEvicted)
+{
+  auto& c = counters(*thePos->table).second;
+  if (theEvicted)
+    ++c.evictions;
+  --c.entries;
+  c.bytes -= thePos->bytes;
+  itsPositions.erase(thePos->key);
+  itsEntries.erase(thePos);
+}
+
+std::vector<std::string> CacheAccounting::names()
+{
+  return {"Cache",
+          "Table",
+          "Entries",
+          "Bytes",
+          "Hits",
+          "Misses",
+          "HitRate",
+          "StageHits",
+          "StageMisses",
+          "Inserts",
+          "Evictions",
+          "NotCachedEmpty",
+          "AgeP50s",
+          "AgeP90s",
+          "AgeMaxs"};
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append per-table rows and a total row marked with table '*'
+ */
+// ----------------------------------------------------------------------
+
+void CacheAccounting::addRows(Spine::Table& theTable, int& theRow) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    std::shared_lock<std::shared_mutex> tables_lock(itsTablesMutex);
+
+    // Entry ages in seconds by table
+    const auto now = Clock::now();
+    std::map<std::string, std::vector<double>> ages;
+    std::vector<double> all_ages;
+    for (const auto& entry : itsEntries)
+    {
+      double age = std::chrono::duration<double>(now - entry.time).count();
+      ages[*entry.table].push_back(age);
+      all_ages.push_back(age);
+    }
+
+    auto add_row = [&](const std::string& name, const Totals& c, std::vector<double>& a)
+    {
+      std::sort(a.begin(), a.end());
+      const auto lookups = c.hits + c.misses;
+      int col = 0;
+      theTable.set(col++, theRow, itsName);
+      theTable.set(col++, theRow, name);
+      theTable.set(col++, theRow, Fmi::to_string(c.entries));
+      theTable.set(col++, theRow, Fmi::to_string(c.bytes));
+      theTable.set(col++, theRow, Fmi::to_string(c.hits));
+      theTable.set(col++, theRow, Fmi::to_string(c.misses));
+      theTable.set(col++,
+                   theRow,
+                   fmt::format("{:.3f}", lookups > 0 ? static_cast<double>(c.hits) / lookups : 0));
+      theTable.set(col++, theRow, Fmi::to_string(c.stage_hits));
+      theTable.set(col++, theRow, Fmi::to_string(c.stage_misses));
+      theTable.set(col++, theRow, Fmi::to_string(c.inserts));
+      theTable.set(col++, theRow, Fmi::to_string(c.evictions));
+      theTable.set(col++, theRow, Fmi::to_string(c.not_cached_empty));
+      theTable.set(col++, theRow, fmt::format("{:.1f}", percentile(a, 0.5)));
+      theTable.set(col++, theRow, fmt::format("{:.1f}", percentile(a, 0.9)));
+      theTable.set(col++, theRow, fmt::format("{:.1f}", a.empty() ? 0.0 : a.back()));
+      ++theRow;
+    };
+
+    Totals total;
+    for (const auto& item : itsTables)
+    {
+      const auto& c = item.second;
+      Totals t;
+      t.hits = c.hits.load(std::memory_order_relaxed);
+      t.misses = c.misses.load(std::memory_order_relaxed);
+      t.stage_hits = c.stage_hits.load(std::memory_order_relaxed);
+      t.stage_misses = c.stage_misses.load(std::memory_order_relaxed);
+      t.inserts = c.inserts.load(std::memory_order_relaxed);
+      t.not_cached_empty = c.not_cached_empty.load(std::memory_order_relaxed);
+      t.evictions = c.evictions;
+      t.entries = c.entries;
+      t.bytes = c.bytes;
+
+      total.hits += t.hits;
+      total.misses += t.misses;
+      total.stage_hits += t.stage_hits;
+      total.stage_misses += t.stage_misses;
+      total.inserts += t.inserts;
+      total.evictions += t.evictions;
+      total.not_cached_empty += t.not_cached_empty;
+      total.entries += t.entries;
+      total.bytes += t.bytes;
+      add_row(item.first, t, ages[item.first]);
+    }
+    add_row("*", total, all_ages);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
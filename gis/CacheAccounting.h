@@ -0,0 +1,136 @@
+// ======================================================================
+/*!
+ * \brief Per-table accounting of cache contents
+ *
+ * Fmi::Cache reports only global hit and miss counters. The lookups,
+ * inserts and results which were not cached because they were empty
+ * are counted here per table with atomic counters. Lookups of requested
+ * results and of intermediate results, such as the outputs of processing
+ * stages, are counted separately so that each request is one lookup.
+ *
+ * Optionally the keys inserted into a cache are tracked in a mirror in
+ * least recently used order with the same capacity, which gives estimates
+ * of the resident bytes, entry ages and evictions per table. The mirror
+ * is updated under a lock on every hit, hence it is disabled by default.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <spine/Table.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class CacheAccounting
+{
+ public:
+  explicit CacheAccounting(std::string theName);
+
+  CacheAccounting() = delete;
+  CacheAccounting(const CacheAccounting& other) = delete;
+  CacheAccounting& operator=(const CacheAccounting& other) = delete;
+
+  void resize(std::size_t theMaxSize);
+
+  // Track the entries in the mirror, needed for entry counts, bytes, ages and evictions
+  void trackEntries(bool theFlag);
+
+  // String keys are hashed only if the entries are tracked
+  void hit(std::size_t theKey, const std::string& theTable);
+  void hit(const std::string& theKey, const std::string& theTable);
+  void miss(const std::string& theTable);
+  void stageHit(const std::string& theKey, const std::string& theTable);
+  void stageMiss(const std::string& theTable);
+  void insert(std::size_t theKey, const std::string& theTable, std::size_t theBytes);
+  void insert(const std::string& theKey, const std::string& theTable, std::size_t theBytes);
+  void notCachedEmpty(const std::string& theTable);
+
+  // Entry removed by the cache itself, optionally counted as an eviction
+  void remove(std::size_t theKey, bool theEvicted);
+  void remove(const std::string& theKey, bool theEvicted);
+
+  // All entries removed at once by the cache, counted as evictions
+  void evictAll();
+
+  // Append rows for each table and the cache total
+  void addRows(Spine::Table& theTable, int& theRow) const;
+
+  // Names of the table columns
+  static std::vector<std::string> names();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    std::size_t key;
+    const std::string* table;  // key of itsTables
+    std::size_t bytes;
+    Clock::time_point time;
+  };
+
+  struct Counters
+  {
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> stage_hits{0};
+    std::atomic<std::uint64_t> stage_misses{0};
+    std::atomic<std::uint64_t> inserts{0};
+    std::atomic<std::uint64_t> not_cached_empty{0};
+
+    // Updated with the mirror under its lock
+    std::uint64_t evictions = 0;
+    std::uint64_t entries = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  struct Totals
+  {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t stage_hits = 0;
+    std::uint64_t stage_misses = 0;
+    std::uint64_t inserts = 0;
+    std::uint64_t not_cached_empty = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t entries = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  std::pair<const std::string, Counters>& counters(const std::string& theTable);
+  void touch(std::size_t theKey);
+  void evict();
+  void erase(std::list<Entry>::iterator thePos, bool theEvicted);
+
+  const std::string itsName;
+  std::atomic<bool> itsTracking{false};
+
+  // Counters by table. Tables are never removed, hence the counters may be
+  // updated after the lock has been released. Locked after itsMutex if both are needed.
+  mutable std::shared_mutex itsTablesMutex;
+  std::map<std::string, Counters> itsTables;
+
+  // The mirror, entries in least recently used order, the latest first
+  mutable std::mutex itsMutex;
+  std::size_t itsMaxSize = 0;
+  std::list<Entry> itsEntries;
+  std::unordered_map<std::size_t, std::list<Entry>::iterator> itsPositions;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,296 @@
+#include "CompressedCache.h"
+#include <boost/asio/post.hpp>
+#include <macgyver/Exception.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Replace 8 byte words by their difference to the word two words back
+ *
+ * Interleaved coordinates become differences to the previous coordinate
+ * on the same axis. Coordinates stored with a limited precision then
+ * compress to about half of their size, plain doubles hardly compress
+ * at all. A tail shorter than a word is left as is.
+ */
+// ----------------------------------------------------------------------
+
+std::string delta_encode(std::string theData)
+{
+  const std::size_t words = theData.size() / 8;
+  for (std::size_t i = words; i-- > 2;)
+  {
+    std::uint64_t value = 0;
+    std::uint64_t previous = 0;
+    std::memcpy(&value, &theData[8 * i], 8);
+    std::memcpy(&previous, &theData[8 * (i - 2)], 8);
+    value -= previous;
+    std::memcpy(&theData[8 * i], &value, 8);
+  }
+  return theData;
+}
+
+std::string delta_decode(std::string theData)
+{
+  const std::size_t words = theData.size() / 8;
+  for (std::size_t i = 2; i < words; i++)
+  {
+    std::uint64_t value = 0;
+    std::uint64_t previous = 0;
+    std::memcpy(&value, &theData[8 * i], 8);
+    std::memcpy(&previous, &theData[8 * (i - 2)], 8);
+    value += previous;
+    std::memcpy(&theData[8 * i], &value, 8);
+  }
+  return theData;
+}
+
+std::string compress_data(const std::string& theData)
+{
+  auto n = compressBound(theData.size());
+  std::string ret(n, '\0');
+  if (compress2(reinterpret_cast<Bytef*>(&ret[0]),
+                &n,
+                reinterpret_cast<const Bytef*>(theData.data()),
+                theData.size(),
+                Z_BEST_SPEED) != Z_OK)
+    throw Fmi::Exception(BCP, "Failed to compress a cached geometry");
+  ret.resize(n);
+  ret.shrink_to_fit();
+  return ret;
+}
+
+std::string uncompress_data(const std::string& theData, std::size_t theSize)
+{
+  std::string ret(theSize, '\0');
+  uLongf n = theSize;
+  if (uncompress(reinterpret_cast<Bytef*>(&ret[0]),
+                 &n,
+                 reinterpret_cast<const Bytef*>(theData.data()),
+                 theData.size()) != Z_OK ||
+      n != theSize)
+    throw Fmi::Exception(BCP, "Failed to uncompress a cached geometry");
+  return ret;
+}
+
+}  // namespace
+
+CompressedCache::CompressedCache(std::size_t theMaxBytes, std::size_t theMinBytes)
+    : itsMaxBytes(theMaxBytes), itsMinBytes(theMinBytes)
+{
+  // The size is limited in bytes instead of entries. Hits are rare
+  // since this is the second tier, hence the entries can be tracked.
+  itsAccounting.resize(std::numeric_limits<std::size_t>::max());
+  itsAccounting.trackEntries(true);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Share a geometry with a deleter which demotes it to this cache
+ *
+ * Small geometries are not worth compressing and are shared as is, and
+ * views to shared memory need not be kept here.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FlatGeometry> CompressedCache::manage(
+    const std::string& theKey,
+    const std::string& theTable,
+    std::unique_ptr<FlatGeometry> theGeometry)
+{
+  try
+  {
+    if (theGeometry->isView() || theGeometry->bytes() < itsMinBytes)
+      return std::shared_ptr<const FlatGeometry>(std::move(theGeometry));
+
+    std::weak_ptr<CompressedCache> cache = shared_from_this();
+    return std::shared_ptr<const FlatGeometry>(
+        theGeometry.release(),
+        [cache, theKey, theTable](const FlatGeometry* p)
+        {
+          std::shared_ptr<const FlatGeometry> geom(p);
+          auto self = cache.lock();
+          if (!self)
+            return;
+          try
+          {
+            self->schedule(theKey, theTable, std::move(geom));
+          }
+          catch (...)
+          {
+            Fmi::Exception::Trace(BCP, "Failed to demote a cached geometry").printError();
+          }
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CompressedCache::schedule(const std::string& theKey,
+                               const std::string& theTable,
+                               std::shared_ptr<const FlatGeometry> theGeometry)
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    if (itsShutdown)
+      return;
+  }
+
+  boost::asio::post(itsPool,
+                    [this, theKey, theTable, geom = std::move(theGeometry)]()
+                    {
+                      try
+                      {
+                        demote(theKey, theTable, *geom);
+                      }
+                      catch (...)
+                      {
+                        Fmi::Exception::Trace(BCP, "Failed to demote a cached geometry")
+                            .printError();
+                      }
+                    });
+}
+
+void CompressedCache::demote(const std::string& theKey,
+                             const std::string& theTable,
+                             const FlatGeometry& theGeometry)
+{
+  try
+  {
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      if (itsShutdown)
+        return;
+    }
+
+    auto packed = theGeometry.pack();
+
+    Entry entry;
+    entry.key = theKey;
+    entry.size = packed.data.size();
+    entry.data = std::make_shared<const std::string>(
+        compress_data(delta_encode(std::move(packed.data))));
+    entry.spatialReferences = std::move(packed.spatialReferences);
+
+    const auto bytes = entry.data->size();
+    if (bytes > itsMaxBytes)
+      return;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto pos = itsPositions.find(theKey);
+    if (pos != itsPositions.end())
+    {
+      itsBytes -= pos->second->data->size();
+      itsEntries.erase(pos->second);
+      itsPositions.erase(pos);
+    }
+
+    itsEntries.push_front(std::move(entry));
+    itsPositions[theKey] = itsEntries.begin();
+    itsBytes += bytes;
+    itsAccounting.insert(theKey, theTable, bytes);
+
+    while (itsBytes > itsMaxBytes)
+    {
+      const auto& last = itsEntries.back();
+      itsBytes -= last.data->size();
+      itsAccounting.remove(last.key, true);
+      itsPositions.erase(last.key);
+      itsEntries.pop_back();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Inflate an entry and remove it from this tier
+ *
+ * The compressed data is shared with the entry, so that it can be
+ * inflated without copying it or holding the lock. The entry is removed
+ * only after it has been inflated, so a failure does not lose it.
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<FlatGeometry> CompressedCache::take(const std::string& theKey,
+                                                    const std::string& theTable)
+{
+  try
+  {
+    std::shared_ptr<const std::string> data;
+    std::size_t size = 0;
+    FlatGeometry::Packed packed;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto pos = itsPositions.find(theKey);
+      if (pos == itsPositions.end())
+      {
+        itsAccounting.miss(theTable);
+        return {};
+      }
+      data = pos->second->data;
+      size = pos->second->size;
+      packed.spatialReferences = pos->second->spatialReferences;
+    }
+
+    packed.data = delta_decode(uncompress_data(*data, size));
+    auto ret = std::make_unique<FlatGeometry>(packed);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsAccounting.hit(theKey, theTable);
+
+    // A concurrent take may have removed the entry or a demotion replaced it
+    auto pos = itsPositions.find(theKey);
+    if (pos != itsPositions.end() && pos->second->data == data)
+    {
+      itsAccounting.remove(theKey, false);
+      itsBytes -= data->size();
+      itsEntries.erase(pos->second);
+      itsPositions.erase(pos);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void CompressedCache::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsShutdown = true;
+    itsEntries.clear();
+    itsPositions.clear();
+    itsBytes = 0;
+  }
+  itsPool.stop();
+  itsPool.join();
+}
+
+void CompressedCache::addRows(Spine::Table& theTable, int& theRow) const
+{
+  itsAccounting.addRows(theTable, theRow);
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
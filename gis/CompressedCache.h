@@ -0,0 +1,95 @@
+// ======================================================================
+/*!
+ * \brief Compressed second tier for the geometry cache
+ *
+ * Geometries handed out by manage() are compressed into this cache when
+ * the last reference to them is dropped, which happens when the main
+ * cache evicts them and no request holds them any more. A later lookup
+ * inflates the entry and removes it from this tier so that it can be
+ * promoted back to the main cache. Entries are evicted in least recently
+ * used order when the compressed size limit is reached. Compression is
+ * done in a background thread, since the last reference may be dropped
+ * while the main cache is locked. Entries are inflated without holding
+ * the lock and removed only once inflated successfully.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "CacheAccounting.h"
+#include "FlatGeometry.h"
+#include <boost/asio/thread_pool.hpp>
+#include <spine/Table.h>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class CompressedCache : public std::enable_shared_from_this<CompressedCache>
+{
+ public:
+  CompressedCache(std::size_t theMaxBytes, std::size_t theMinBytes);
+
+  CompressedCache() = delete;
+  CompressedCache(const CompressedCache& other) = delete;
+  CompressedCache& operator=(const CompressedCache& other) = delete;
+
+  // Shared geometry which is demoted to this cache once it is no longer used
+  std::shared_ptr<const FlatGeometry> manage(const std::string& theKey,
+                                             const std::string& theTable,
+                                             std::unique_ptr<FlatGeometry> theGeometry);
+
+  // Remove and inflate an entry, nullptr if there is none
+  std::unique_ptr<FlatGeometry> take(const std::string& theKey, const std::string& theTable);
+
+  // Stop accepting new entries and compressing pending ones
+  void shutdown();
+
+  // Append accounting rows for each table and the total
+  void addRows(Spine::Table& theTable, int& theRow) const;
+
+ private:
+  void schedule(const std::string& theKey,
+                const std::string& theTable,
+                std::shared_ptr<const FlatGeometry> theGeometry);
+  void demote(const std::string& theKey,
+              const std::string& theTable,
+              const FlatGeometry& theGeometry);
+
+  struct Entry
+  {
+    std::string key;
+    std::shared_ptr<const std::string> data;  // compressed buffers
+    std::size_t size = 0;                     // uncompressed size
+    std::vector<std::shared_ptr<OGRSpatialReference>> spatialReferences;
+  };
+
+  const std::size_t itsMaxBytes;
+  const std::size_t itsMinBytes;
+
+  mutable std::mutex itsMutex;
+  bool itsShutdown = false;
+  std::size_t itsBytes = 0;
+
+  // entries in least recently used order, the latest first
+  std::list<Entry> itsEntries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> itsPositions;
+
+  CacheAccounting itsAccounting{"Gis::compressed_geometry_cache"};
+
+  // declared last so that a running compression ends before the rest is destroyed
+  boost::asio::thread_pool itsPool{1};
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
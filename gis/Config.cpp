@@ -14,6 +14,7 @@
 #include <sqlite3pp/sqlite3pp.h>
 #include <sqlite3pp/sqlite3ppext.h>
 #include <cpl_conv.h>  // For configuring GDAL
+#include <cmath>
 #include <filesystem>
 #include <iostream>
 #include <sqlite3.h>
@@ -89,6 +90,7 @@ void Config::read_postgis_settings()
   itsConfig.lookupValue("postgis.username", itsDefaultConnectionInfo.username);
   itsConfig.lookupValue("postgis.password", itsDefaultConnectionInfo.password);
   itsConfig.lookupValue("postgis.encoding", itsDefaultConnectionInfo.encoding);
+  read_admission_settings("postgis", itsDefaultConnectionInfo);
 
   libconfig::Setting& pg_sett = itsConfig.lookup("postgis");
   int n_pgsett = pg_sett.getLength();
@@ -108,11 +110,32 @@ void Config::read_postgis_settings()
       itsConfig.lookupValue("postgis." + sett_name + ".password", pgci.password);
       itsConfig.lookupValue("postgis." + sett_name + ".encoding", pgci.encoding);
 
+      pgci.max_connections = itsDefaultConnectionInfo.max_connections;
+      pgci.queue_timeout = itsDefaultConnectionInfo.queue_timeout;
+      pgci.statement_timeout = itsDefaultConnectionInfo.statement_timeout;
+      read_admission_settings("postgis." + sett_name, pgci);
+
       itsConnectionInfo.insert(make_pair(sett_name, pgci));
     }
   }
 }
 
+// Concurrency limit and timeouts of a database
+void Config::read_admission_settings(const std::string& thePath,
+                                     postgis_connection_info& theInfo) const
+{
+  itsConfig.lookupValue(thePath + ".max_connections", theInfo.max_connections);
+  itsConfig.lookupValue(thePath + ".queue_timeout", theInfo.queue_timeout);
+  itsConfig.lookupValue(thePath + ".statement_timeout", theInfo.statement_timeout);
+
+  if (theInfo.max_connections < 0 || theInfo.queue_timeout < 0 || theInfo.statement_timeout < 0)
+    throw Fmi::Exception(BCP,
+                         "The max_connections, queue_timeout and statement_timeout settings "
+                         "must be nonnegative")
+        .addParameter("Setting", thePath)
+        .addParameter("Configuration file", itsFileName);
+}
+
 void Config::read_postgis_info()
 {
   if (!itsConfig.exists("info"))
@@ -152,10 +175,98 @@ void Config::read_postgis_info()
         std::string key = schema_name + '.' + table_name;
         itsPostGisTimeStepMap.insert(std::make_pair(key, timestep));
       }
+
+      if (table.exists("extent"))
+      {
+        std::string key = schema_name + '.' + table_name;
+        std::string name = table["extent"];
+        ExtentMode mode = ExtentMode::Exact;
+        if (name == "fixed")
+        {
+          if (!table.exists("bbox"))
+            throw Fmi::Exception(BCP, "Fixed extent requires a bbox setting")
+                .addParameter("Table", key)
+                .addParameter("Configuration file", itsFileName);
+          mode = ExtentMode::Fixed;
+        }
+        else if (name == "estimated")
+          mode = ExtentMode::Estimated;
+        else if (name == "exact")
+          mode = ExtentMode::Exact;
+        else if (name == "latest")
+          mode = ExtentMode::Latest;
+        else
+          throw Fmi::Exception(BCP, "Unknown extent mode '" + name + "'")
+              .addDetail("Valid modes are fixed, estimated, exact and latest")
+              .addParameter("Table", key)
+              .addParameter("Configuration file", itsFileName);
+        itsPostGisExtentModeMap.insert(std::make_pair(key, mode));
+      }
+
+      if (table.exists("lod"))
+      {
+        std::string key = schema_name + '.' + table_name;
+        const auto& lod = table["lod"];
+        double tolerance = 0;
+        int levels = 0;
+        double factor = 2;
+        if (!lod.isGroup() || !lod.lookupValue("tolerance", tolerance) ||
+            !lod.lookupValue("levels", levels))
+          throw Fmi::Exception(BCP, "The 'lod' setting must be a group with tolerance and levels")
+              .addParameter("Table", key)
+              .addParameter("Configuration file", itsFileName);
+        lod.lookupValue("factor", factor);
+        if (tolerance <= 0 || levels < 1 || factor <= 1)
+          throw Fmi::Exception(
+              BCP, "The 'lod' tolerance and levels must be positive and the factor above one")
+              .addParameter("Table", key)
+              .addParameter("Configuration file", itsFileName);
+
+        std::vector<double> tolerances;
+        for (int level = 0; level < levels; level++)
+          tolerances.push_back(tolerance * std::pow(factor, level));
+        itsPostGisLODMap.insert(std::make_pair(key, tolerances));
+      }
     }
   }
 }
 
+void Config::read_file_settings()
+{
+  if (!itsConfig.exists("files"))
+    return;
+
+  const auto& files = itsConfig.lookup("files");
+  if (!files.isGroup())
+    throw Fmi::Exception(BCP, "files setting must be a group")
+        .addParameter("Configuration file", itsFileName);
+
+  for (int i = 0; i < files.getLength(); i++)
+  {
+    const auto& source = files[i];
+    std::string name = source.getName();
+
+    if (!source.isGroup() || !source.exists("path"))
+      throw Fmi::Exception(BCP, "files settings must be groups with a path setting")
+          .addParameter("Source", name)
+          .addParameter("Configuration file", itsFileName);
+
+    if (itsConnectionInfo.find(name) != itsConnectionInfo.end())
+      throw Fmi::Exception(BCP, "Source is defined both as a file and as a PostGIS database")
+          .addParameter("Source", name)
+          .addParameter("Configuration file", itsFileName);
+
+    std::string path = source["path"];
+    if (!path.empty() && path[0] != '/')
+    {
+      // Handle relative paths assuming they are relative to the config itself
+      std::filesystem::path p(itsFileName);
+      path = p.parent_path().string() + "/" + path;
+    }
+    itsFileSources[name] = path;
+  }
+}
+
 void Config::read_cache_settings()
 {
   if (!itsConfig.exists("cache.max_size"))
@@ -165,6 +276,22 @@ void Config::read_cache_settings()
   }
 
   itsConfig.lookupValue("cache.max_size", itsMaxCacheSize);
+  itsConfig.lookupValue("cache.timestep_reconcile_interval", itsTimeStepReconcileInterval);
+  itsConfig.lookupValue("cache.metadata_ttl", itsMetaDataTTL);
+  itsConfig.lookupValue("cache.compressed_max_megabytes", itsCompressedCacheMegaBytes);
+  itsConfig.lookupValue("cache.compressed_min_kilobytes", itsCompressedCacheMinKiloBytes);
+  itsConfig.lookupValue("cache.shared_path", itsSharedCachePath);
+  itsConfig.lookupValue("cache.shared_megabytes", itsSharedCacheMegaBytes);
+  itsConfig.lookupValue("cache.shared_slots", itsSharedCacheSlots);
+  itsConfig.lookupValue("cache.track_entries", itsTrackCacheEntries);
+
+  if (itsCompressedCacheMegaBytes < 0 || itsCompressedCacheMinKiloBytes < 0)
+    throw Fmi::Exception(BCP, "The compressed cache sizes must be nonnegative")
+        .addParameter("Configuration file", itsFileName);
+
+  if (!itsSharedCachePath.empty() && (itsSharedCacheMegaBytes <= 0 || itsSharedCacheSlots <= 0))
+    throw Fmi::Exception(BCP, "The shared cache size and slots must be positive")
+        .addParameter("Configuration file", itsFileName);
 }
 
 void Config::read_gdal_settings()
@@ -187,6 +314,61 @@ void Config::read_gdal_settings()
   }
 }
 
+void Config::read_slow_query_settings()
+{
+  if (!itsConfig.exists("slow_query_log"))
+    return;
+
+  const auto& settings = itsConfig.lookup("slow_query_log");
+  if (!settings.isGroup())
+    throw Fmi::Exception(BCP, "The 'slow_query_log' setting must be a group!")
+        .addParameter("Configuration file", itsFileName);
+
+  for (int i = 0; i < settings.getLength(); i++)
+  {
+    const auto& value = settings[i];
+    std::string name = value.getName();
+    if (name == "history")
+    {
+      itsSlowQueryHistory = value;
+      if (itsSlowQueryHistory < 0)
+        throw Fmi::Exception(BCP, "The 'slow_query_log.history' setting must be nonnegative")
+            .addParameter("Configuration file", itsFileName);
+    }
+    else if (name == "shape" || name == "features" || name == "metadata")
+    {
+      int threshold = value;
+      if (threshold >= 0)
+        itsSlowQueryThresholds[name] = threshold;
+    }
+    else
+      throw Fmi::Exception(BCP, "Unknown slow_query_log setting '" + name + "'")
+          .addDetail("Valid settings are history, shape, features and metadata")
+          .addParameter("Configuration file", itsFileName);
+  }
+}
+
+void Config::read_fast_projection_settings()
+{
+  itsConfig.lookupValue("fast_projections.enabled", itsFastProjections);
+  itsConfig.lookupValue("fast_projections.tolerance", itsFastProjectionTolerance);
+  if (itsFastProjectionTolerance <= 0)
+    throw Fmi::Exception(BCP, "The 'fast_projections.tolerance' setting must be positive")
+        .addParameter("Configuration file", itsFileName);
+}
+
+void Config::read_async_settings()
+{
+  itsConfig.lookupValue("async.threads", itsAsyncThreads);
+  itsConfig.lookupValue("async.max_per_pgname", itsAsyncMaxPerPGName);
+  if (itsAsyncThreads < 1)
+    throw Fmi::Exception(BCP, "The 'async.threads' setting must be positive")
+        .addParameter("Configuration file", itsFileName);
+  if (itsAsyncMaxPerPGName < 1)
+    throw Fmi::Exception(BCP, "The 'async.max_per_pgname' setting must be positive")
+        .addParameter("Configuration file", itsFileName);
+}
+
 Fmi::BBox Config::read_bbox(const libconfig::Setting& theSetting) const
 {
   if (!theSetting.isArray())
@@ -234,15 +416,34 @@ Config::Config(std::string theFileName) : itsFileName(std::move(theFileName))
 
       itsConfig.lookupValue("quiet", itsQuiet);
 
+      itsConfig.lookupValue("threads", itsThreads);
+      if (itsThreads < 1)
+        throw Fmi::Exception(BCP, "The 'threads' setting must be positive")
+            .addParameter("Configuration file", itsFileName);
+
+      itsConfig.lookupValue("parallel_reprojection_points", itsParallelReprojectionPoints);
+      if (itsParallelReprojectionPoints < 0)
+        throw Fmi::Exception(BCP, "The 'parallel_reprojection_points' setting must be nonnegative")
+            .addParameter("Configuration file", itsFileName);
+
+      itsConfig.lookupValue("native_reprojection", itsNativeReprojection);
+
       int default_epsg = -1;
       itsConfig.lookupValue("default_epsg", default_epsg);
       if (default_epsg > 0)
         itsDefaultEPSG = default_epsg;
 
       read_crs_settings();
-      read_postgis_settings();
+
+      // PostGIS settings are optional if only files are used
+      if (itsConfig.exists("postgis") || !itsConfig.exists("files"))
+        read_postgis_settings();
+      read_file_settings();
       read_cache_settings();
       read_gdal_settings();
+      read_slow_query_settings();
+      read_fast_projection_settings();
+      read_async_settings();
       read_postgis_info();
 
       if (itsConfig.exists("bbox"))
@@ -298,6 +499,20 @@ const postgis_connection_info& Config::getPostGISConnectionInfo(const std::strin
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the path of a file data source, or nothing for PostGIS
+ */
+// ----------------------------------------------------------------------
+
+std::optional<std::string> Config::getFileSource(const std::string& thePGName) const
+{
+  auto pos = itsFileSources.find(thePGName);
+  if (pos == itsFileSources.end())
+    return {};
+  return pos->second;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Get the default EPSG for tables whose SRID is missing
@@ -341,6 +556,42 @@ std::optional<Fmi::TimeDuration> Config::getTableTimeStep(const std::string& the
   return pos->second;
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the method for calculating the table envelope
+ *
+ * A configured bbox implies a fixed extent unless some other mode is set.
+ */
+// ----------------------------------------------------------------------
+
+ExtentMode Config::getTableExtentMode(const std::string& theSchema,
+                                      const std::string& theTable) const
+{
+  std::string key = theSchema + "." + theTable;
+  auto pos = itsPostGisExtentModeMap.find(key);
+  if (pos != itsPostGisExtentModeMap.end())
+    return pos->second;
+  if (itsPostGisBBoxMap.find(key) != itsPostGisBBoxMap.end())
+    return ExtentMode::Fixed;
+  return ExtentMode::Exact;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the level of detail tolerances of the table, if any
+ */
+// ----------------------------------------------------------------------
+
+const std::vector<double>& Config::getTableLOD(const std::string& theSchema,
+                                               const std::string& theTable) const
+{
+  static const std::vector<double> none;
+  auto pos = itsPostGisLODMap.find(theSchema + "." + theTable);
+  if (pos == itsPostGisLODMap.end())
+    return none;
+  return pos->second;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Return true for quiet mode
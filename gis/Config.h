@@ -7,6 +7,7 @@
 #include <spine/CRSRegistry.h>
 #include <libconfig.h++>
 #include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -23,6 +24,18 @@ struct postgis_connection_info
   std::string username;
   std::string password;
   std::string encoding;
+  int max_connections = 0;    // concurrent queries, zero for no limit
+  int queue_timeout = 0;      // milliseconds to wait for a connection, zero for no limit
+  int statement_timeout = 0;  // milliseconds, zero for no limit
+};
+
+// table envelope calculation method
+enum class ExtentMode
+{
+  Exact,      // ST_Extent over the full table
+  Estimated,  // ST_EstimatedExtent, falls back to Exact if there are no statistics
+  Latest,     // ST_Extent over the latest time only
+  Fixed       // configured bbox
 };
 
 class Config
@@ -41,14 +54,42 @@ class Config
   Spine::CRSRegistry& getCRSRegistry();
 
   const postgis_connection_info& getPostGISConnectionInfo(const std::string& thePGName) const;
+  std::optional<std::string> getFileSource(const std::string& thePGName) const;
 
   int getMaxCacheSize() const { return itsMaxCacheSize; }
+  int getTimeStepReconcileInterval() const { return itsTimeStepReconcileInterval; }
+  int getMetaDataTTL() const { return itsMetaDataTTL; }
+  int getCompressedCacheMegaBytes() const { return itsCompressedCacheMegaBytes; }
+  int getCompressedCacheMinKiloBytes() const { return itsCompressedCacheMinKiloBytes; }
+  const std::string& getSharedCachePath() const { return itsSharedCachePath; }
+  int getSharedCacheMegaBytes() const { return itsSharedCacheMegaBytes; }
+  int getSharedCacheSlots() const { return itsSharedCacheSlots; }
+  bool getTrackCacheEntries() const { return itsTrackCacheEntries; }
+  int getThreads() const { return itsThreads; }
+  int getParallelReprojectionPoints() const { return itsParallelReprojectionPoints; }
+  bool getNativeReprojection() const { return itsNativeReprojection; }
+  int getAsyncThreads() const { return itsAsyncThreads; }
+  int getAsyncMaxPerPGName() const { return itsAsyncMaxPerPGName; }
+
+  // slow query log thresholds in milliseconds by operation
+  const std::map<std::string, int>& getSlowQueryThresholds() const
+  {
+    return itsSlowQueryThresholds;
+  }
+  int getSlowQueryHistory() const { return itsSlowQueryHistory; }
+
+  // fast projection kernels and their tolerance against PROJ in meters
+  bool getFastProjections() const { return itsFastProjections; }
+  double getFastProjectionTolerance() const { return itsFastProjectionTolerance; }
 
   std::optional<int> getDefaultEPSG() const;
   std::optional<Fmi::BBox> getTableBBox(const std::string& theSchema,
                                           const std::string& theTable) const;
   std::optional<Fmi::TimeDuration> getTableTimeStep(
       const std::string& theSchema, const std::string& theTable) const;
+  ExtentMode getTableExtentMode(const std::string& theSchema, const std::string& theTable) const;
+  const std::vector<double>& getTableLOD(const std::string& theSchema,
+                                        const std::string& theTable) const;
 
   bool quiet() const;
 
@@ -57,8 +98,14 @@ class Config
   void require_postgis_settings() const;
   void read_postgis_settings();
   void read_postgis_info();
+  void read_admission_settings(const std::string& thePath,
+                               postgis_connection_info& theInfo) const;
+  void read_file_settings();
   void read_cache_settings();
   void read_gdal_settings();
+  void read_slow_query_settings();
+  void read_fast_projection_settings();
+  void read_async_settings();
   void read_bbox_settings();
   Fmi::BBox read_bbox(const libconfig::Setting& theSetting) const;
 
@@ -70,8 +117,40 @@ class Config
   postgis_connection_info itsDefaultConnectionInfo;
   std::map<std::string, postgis_connection_info> itsConnectionInfo;
 
+  // Local files used instead of PostGIS, paths by pgname
+  std::map<std::string, std::string> itsFileSources;
+
   // cache settings
   int itsMaxCacheSize = 0;
+  int itsTimeStepReconcileInterval = 3600;  // seconds
+  int itsMetaDataTTL = 0;                   // seconds, zero disables the cache
+  int itsCompressedCacheMegaBytes = 0;      // zero disables the compressed tier
+  int itsCompressedCacheMinKiloBytes = 64;  // smaller geometries are not compressed
+  std::string itsSharedCachePath;           // empty disables the shared cache
+  int itsSharedCacheMegaBytes = 1024;       // fixed size of the shared file
+  int itsSharedCacheSlots = 100000;         // fixed size of the shared index
+  bool itsTrackCacheEntries = false;        // cache accounting of entries, bytes and ages
+
+  // slow query log settings
+  std::map<std::string, int> itsSlowQueryThresholds;
+  int itsSlowQueryHistory = 100;
+
+  // fast projection settings
+  bool itsFastProjections = true;
+  double itsFastProjectionTolerance = 0.001;  // meters
+
+  // worker threads for background tasks
+  int itsThreads = 4;
+
+  // minimum size of geometries reprojected in parallel, zero disables
+  int itsParallelReprojectionPoints = 100000;
+
+  // read shapes in their own spatial reference and reproject them in the engine
+  bool itsNativeReprojection = true;
+
+  // threads for asynchronous requests and their limit per database
+  int itsAsyncThreads = 8;
+  int itsAsyncMaxPerPGName = 4;
 
   // Default EPSG for PostGIS geometries which have no SRID
   std::optional<int> itsDefaultEPSG;
@@ -85,6 +164,13 @@ class Config
 
   using PostGisTimeStepMap = std::map<std::string, Fmi::TimeDuration>;
   PostGisTimeStepMap itsPostGisTimeStepMap;
+
+  using PostGisExtentModeMap = std::map<std::string, ExtentMode>;
+  PostGisExtentModeMap itsPostGisExtentModeMap;
+
+  // level of detail tolerances for mindistance in ascending order
+  using PostGisLODMap = std::map<std::string, std::vector<double>>;
+  PostGisLODMap itsPostGisLODMap;
 };
 
 }  // namespace Gis
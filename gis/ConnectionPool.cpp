@@ -0,0 +1,204 @@
+#include "ConnectionPool.h"
+#include "Config.h"
+#include "FileSource.h"
+#include <gis/Host.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <chrono>
+#include <cpl_error.h>
+#include <exception>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+ConnectionPool::Connection::Connection(ConnectionPool& thePool,
+                                       std::string thePGName,
+                                       GDALDataPtr theConnection)
+    : itsPool(&thePool),
+      itsPGName(std::move(thePGName)),
+      itsConnection(std::move(theConnection)),
+      itsUncaughtExceptions(std::uncaught_exceptions())
+{
+}
+
+ConnectionPool::Connection::Connection(Connection&& other) noexcept
+    : itsPool(other.itsPool),
+      itsPGName(std::move(other.itsPGName)),
+      itsConnection(std::move(other.itsConnection)),
+      itsUncaughtExceptions(other.itsUncaughtExceptions)
+{
+  other.itsPool = nullptr;
+}
+
+ConnectionPool::Connection::~Connection()
+{
+  try
+  {
+    if (!itsPool)
+      return;
+    if (std::uncaught_exceptions() > itsUncaughtExceptions)
+      itsConnection.reset();
+    itsPool->release(itsPGName, std::move(itsConnection));
+  }
+  catch (...)
+  {
+    // Destructors must not throw, the connection is simply not reused
+  }
+}
+
+ConnectionPool::ConnectionPool(const Config& theConfig) : itsConfig(theConfig) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get an idle connection or open a new one
+ *
+ * File data sources are opened once per concurrent user too, since
+ * GDAL datasets keep the read position of each layer.
+ */
+// ----------------------------------------------------------------------
+
+ConnectionPool::Connection ConnectionPool::get(const std::string& thePGName)
+{
+  try
+  {
+    std::size_t max_connections = 0;
+    int queue_timeout = 0;
+    if (!itsConfig.getFileSource(thePGName))
+    {
+      const auto& pgci = itsConfig.getPostGISConnectionInfo(thePGName);
+      max_connections = pgci.max_connections;
+      queue_timeout = pgci.queue_timeout;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(itsMutex);
+      auto& database = itsDatabases[thePGName];
+
+      auto admitted = [this, &database, max_connections]()
+      { return itsShutdown || max_connections == 0 || database.active < max_connections; };
+
+      // Queue up unless admitted immediately without passing earlier waiters
+      if (!database.waiters.empty() || !admitted())
+      {
+        std::condition_variable ready;
+        database.waiters.push_back(&ready);
+
+        auto turn = [this, &database, &ready, &admitted]()
+        { return itsShutdown || (database.waiters.front() == &ready && admitted()); };
+
+        bool ok = true;
+        if (queue_timeout == 0)
+          ready.wait(lock, turn);
+        else
+          ok = ready.wait_for(lock, std::chrono::milliseconds(queue_timeout), turn);
+
+        // The next waiter may be admitted too if there is room
+        database.waiters.erase(
+            std::find(database.waiters.begin(), database.waiters.end(), &ready));
+        if (!database.waiters.empty())
+          database.waiters.front()->notify_one();
+
+        if (!ok)
+          throw Fmi::Exception(BCP, "Timed out waiting for a database connection")
+              .addParameter("Queue timeout", Fmi::to_string(queue_timeout) + " ms")
+              .addParameter("Active connections", Fmi::to_string(database.active))
+              .addParameter("Waiting", Fmi::to_string(database.waiters.size()));
+      }
+
+      if (itsShutdown)
+        throw Fmi::Exception(BCP, "Database request cancelled due to shutdown");
+
+      ++database.active;
+
+      if (!database.idle.empty())
+      {
+        auto connection = std::move(database.idle.back());
+        database.idle.pop_back();
+        return {*this, thePGName, std::move(connection)};
+      }
+    }
+
+    // Open a new connection without holding the lock, releasing the slot on failure
+    GDALDataPtr connection;
+    try
+    {
+      connection = open(thePGName);
+    }
+    catch (...)
+    {
+      release(thePGName, nullptr);
+      throw;
+    }
+    return {*this, thePGName, std::move(connection)};
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("pgname", thePGName);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Open a new connection
+ *
+ * PostGIS connections get the configured statement timeout, after which
+ * the server cancels the query. A connection without the timeout is not
+ * used, since a slow query could then stall it indefinitely.
+ */
+// ----------------------------------------------------------------------
+
+GDALDataPtr ConnectionPool::open(const std::string& thePGName) const
+{
+  auto path = itsConfig.getFileSource(thePGName);
+  if (path)
+    return FileSource::open(*path);
+
+  const postgis_connection_info& pgci = itsConfig.getPostGISConnectionInfo(thePGName);
+  Fmi::Host host(pgci.host, pgci.database, pgci.username, pgci.password, pgci.port);
+
+  auto connection = host.connect();
+
+  if (pgci.statement_timeout > 0)
+  {
+    auto sql = "SET statement_timeout = " + Fmi::to_string(pgci.statement_timeout);
+    CPLErrorReset();
+    auto* result = connection->ExecuteSQL(sql.c_str(), nullptr, nullptr);
+    if (result)
+      connection->ReleaseResultSet(result);
+    if (CPLGetLastErrorType() >= CE_Failure)
+      throw Fmi::Exception(BCP, "Failed to set the statement timeout")
+          .addParameter("Timeout", Fmi::to_string(pgci.statement_timeout) + " ms")
+          .addParameter("Error", CPLGetLastErrorMsg());
+  }
+
+  return connection;
+}
+
+void ConnectionPool::release(const std::string& thePGName, GDALDataPtr theConnection)
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto& database = itsDatabases[thePGName];
+  if (database.active > 0)
+    --database.active;
+  if (theConnection && !itsShutdown)
+    database.idle.push_back(std::move(theConnection));
+  if (!database.waiters.empty())
+    database.waiters.front()->notify_one();
+}
+
+void ConnectionPool::shutdown()
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  itsShutdown = true;
+  for (auto& database : itsDatabases)
+    for (auto* waiter : database.second.waiters)
+      waiter->notify_one();
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
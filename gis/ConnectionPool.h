@@ -0,0 +1,96 @@
+// ======================================================================
+/*!
+ * \brief Pool of database connections per pgname
+ *
+ * GDAL datasets are not thread safe, hence a connection is handed out
+ * to a single user at a time and returned to the pool when the handle
+ * is destroyed. Connections released while an exception is in flight
+ * are discarded, since they may be in an unknown state. Local file
+ * data sources are pooled the same way.
+ *
+ * The number of connections in use may be limited per pgname. Callers
+ * wait for a free connection in a queue and are admitted in the order
+ * of arrival, at most for the configured queue timeout. Each waiter has
+ * its own condition variable so that only the first one is woken up.
+ * Waiting callers are released with an error on shutdown.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/Types.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class Config;
+
+class ConnectionPool
+{
+ public:
+  class Connection
+  {
+   public:
+    ~Connection();
+    Connection(ConnectionPool& thePool, std::string thePGName, GDALDataPtr theConnection);
+
+    Connection() = delete;
+    Connection(const Connection& other) = delete;
+    Connection& operator=(const Connection& other) = delete;
+    Connection(Connection&& other) noexcept;
+    Connection& operator=(Connection&& other) = delete;
+
+    const GDALDataPtr& get() const { return itsConnection; }
+    GDALDataset* operator->() const { return itsConnection.get(); }
+
+   private:
+    ConnectionPool* itsPool;
+    std::string itsPGName;
+    GDALDataPtr itsConnection;
+    int itsUncaughtExceptions;
+  };
+
+  explicit ConnectionPool(const Config& theConfig);
+
+  ConnectionPool() = delete;
+  ConnectionPool(const ConnectionPool& other) = delete;
+  ConnectionPool& operator=(const ConnectionPool& other) = delete;
+  ConnectionPool(ConnectionPool&& other) = delete;
+  ConnectionPool& operator=(ConnectionPool&& other) = delete;
+
+  Connection get(const std::string& thePGName);
+
+  // Fail all current and future waits for a connection
+  void shutdown();
+
+ private:
+  // a null connection is not reused
+  void release(const std::string& thePGName, GDALDataPtr theConnection);
+  GDALDataPtr open(const std::string& thePGName) const;
+
+  struct Database
+  {
+    std::vector<GDALDataPtr> idle;
+    std::size_t active = 0;                          // connections handed out
+    std::deque<std::condition_variable*> waiters;  // in order of arrival
+  };
+
+  const Config& itsConfig;
+
+  std::mutex itsMutex;
+  bool itsShutdown = false;
+  std::map<std::string, Database> itsDatabases;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -1,12 +1,16 @@
 #include "Engine.h"
 #include "Config.h"
+#include "ConnectionPool.h"
+#include "FileSource.h"
+#include "GdalUtils.h"
 #include "Normalize.h"
+#include "SlowQueryLog.h"
 #include <boost/algorithm/string/join.hpp>
+#include <boost/asio/post.hpp>
 #include <gis/Box.h>
 #include <gis/CoordinateMatrixCache.h>
 #include <gis/CoordinateTransformation.h>
 #include <gis/EPSGInfo.h>
-#include <gis/Host.h>
 #include <gis/OGR.h>
 #include <gis/OGRSpatialReferenceFactory.h>
 #include <gis/PostGIS.h>
@@ -16,8 +20,16 @@
 #include <macgyver/StringConversion.h>
 #include <spine/Reactor.h>
 #include <gdal_version.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <memory>
 #include <ogrsf_frmts.h>
+#include <optional>
+#include <variant>
 
 const auto featuredeleter = [](OGRFeature* p) { OGRFeature::DestroyFeature(p); };
 using SafeFeature = std::unique_ptr<OGRFeature, decltype(featuredeleter)>;
@@ -30,20 +42,106 @@ namespace Gis
 {
 namespace
 {
-int getEpsgCode(const GDALDataPtr& connection,
-                const std::string& schema,
-                const std::string& table,
-                const std::string& geometry_column,
-                const SmartMet::Engine::Gis::Config& config)
+// Times are requested from the database as epoch seconds, which makes
+// the results independent of the session time zone.
+std::string epoch_sql(const std::string& theExpression)
+{
+  return "extract(epoch from " + theExpression + ")::bigint";
+}
+
+// A time literal in UTC. The zone is ignored for columns without a time zone.
+std::string time_sql(const Fmi::DateTime& theTime)
+{
+  return "'" + Fmi::to_iso_extended_string(theTime) + "Z'";
+}
+
+// Conditions for the optional time range of the query, or an empty string
+std::string time_range_sql(const MetaDataQueryOptions& theOptions)
+{
+  std::string ret;
+  if (!theOptions.time_column)
+    return ret;
+
+  const auto& time_column = *theOptions.time_column;
+  if (theOptions.starttime)
+    ret += time_column + " >= " + time_sql(*theOptions.starttime);
+  if (theOptions.endtime)
+  {
+    if (!ret.empty())
+      ret += " AND ";
+    ret += time_column + " <= " + time_sql(*theOptions.endtime);
+  }
+  return ret;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief SQL expression for the extent of the table geometries
+ *
+ * The strategy is configurable per table:
+ *
+ *   fixed     - the configured bbox, no SQL is needed
+ *   estimated - ST_EstimatedExtent using table statistics, exact if there are none
+ *   exact     - ST_Extent over the full table or the requested time range
+ *   latest    - ST_Extent over the rows with the latest time (in the time range) only
+ *
+ * The estimated extent is requested separately with estimated_extent_sql,
+ * this returns the exact extent used when there is no estimate.
+ */
+// ----------------------------------------------------------------------
+
+std::string extent_sql(const Config& theConfig, const MetaDataQueryOptions& theOptions)
+{
+  const auto& schema = theOptions.schema;
+  const auto& table = theOptions.table;
+  const auto& geometry_column = theOptions.geometry_column;
+
+  auto mode = theConfig.getTableExtentMode(schema, table);
+
+  if (mode == ExtentMode::Fixed)
+    return {};
+
+  std::string exact =
+      "(SELECT ST_Extent(" + geometry_column + ")::geometry FROM " + schema + "." + table;
+
+  const auto time_range = time_range_sql(theOptions);
+
+  if (mode == ExtentMode::Latest && theOptions.time_column)
+  {
+    const auto& time_column = *theOptions.time_column;
+    exact += " WHERE " + time_column + " = (SELECT max(" + time_column + ") FROM " + schema + "." +
+             table;
+    if (!time_range.empty())
+      exact += " WHERE " + time_range;
+    exact += ")";
+  }
+  else if (!time_range.empty())
+    exact += " WHERE " + time_range;
+  exact += ")";
+
+  return exact;
+}
+
+std::string estimated_extent_sql(const MetaDataQueryOptions& theOptions)
+{
+  return "SELECT ST_EstimatedExtent('" + theOptions.schema + "', '" + theOptions.table + "', '" +
+         theOptions.geometry_column + "')::geometry AS extent";
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run an extent query, return nothing if the extent is NULL
+ */
+// ----------------------------------------------------------------------
+
+std::optional<OGREnvelope> query_envelope(const GDALDataPtr& connection,
+                                          const std::string& sqlStmt)
 {
   try
   {
     auto layerdeleter = [&](OGRLayer* p) { connection->ReleaseResultSet(p); };
     using SafeLayer = std::unique_ptr<OGRLayer, decltype(layerdeleter)>;
 
-    std::string sqlStmt =
-        "select st_srid(" + geometry_column + ") from " + schema + "." + table + " limit 1;";
-
     SafeLayer pLayer(connection->ExecuteSQL(sqlStmt.c_str(), nullptr, nullptr), layerdeleter);
 
     if (!pLayer)
@@ -51,20 +149,16 @@ int getEpsgCode(const GDALDataPtr& connection,
 
     SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
 
-    if (pFeature)
-      return pFeature->GetFieldAsInteger(0);
-
-    auto default_epsg = config.getDefaultEPSG();
+    if (!pFeature)
+      throw Fmi::Exception(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
 
-    if (default_epsg)
-    {
-      if (!config.quiet())
-        std::cerr << "Warning: sqlStmt returned null. Setting EPSG to default value "
-                  << *default_epsg << '\n';
-      return *default_epsg;
-    }
+    const OGRGeometry* pGeometry = pFeature->GetGeometryRef();
+    if (!pGeometry)
+      return {};
 
-    throw Fmi::Exception(BCP, "Gis-engine: Null feature received from " + sqlStmt);
+    OGREnvelope bbox;
+    pGeometry->getEnvelope(&bbox);
+    return bbox;
   }
   catch (...)
   {
@@ -72,21 +166,69 @@ int getEpsgCode(const GDALDataPtr& connection,
   }
 }
 
-GDALDataPtr db_connection(const Config& config, const std::string& pgname)
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run fn(0...n-1) in parallel using the given thread pool
+ *
+ * The calling thread processes items too and waits only for items which
+ * have been started, not for queued helper tasks. Hence this is safe to
+ * call from within the thread pool itself. The first exception thrown is
+ * rethrown once all started items have finished.
+ */
+// ----------------------------------------------------------------------
+
+template <typename Function>
+void parallel_for(boost::asio::thread_pool& pool,
+                  std::size_t n,
+                  std::size_t max_threads,
+                  Function&& fn)
 {
-  try
+  struct State
   {
-    // Read it from the database
-    const postgis_connection_info& pgci = config.getPostGISConnectionInfo(pgname);
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable done_cond;
+    std::size_t done = 0;
+    std::exception_ptr error;
+  };
 
-    Fmi::Host host(pgci.host, pgci.database, pgci.username, pgci.password, pgci.port);
+  auto state = std::make_shared<State>();
 
-    return host.connect();
-  }
-  catch (...)
+  // Late helpers find no work and never touch fn
+  auto work = [state, n, &fn]()
   {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
+    std::size_t i = 0;
+    while ((i = state->next++) < n)
+    {
+      std::exception_ptr error;
+      try
+      {
+        fn(i);
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (error && !state->error)
+        state->error = error;
+      if (++state->done == n)
+        state->done_cond.notify_all();
+    }
+  };
+
+  const auto helpers = std::min(n, max_threads);
+  for (std::size_t i = 1; i < helpers; i++)
+    boost::asio::post(pool, work);
+
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done_cond.wait(lock, [&state, n]() { return state->done == n; });
+
+  if (state->error)
+    std::rethrow_exception(state->error);
 }
 
 // Apply the per-geometry simplification pipeline (minarea / mindistance /
@@ -140,6 +282,16 @@ Fmi::Features simplify(const Fmi::Features& theFeatures, const MapOptions& theOp
   return newfeatures;
 }
 
+using Clock = std::chrono::steady_clock;
+
+// Name used for a table in the statistics
+std::string statistics_name(const std::string& thePGName,
+                            const std::string& theSchema,
+                            const std::string& theTable)
+{
+  return thePGName + ':' + theSchema + '.' + theTable;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Create cache-keys for the map options
@@ -183,36 +335,48 @@ std::pair<std::string, std::string> cache_keys(const MapOptions& theOptions,
   }
 }
 
-}  // namespace
+// Index of the level of detail nearest to the tolerance on a logarithmic scale, or
+// nothing if the tolerance is more than one step outside the ladder
+std::optional<std::size_t> nearest_level(const std::vector<double>& theLevels,
+                                         double theTolerance)
+{
+  const double default_factor = 2;
+  const double factor = (theLevels.size() > 1 ? theLevels[1] / theLevels[0] : default_factor);
+  if (theTolerance < theLevels.front() / factor || theTolerance > theLevels.back() * factor)
+    return {};
+
+  std::size_t best = 0;
+  for (std::size_t i = 1; i < theLevels.size(); i++)
+    if (std::abs(std::log(theLevels[i] / theTolerance)) <
+        std::abs(std::log(theLevels[best] / theTolerance)))
+      best = i;
+  return best;
+}
 
-OGREnvelope Engine::getTableEnvelope(const GDALDataPtr& connection,
-                                     const std::string& schema,
-                                     const std::string& table,
-                                     const std::string& geometry_column,
-                                     bool quiet) const
+// The statement generated by Fmi::PostGIS::read, or the layer and filter of a file source
+std::string read_query(const MapOptions& theOptions)
 {
-  try
-  {
-    // we assume there is just one geometry column
-    auto fixed_bbox = itsConfig->getTableBBox(schema, table);
-    if (fixed_bbox)
-    {
-      OGREnvelope bbox;
-      bbox.MinX = fixed_bbox->west;
-      bbox.MinY = fixed_bbox->south;
-      bbox.MaxX = fixed_bbox->east;
-      bbox.MaxY = fixed_bbox->north;
-      return bbox;
-    }
+  std::string ret = "SELECT * FROM " + theOptions.schema + "." + theOptions.table;
+  if (theOptions.where)
+    ret += " WHERE " + *theOptions.where;
+  return ret;
+}
 
-#if 0
-    std::string sqlStmt = "SELECT ST_EstimatedExtent('" + schema + "', '" + table + "', '" +
-                          geometry_column + "')::geometry as extent";
-#else
-    std::string sqlStmt = "SELECT ST_Extent(" + geometry_column + ")::geometry as extent FROM " +
-                          schema + "." + table;
-#endif
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append distinct times from the given query to the vector
+ */
+// ----------------------------------------------------------------------
 
+void read_timesteps(const GDALDataPtr& connection,
+                    const std::string& sqlStmt,
+                    const MetaDataQueryOptions& theOptions,
+                    TimeSteps& theTimeSteps,
+                    QueryTrace& theTrace)
+{
+  try
+  {
+    theTrace.addQuery(sqlStmt);
     auto layerdeleter = [&](OGRLayer* p) { connection->ReleaseResultSet(p); };
     using SafeLayer = std::unique_ptr<OGRLayer, decltype(layerdeleter)>;
 
@@ -221,26 +385,116 @@ OGREnvelope Engine::getTableEnvelope(const GDALDataPtr& connection,
     if (!pLayer)
       throw Fmi::Exception(BCP, "Gis-engine: PostGIS metadata query failed: '" + sqlStmt + "'");
 
-    SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
+    while (true)
+    {
+      SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
+      if (!pFeature)
+        break;
 
-    if (!pFeature)
-      throw Fmi::Exception(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
+      if (!pFeature->IsFieldSetAndNotNull(0))
+      {
+        std::cout << "Reading values from '" << theOptions.schema << "." << theOptions.table << "."
+                  << *theOptions.time_column << "' failed!\n";
+        break;
+      }
+
+      theTimeSteps.push_back(TimeSteps::from_seconds(pFeature->GetFieldAsInteger64(0)));
+      theTrace.addRows(1);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    // get geometry
-    OGRGeometry* pGeometry = pFeature->GetGeometryRef();
+}  // namespace
 
-    if (!pGeometry)
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the timesteps of a table without a fixed timestep
+ *
+ * The timesteps are cached per table. Normally only times newer than the
+ * last known one are requested from the database, a full rescan is done
+ * periodically to notice deleted or late arriving older times. A requested
+ * time range is extracted from the cached timesteps if there are any,
+ * otherwise only the time range is requested from the database.
+ */
+// ----------------------------------------------------------------------
+
+TimeSteps Engine::getTimeSteps(const GDALDataPtr& connection,
+                               const MetaDataQueryOptions& theOptions,
+                               QueryTrace& theTrace) const
+{
+  try
+  {
+    const auto& time_column = *theOptions.time_column;
+
+    std::string key = theOptions.pgname;
+    key += '|';
+    key += theOptions.schema;
+    key += '|';
+    key += theOptions.table;
+    key += '|';
+    key += time_column;
+
+    std::shared_ptr<TimeStepCacheEntry> entry;
     {
-      Fmi::Exception ex(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
-      if (quiet)
-        ex.disableLogging();
-      throw ex;
+      std::lock_guard<std::mutex> lock(itsTimeStepCacheMutex);
+      auto& ptr = itsTimeStepCache[key];
+      if (!ptr)
+        ptr = std::make_shared<TimeStepCacheEntry>();
+      entry = ptr;
     }
 
-    OGREnvelope bbox;
-    pGeometry->getEnvelope(&bbox);
+    // Another request may be updating the same timesteps
+    std::unique_lock<std::mutex> lock(entry->mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+      auto wait_start = Clock::now();
+      lock.lock();
+      theTrace.addWait(Clock::now() - wait_start);
+    }
 
-    return bbox;
+    const auto time_range = time_range_sql(theOptions);
+
+    if (!time_range.empty() && entry->timesteps.empty())
+    {
+      std::string sqlStmt = "SELECT " + epoch_sql("t") + " FROM (SELECT DISTINCT(" + time_column +
+                            ") AS t FROM " + theOptions.schema + "." + theOptions.table +
+                            " WHERE " + time_range + ") AS times ORDER BY t";
+      TimeSteps timesteps;
+      read_timesteps(connection, sqlStmt, theOptions, timesteps, theTrace);
+      return timesteps;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto interval = std::chrono::seconds(itsConfig->getTimeStepReconcileInterval());
+    const bool full_scan = (entry->timesteps.empty() || now - entry->reconcile_time >= interval);
+
+    std::string sqlStmt = "SELECT " + epoch_sql("t") + " FROM (SELECT DISTINCT(" + time_column +
+                          ") AS t FROM " + theOptions.schema + "." + theOptions.table + " WHERE " +
+                          time_column + " IS NOT NULL";
+
+    if (!full_scan)
+      sqlStmt += " AND " + time_column + " > " + time_sql(entry->timesteps.back());
+
+    sqlStmt += ") AS times ORDER BY t";
+
+    if (full_scan)
+    {
+      TimeSteps timesteps;
+      read_timesteps(connection, sqlStmt, theOptions, timesteps, theTrace);
+      entry->timesteps = std::move(timesteps);
+      entry->reconcile_time = now;
+    }
+    else
+      read_timesteps(connection, sqlStmt, theOptions, entry->timesteps, theTrace);
+
+    if (!time_range.empty())
+      return entry->timesteps.slice(theOptions.starttime, theOptions.endtime);
+
+    return entry->timesteps;
   }
   catch (...)
   {
@@ -275,6 +529,47 @@ void Engine::init()
     itsCache.resize(itsConfig->getMaxCacheSize());
     itsFeaturesCache.resize(itsConfig->getMaxCacheSize());
     itsEnvelopeCache.resize(itsConfig->getMaxCacheSize());
+    itsMetaDataCache.resize(itsConfig->getMaxCacheSize());
+
+    itsGeometryCacheAccounting.resize(itsConfig->getMaxCacheSize());
+    itsFeaturesCacheAccounting.resize(itsConfig->getMaxCacheSize());
+    itsEnvelopeCacheAccounting.resize(itsConfig->getMaxCacheSize());
+    itsGeometryCacheAccounting.trackEntries(itsConfig->getTrackCacheEntries());
+    itsFeaturesCacheAccounting.trackEntries(itsConfig->getTrackCacheEntries());
+    itsEnvelopeCacheAccounting.trackEntries(itsConfig->getTrackCacheEntries());
+
+    if (itsConfig->getCompressedCacheMegaBytes() > 0)
+      itsCompressedCache = std::make_shared<CompressedCache>(
+          static_cast<std::size_t>(itsConfig->getCompressedCacheMegaBytes()) * 1024 * 1024,
+          static_cast<std::size_t>(itsConfig->getCompressedCacheMinKiloBytes()) * 1024);
+
+    // The server can run without the shared cache, for example if the file cannot be created
+    if (!itsConfig->getSharedCachePath().empty())
+    {
+      try
+      {
+        itsSharedCache = std::make_unique<SharedCache>(
+            itsConfig->getSharedCachePath(),
+            static_cast<std::size_t>(itsConfig->getSharedCacheMegaBytes()) * 1024 * 1024,
+            static_cast<std::size_t>(itsConfig->getSharedCacheSlots()));
+      }
+      catch (...)
+      {
+        Fmi::Exception::Trace(BCP, "Shared geometry cache disabled").printError();
+      }
+    }
+
+    itsConnectionPool = std::make_unique<ConnectionPool>(*itsConfig);
+    itsSlowQueryLog = std::make_unique<SlowQueryLog>(itsConfig->getSlowQueryThresholds(),
+                                                     itsConfig->getSlowQueryHistory());
+    itsThreadPool = std::make_unique<boost::asio::thread_pool>(itsConfig->getThreads());
+
+    itsAsyncExecutor = std::make_unique<AsyncExecutor>(itsConfig->getAsyncThreads(),
+                                                       itsConfig->getAsyncMaxPerPGName());
+
+    if (itsConfig->getFastProjections())
+      itsFastProjections =
+          std::make_unique<FastProjections>(itsConfig->getFastProjectionTolerance());
 
     // Register all drivers just once
 
@@ -299,6 +594,24 @@ void Engine::init()
 void Engine::shutdown()
 {
   std::cout << "  -- Shutdown requested (gis)\n";
+
+  // Fail requests waiting for a database connection, then abandon queued
+  // requests and background tasks and wait for the running ones
+  if (itsConnectionPool)
+    itsConnectionPool->shutdown();
+
+  if (itsAsyncExecutor)
+    itsAsyncExecutor->shutdown();
+
+  if (itsThreadPool)
+  {
+    itsThreadPool->stop();
+    itsThreadPool->join();
+  }
+
+  // Do not compress the evicted geometries while the caches are destroyed
+  if (itsCompressedCache)
+    itsCompressedCache->shutdown();
 }
 
 // ----------------------------------------------------------------------
@@ -329,6 +642,54 @@ Spine::CRSRegistry& Engine::getCRSRegistry()
 
 OGRGeometryPtr Engine::getShape(const Fmi::SpatialReference* theSR,
                                 const MapOptions& theOptions) const
+{
+  try
+  {
+    auto flat = getFlatShape(theSR, theOptions);
+    if (!flat)
+      return {};
+    return flat->geometry();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch a shape in the flat representation used in the cache
+ *
+ * Returns nullptr for an empty shape.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FlatGeometry> Engine::getFlatShape(const Fmi::SpatialReference* theSR,
+                                                         const MapOptions& theOptions) const
+{
+  try
+  {
+    return getFlatShape(theSR, theOptions, false);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch a shape as the requested result or as input for another one
+ *
+ * The cache accounting counts one lookup of the requested result per
+ * request. The lookups of intermediate results are counted as stage
+ * lookups.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FlatGeometry> Engine::getFlatShape(const Fmi::SpatialReference* theSR,
+                                                         const MapOptions& theOptions,
+                                                         bool theStage) const
 {
   try
   {
@@ -338,48 +699,181 @@ OGRGeometryPtr Engine::getShape(const Fmi::SpatialReference* theSR,
     if (theOptions.table.empty())
       throw Fmi::Exception(BCP, "PostGIS table name missing from map query");
 
+    // Snap mindistance to the level of detail ladder of the table, if there is one.
+    // The levels are built in the background on first use. Tolerances far outside
+    // the ladder are used as is.
+    std::optional<std::size_t> lod_level;
+    const auto& lod = itsConfig->getTableLOD(theOptions.schema, theOptions.table);
+    if (!lod.empty() && theOptions.mindistance && *theOptions.mindistance > 0)
+      lod_level = nearest_level(lod, *theOptions.mindistance);
+
+    if (lod_level)
+    {
+      if (lod[*lod_level] != *theOptions.mindistance)
+      {
+        auto options = theOptions;
+        options.mindistance = lod[*lod_level];
+        return getFlatShape(theSR, options, theStage);
+      }
+      buildLevels(theSR, theOptions);
+    }
+
     // Find simplified map from the cache
 
     auto keys = cache_keys(theOptions, theSR);
     const auto& basic_key = keys.first;
     const auto& full_key = keys.second;
 
-    auto obj = itsCache.find(full_key);
-    if (obj)
-      return *obj;
+    const auto stats_table =
+        statistics_name(theOptions.pgname, theOptions.schema, theOptions.table);
 
-    // Find full map from the cache
+    auto flat = findShape(full_key, stats_table, theStage);
+    if (flat)
+      return flat;
+
+    QueryTrace trace("shape", theOptions.pgname, theOptions.schema + "." + theOptions.table);
+    QueryFailureCheck failure_check(*itsSlowQueryLog, trace);
 
     OGRGeometryPtr geom;
 
-    obj = itsCache.find(basic_key);
-    if (obj)
-      geom = *obj;
-    else
+    static const Fmi::GeometryAmalgamator default_amalgamator;
+    static const Fmi::GeometrySimplifier default_simplifier;
+
+    const bool amalgamate =
+        (theOptions.amalgamator.hash_value() != default_amalgamator.hash_value());
+
+    // The outputs of the amalgamator, despeckle and mindistance stages are cached
+    // under keys extending the key of the previous stage. Requests which differ
+    // only in the later stages continue from the longest cached prefix.
+    std::vector<std::string> stage_keys;
+    std::string stage_key = basic_key;
+    if (amalgamate)
     {
-      // Read it from the database
-      auto connection = db_connection(*itsConfig, theOptions.pgname);
+      stage_key += "|amalgamator:" + Fmi::to_string(theOptions.amalgamator.hash_value());
+      stage_keys.push_back(stage_key);
+    }
+    if (theOptions.minarea)
+    {
+      stage_key += "|minarea:" + Fmi::to_string(*theOptions.minarea);
+      stage_keys.push_back(stage_key);
+    }
+    if (theOptions.mindistance)
+    {
+      stage_key += "|mindistance:" + Fmi::to_string(*theOptions.mindistance);
+      stage_keys.push_back(stage_key);
+    }
 
-      std::string name = theOptions.schema + "." + theOptions.table;
-      geom = Fmi::PostGIS::read(theSR, connection, name, theOptions.where);
+    std::size_t cached_stages = 0;
+    for (auto i = stage_keys.size(); i > 0 && cached_stages == 0; i--)
+    {
+      flat = findShape(stage_keys[i - 1], stats_table, true);
+      if (flat)
+      {
+        geom = flat->geometry();
+        cached_stages = i;
+      }
+    }
 
-      // Cache the result if it's not empty
-      if (geom)
-        itsCache.insert(basic_key, geom);
+    // Find full map from the cache unless a pipeline stage was found
+
+    if (cached_stages == 0)
+    {
+      flat = findShape(basic_key, stats_table, true);
+      if (flat)
+        geom = flat->geometry();
+      else
+      {
+        // Read it from the database
+        auto start = Clock::now();
+        auto connection = itsConnectionPool->get(theOptions.pgname);
+        trace.addStage("connect", Clock::now() - start);
+        trace.addQuery(read_query(theOptions));
+
+        auto read_shape = [&](const Fmi::SpatialReference* sr)
+        {
+          if (itsConfig->getFileSource(theOptions.pgname))
+            return FileSource::read(
+                sr, connection.get(), theOptions.schema, theOptions.table, theOptions.where);
+          std::string name = theOptions.schema + "." + theOptions.table;
+          return Fmi::PostGIS::read(sr, connection.get(), name, theOptions.where);
+        };
+
+        // The shape may be read in its own spatial reference and reprojected here
+        // with fast projections or in parallel. Like the readers, a table without
+        // a spatial reference cannot be reprojected.
+        if (theSR && reprojectsNatively())
+        {
+          geom = read_shape(nullptr);
+          if (geom)
+          {
+            if (!geom->getSpatialReference())
+              throw Fmi::Exception(BCP, "Table has no spatial reference, cannot reproject it")
+                  .addParameter("Table", theOptions.schema + "." + theOptions.table);
+            auto reproject_start = Clock::now();
+            geom = reproject(*geom, *theSR);
+            trace.addStage("reproject", Clock::now() - reproject_start);
+          }
+        }
+        else
+          geom = read_shape(theSR);
+
+        const auto elapsed = Clock::now() - start;
+        trace.addStage("db_read", elapsed);
+
+        // Cache the result if it's not empty. The volume statistics are taken from
+        // the flat representation instead of walking the geometry again.
+        std::size_t rows = 0;
+        if (geom)
+        {
+          const auto* collection = dynamic_cast<const OGRGeometryCollection*>(geom.get());
+          rows = (collection ? collection->getNumGeometries() : 1);
+          flat = cacheShape(basic_key, stats_table, std::make_unique<FlatGeometry>(geom));
+        }
+        else
+          itsGeometryCacheAccounting.notCachedEmpty(stats_table);
+
+        itsPipelineStatistics.add(stats_table,
+                                  "db_read",
+                                  elapsed,
+                                  0,
+                                  flat ? flat->numPoints() : 0,
+                                  rows,
+                                  flat ? flat->dataSize() : 0);
+        trace.addRows(rows);
+      }
     }
 
     // Skip the pipeline when no simplification has been requested. The new
     // amalgamator and simplifier objects no-op when inactive, but comparing
     // against a default-constructed instance avoids an extra cache write.
-    static const Fmi::GeometryAmalgamator default_amalgamator;
-    static const Fmi::GeometrySimplifier default_simplifier;
     const bool needs_pipeline =
-        theOptions.minarea || theOptions.mindistance ||
-        theOptions.amalgamator.hash_value() != default_amalgamator.hash_value() ||
+        theOptions.minarea || theOptions.mindistance || amalgamate ||
         theOptions.simplifier.hash_value() != default_simplifier.hash_value();
 
     if (!needs_pipeline)
-      return geom;
+    {
+      itsSlowQueryLog->check(trace);
+      return flat;
+    }
+
+    // True if the next stage must be run, false if its output was cached
+    std::size_t next_stage = 0;
+    auto run_stage = [&]() { return next_stage++ >= cached_stages; };
+
+    // Cache the output of a stage and record the time and point counts of the stage.
+    // The points are counted from the flat representation made for the cache.
+    std::size_t points = (flat ? flat->numPoints() : 0);
+    auto finish_stage = [&](const char* stage, Clock::time_point start, const std::string& key)
+    {
+      const auto elapsed = Clock::now() - start;
+      trace.addStage(stage, elapsed);
+      flat.reset();
+      if (geom)
+        flat = cacheShape(key, stats_table, std::make_unique<FlatGeometry>(geom));
+      const auto points_out = (flat ? flat->numPoints() : 0);
+      itsPipelineStatistics.add(stats_table, stage, elapsed, points, points_out);
+      points = points_out;
+    };
 
     // Apply the simplification pipeline. Order:
     //   1) amalgamator (merges nearby polygons via constrained Delaunay)
@@ -390,8 +884,9 @@ OGRGeometryPtr Engine::getShape(const Fmi::SpatialReference* theSR,
     // amalgamator could not merge into a neighbour, and so that the new
     // simplifier operates on the merged outline.
 
-    if (geom)
+    if (amalgamate && run_stage() && geom)
     {
+      auto start = Clock::now();
       std::vector<OGRGeometryPtr> wrap{geom};
       theOptions.amalgamator.apply(wrap);
       // The amalgamator may explode a single MultiPolygon into multiple
@@ -418,39 +913,147 @@ OGRGeometryPtr Engine::getShape(const Fmi::SpatialReference* theSR,
             mp->addGeometryDirectly(g->clone());
         geom.reset(mp);
       }
+      finish_stage("amalgamator", start, stage_keys[next_stage - 1]);
     }
 
-    if (theOptions.minarea && geom)
+    if (theOptions.minarea && run_stage() && geom)
+    {
+      auto start = Clock::now();
       geom.reset(Fmi::OGR::despeckle(*geom, *theOptions.minarea));
+      finish_stage("despeckle", start, stage_keys[next_stage - 1]);
+    }
 
-    if (theOptions.mindistance && geom)
+    if (theOptions.mindistance && run_stage() && geom)
     {
-      const double kilometers_to_degrees = 1.0 / 110.0;  // one degree latitude =~ 110 km
-      const double kilometers_to_meters = 1000;
+      // Levels of detail are simplified from the previous level instead of the
+      // full resolution geometry, which bounds the cost of each level
+      if (lod_level && *lod_level > 0)
+      {
+        auto previous = theOptions;
+        previous.mindistance = lod[*lod_level - 1];
+        previous.simplifier = Fmi::GeometrySimplifier();
+        flat = getFlatShape(theSR, previous, true);
+        geom = (flat ? flat->geometry() : OGRGeometryPtr());
+        points = (flat ? flat->numPoints() : 0);
+      }
 
-      const auto* crs = geom->getSpatialReference();
-      bool geographic = (crs ? crs->IsGeographic() : false);
-      if (!geographic)
-        geom.reset(
-            geom->SimplifyPreserveTopology(kilometers_to_meters * (*theOptions.mindistance)));
-      else
-        geom.reset(
-            geom->SimplifyPreserveTopology(kilometers_to_degrees * (*theOptions.mindistance)));
+      if (geom)
+      {
+        auto start = Clock::now();
+        const double kilometers_to_degrees = 1.0 / 110.0;  // one degree latitude =~ 110 km
+        const double kilometers_to_meters = 1000;
+
+        const auto* crs = geom->getSpatialReference();
+        bool geographic = (crs ? crs->IsGeographic() : false);
+        if (!geographic)
+          geom.reset(
+              geom->SimplifyPreserveTopology(kilometers_to_meters * (*theOptions.mindistance)));
+        else
+          geom.reset(
+              geom->SimplifyPreserveTopology(kilometers_to_degrees * (*theOptions.mindistance)));
+        finish_stage("mindistance", start, stage_keys[next_stage - 1]);
+      }
     }
 
-    if (geom)
+    // The output of the simplifier is cached as the result
+    if (geom && theOptions.simplifier.hash_value() != default_simplifier.hash_value())
     {
+      auto start = Clock::now();
       std::vector<OGRGeometryPtr> wrap{geom};
       theOptions.simplifier.apply(wrap, true);
       geom = wrap.empty() ? OGRGeometryPtr() : wrap.front();
+      finish_stage("simplifier", start, full_key);
     }
+    else if (geom)
+    {
+      // The output of the last stage is cached already, the result shares it.
+      // Its bytes are accounted for under the stage key.
+      itsCache.insert(full_key, flat);
+      itsGeometryCacheAccounting.insert(full_key, stats_table, 0);
+    }
+    else
+      flat.reset();
+
+    if (!flat)
+      itsGeometryCacheAccounting.notCachedEmpty(stats_table);
 
-    // Cache the result
-
-    if (geom)
-      itsCache.insert(full_key, geom);
+    itsSlowQueryLog->check(trace);
 
-    return geom;
+    return flat;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a shape from the cache, the shared cache or the compressed tier
+ *
+ * Shapes found from the other tiers are promoted back to the cache. The
+ * lookup is counted once as a hit or a miss of the cache, or as a stage
+ * lookup. The other tiers count their own hits.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FlatGeometry> Engine::findShape(const std::string& theKey,
+                                                      const std::string& theTable,
+                                                      bool theStage) const
+{
+  try
+  {
+    auto obj = itsCache.find(theKey);
+    if (obj)
+    {
+      if (theStage)
+        itsGeometryCacheAccounting.stageHit(theKey, theTable);
+      else
+        itsGeometryCacheAccounting.hit(theKey, theTable);
+      return *obj;
+    }
+
+    if (theStage)
+      itsGeometryCacheAccounting.stageMiss(theTable);
+    else
+      itsGeometryCacheAccounting.miss(theTable);
+
+    std::unique_ptr<FlatGeometry> geom;
+    if (itsSharedCache)
+      geom = itsSharedCache->find(theKey, theTable);
+    if (!geom && itsCompressedCache)
+      geom = itsCompressedCache->take(theKey, theTable);
+    if (!geom)
+      return {};
+
+    return cacheShape(theKey, theTable, std::move(geom));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Insert a shape into the cache and share it with the other processes. Shapes
+// are demoted to the compressed tier when evicted.
+std::shared_ptr<const FlatGeometry> Engine::cacheShape(const std::string& theKey,
+                                                       const std::string& theTable,
+                                                       std::unique_ptr<FlatGeometry> theGeom) const
+{
+  try
+  {
+    if (itsSharedCache && !theGeom->isView())
+      itsSharedCache->insert(theKey, theTable, *theGeom);
+
+    std::shared_ptr<const FlatGeometry> flat;
+    if (itsCompressedCache)
+      flat = itsCompressedCache->manage(theKey, theTable, std::move(theGeom));
+    else
+      flat = std::move(theGeom);
+
+    itsCache.insert(theKey, flat);
+    itsGeometryCacheAccounting.insert(theKey, theTable, flat->bytes());
+    return flat;
   }
   catch (...)
   {
@@ -471,6 +1074,36 @@ Fmi::Features Engine::getFeatures(const Fmi::SpatialReference& theSR,
 
 Fmi::Features Engine::getFeatures(const Fmi::SpatialReference* theSR,
                                   const MapOptions& theOptions) const
+{
+  try
+  {
+    return getFlatFeatures(theSR, theOptions)->features();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<const FlatFeatures> Engine::getFlatFeatures(const MapOptions& theOptions) const
+{
+  return getFlatFeatures(nullptr, theOptions);
+}
+
+std::shared_ptr<const FlatFeatures> Engine::getFlatFeatures(const Fmi::SpatialReference& theSR,
+                                                            const MapOptions& theOptions) const
+{
+  return getFlatFeatures(&theSR, theOptions);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch features in the flat representation used in the cache
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FlatFeatures> Engine::getFlatFeatures(const Fmi::SpatialReference* theSR,
+                                                            const MapOptions& theOptions) const
 {
   try
   {
@@ -485,41 +1118,116 @@ Fmi::Features Engine::getFeatures(const Fmi::SpatialReference* theSR,
     const auto& basic_key = keys.first;
     const auto& full_key = keys.second;
 
+    const auto stats_table =
+        statistics_name(theOptions.pgname, theOptions.schema, theOptions.table);
+
     auto obj = itsFeaturesCache.find(full_key);
     if (obj)
+    {
+      itsFeaturesCacheAccounting.hit(full_key, stats_table);
       return *obj;
+    }
+    itsFeaturesCacheAccounting.miss(stats_table);
 
+    std::shared_ptr<const FlatFeatures> flat;
     Fmi::Features ret;
 
+    QueryTrace trace("features", theOptions.pgname, theOptions.schema + "." + theOptions.table);
+    QueryFailureCheck failure_check(*itsSlowQueryLog, trace);
+
     // Find full map from the cache
     obj = itsFeaturesCache.find(basic_key);
     if (obj)
     {
-      ret = *obj;
+      itsFeaturesCacheAccounting.stageHit(basic_key, stats_table);
+      flat = *obj;
     }
     else
     {
+      itsFeaturesCacheAccounting.stageMiss(stats_table);
+
       // Read it from the database
-      auto connection = db_connection(*itsConfig, theOptions.pgname);
+      auto start = Clock::now();
+      auto connection = itsConnectionPool->get(theOptions.pgname);
+      trace.addStage("connect", Clock::now() - start);
+      trace.addQuery(read_query(theOptions));
 
-      std::string name = theOptions.schema + "." + theOptions.table;
-      ret = Fmi::PostGIS::read(theSR, connection, name, theOptions.fieldnames, theOptions.where);
+      auto read_features = [&](const Fmi::SpatialReference* sr)
+      {
+        if (itsConfig->getFileSource(theOptions.pgname))
+          return FileSource::read(sr,
+                                  connection.get(),
+                                  theOptions.schema,
+                                  theOptions.table,
+                                  theOptions.fieldnames,
+                                  theOptions.where);
+        std::string name = theOptions.schema + "." + theOptions.table;
+        return Fmi::PostGIS::read(
+            sr, connection.get(), name, theOptions.fieldnames, theOptions.where);
+      };
+
+      // Reproject here, see getShape. Features without a geometry are kept as is.
+      if (theSR && reprojectsNatively())
+      {
+        ret = read_features(nullptr);
+        auto reproject_start = Clock::now();
+        std::vector<const OGRGeometry*> geometries;
+        for (const auto& feature : ret)
+        {
+          const OGRGeometry* geom = (feature ? feature->geom.get() : nullptr);
+          if (geom && !geom->getSpatialReference())
+            throw Fmi::Exception(BCP, "Table has no spatial reference, cannot reproject it")
+                .addParameter("Table", theOptions.schema + "." + theOptions.table);
+          geometries.push_back(geom);
+        }
 
-      // Cache the result if it's not empty
-      if (!ret.empty())
-        itsFeaturesCache.insert(basic_key, ret);
-    }
+        // The results share target spatial references which use the traditional GIS
+        // order already. Other threads use them too, hence they are not modified.
+        auto results = reproject(geometries, *theSR);
+        for (std::size_t i = 0; i < ret.size(); i++)
+          if (ret[i] && ret[i]->geom)
+            ret[i]->geom.reset(results[i].release());
+        trace.addStage("reproject", Clock::now() - reproject_start);
+      }
+      else
+      {
+        ret = read_features(theSR);
 
-    // Set axis mapping strategy so that user does not have to clone spatial references which was
-    // bugged in proj 9.0
-    for (const auto& ptr : ret)
-    {
-      if (ptr && ptr->geom && ptr->geom->getSpatialReference() != nullptr)
+        // Set axis mapping strategy so that user does not have to clone spatial references which
+        // was bugged in proj 9.0. The flat representation shares the same spatial references.
+        for (const auto& ptr : ret)
+        {
+          if (ptr && ptr->geom && ptr->geom->getSpatialReference() != nullptr)
+          {
+            const OGRSpatialReference* sr = ptr->geom->getSpatialReference();
+            // FIXME: real fix required instead of casting away const
+            const_cast<OGRSpatialReference*>(sr)->SetAxisMappingStrategy(
+                OAMS_TRADITIONAL_GIS_ORDER);
+          }
+        }
+      }
+
+      const auto elapsed = Clock::now() - start;
+      trace.addStage("db_read_features", elapsed);
+      trace.addRows(ret.size());
+
+      // Cache the result if it's not empty. The volume statistics are taken from
+      // the flat representation instead of walking the geometries again.
+      flat = std::make_shared<FlatFeatures>(ret);
+      itsPipelineStatistics.add(stats_table,
+                                "db_read_features",
+                                elapsed,
+                                0,
+                                flat->geometries().numPoints(),
+                                ret.size(),
+                                flat->bytes());
+      if (!flat->empty())
       {
-        const OGRSpatialReference* sr = ptr->geom->getSpatialReference();
-        // FIXME: real fix required instead of casting away const
-        const_cast<OGRSpatialReference*>(sr)->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+        itsFeaturesCache.insert(basic_key, flat);
+        itsFeaturesCacheAccounting.insert(basic_key, stats_table, flat->bytes());
       }
+      else
+        itsFeaturesCacheAccounting.notCachedEmpty(stats_table);
     }
 
     // If no simplification was requested we're done. Note that the
@@ -530,17 +1238,41 @@ Fmi::Features Engine::getFeatures(const Fmi::SpatialReference* theSR,
                                 theOptions.simplifier.hash_value() !=
                                     default_simplifier.hash_value();
     if (!needs_simplify)
-      return ret;
+    {
+      itsSlowQueryLog->check(trace);
+      return flat;
+    }
 
     // Apply simplification options
 
+    // Features found in the cache are materialised for simplification
+    if (ret.empty())
+      ret = flat->features();
+
+    auto start = Clock::now();
     Fmi::Features newfeatures = simplify(ret, theOptions);
+    const auto elapsed = Clock::now() - start;
+    trace.addStage("simplify_features", elapsed);
 
     // Cache the result
-    if (!newfeatures.empty())
-      itsFeaturesCache.insert(full_key, newfeatures);
+    const auto points_in = flat->geometries().numPoints();
+    flat = std::make_shared<FlatFeatures>(newfeatures);
+    itsPipelineStatistics.add(stats_table,
+                              "simplify_features",
+                              elapsed,
+                              points_in,
+                              flat->geometries().numPoints());
+    if (!flat->empty())
+    {
+      itsFeaturesCache.insert(full_key, flat);
+      itsFeaturesCacheAccounting.insert(full_key, stats_table, flat->bytes());
+    }
+    else
+      itsFeaturesCacheAccounting.notCachedEmpty(stats_table);
+
+    itsSlowQueryLog->check(trace);
 
-    return newfeatures;
+    return flat;
   }
   catch (...)
   {
@@ -550,7 +1282,10 @@ Fmi::Features Engine::getFeatures(const Fmi::SpatialReference* theSR,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Fetch meta data (timesteps and bounding box) from db
+ * \brief Fetch meta data (timesteps and bounding box)
+ *
+ * If the metadata cache is enabled, cached metadata is returned even if
+ * it has expired, the expired entry is then refreshed in the background.
  *
  * \param theOptions query options
  */
@@ -560,119 +1295,350 @@ MetaData Engine::getMetaData(const MetaDataQueryOptions& theOptions) const
 {
   try
   {
-    MetaData metadata;
+    const auto ttl = itsConfig->getMetaDataTTL();
+    if (ttl <= 0)
+      return queryMetaData(theOptions);
 
-    auto connection = db_connection(*itsConfig, theOptions.pgname);
+    auto hash = theOptions.hash_value();
 
-    // Get time always in UTC
-    connection->ExecuteSQL("SET TIME ZONE UTC", nullptr, nullptr);
+    auto obj = itsMetaDataCache.find(hash);
+    if (obj)
+    {
+      const auto& entry = *obj;
+      if (std::chrono::steady_clock::now() >= entry->expiration_time)
+        refreshMetaData(theOptions);
+      return entry->metadata;
+    }
 
-    auto layerdeleter = [&](OGRLayer* p) { connection->ReleaseResultSet(p); };
-    using SafeLayer = std::unique_ptr<OGRLayer, decltype(layerdeleter)>;
+    auto entry = std::make_shared<MetaDataCacheEntry>();
+    entry->metadata = queryMetaData(theOptions);
+    entry->expiration_time = std::chrono::steady_clock::now() + std::chrono::seconds(ttl);
+    itsMetaDataCache.insert(hash, entry);
 
-    // 1) Get timesteps
-    if (theOptions.time_column)
+    return entry->metadata;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch meta data for several tables at once
+ *
+ * Duplicate requests are processed only once, and the rest are processed
+ * in parallel using the worker threads and pooled connections. Requests
+ * are grouped by pgname so that concurrently processed requests tend to
+ * reuse connections to the same database.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<MetaData> Engine::getMetaData(
+    const std::vector<MetaDataQueryOptions>& theOptions) const
+{
+  try
+  {
+    // Unique requests ordered by pgname
+    std::vector<std::size_t> order(theOptions.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&theOptions](std::size_t i, std::size_t j)
+                     { return theOptions[i].pgname < theOptions[j].pgname; });
+
+    // Equal hashes do not imply equal requests, hence the options are compared too
+    std::map<std::size_t, std::vector<std::size_t>> unique_requests;  // hash to request indices
+    std::vector<std::size_t> tasks;
+    std::vector<std::size_t> originals(theOptions.size());  // index of the request answered
+    for (auto i : order)
     {
-      auto timestep = itsConfig->getTableTimeStep(theOptions.schema, theOptions.table);
-      if (!timestep)
+      auto& candidates = unique_requests[theOptions[i].hash_value()];
+      auto pos = std::find_if(candidates.begin(),
+                              candidates.end(),
+                              [&theOptions, i](std::size_t j)
+                              { return theOptions[j] == theOptions[i]; });
+      if (pos != candidates.end())
+        originals[i] = *pos;
+      else
       {
-        // List all available times
-        std::string sqlStmt = "SELECT DISTINCT(" + *theOptions.time_column + ")" + " FROM " +
-                              theOptions.schema + "." + theOptions.table + " WHERE " +
-                              *theOptions.time_column + " IS NOT NULL ORDER by " +
-                              *theOptions.time_column;
+        candidates.push_back(i);
+        tasks.push_back(i);
+        originals[i] = i;
+      }
+    }
 
-        SafeLayer pLayer(connection->ExecuteSQL(sqlStmt.c_str(), nullptr, nullptr), layerdeleter);
+    std::vector<MetaData> results(theOptions.size());
 
-        if (!pLayer)
-          throw Fmi::Exception(BCP, "Gis-engine: PostGIS metadata query failed: '" + sqlStmt + "'");
+    parallel_for(*itsThreadPool,
+                 tasks.size(),
+                 itsConfig->getThreads(),
+                 [this, &theOptions, &tasks, &results](std::size_t i)
+                 {
+                   auto pos = tasks[i];
+                   results[pos] = getMetaData(theOptions[pos]);
+                 });
 
-        while (true)
+    // Copy results to duplicate requests
+    for (std::size_t i = 0; i < theOptions.size(); i++)
+      if (originals[i] != i)
+        results[i] = results[originals[i]];
+
+    return results;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch a shape asynchronously
+ *
+ * The spatial reference and options are copied, hence the caller need
+ * not keep them alive. Exceptions are reported by the future.
+ */
+// ----------------------------------------------------------------------
+
+std::future<OGRGeometryPtr> Engine::getShapeAsync(const Fmi::SpatialReference* theSR,
+                                                  const MapOptions& theOptions) const
+{
+  try
+  {
+    std::optional<Fmi::SpatialReference> sr;
+    if (theSR)
+      sr.emplace(*theSR);
+
+    return itsAsyncExecutor->submit(theOptions.pgname,
+                                    [this, sr, theOptions]()
+                                    { return getShape(sr ? &*sr : nullptr, theOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::future<Fmi::Features> Engine::getFeaturesAsync(const MapOptions& theOptions) const
+{
+  try
+  {
+    return itsAsyncExecutor->submit(theOptions.pgname,
+                                    [this, theOptions]() { return getFeatures(theOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::future<Fmi::Features> Engine::getFeaturesAsync(const Fmi::SpatialReference& theSR,
+                                                    const MapOptions& theOptions) const
+{
+  try
+  {
+    return itsAsyncExecutor->submit(theOptions.pgname,
+                                    [this, sr = theSR, theOptions]()
+                                    { return getFeatures(sr, theOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::future<MetaData> Engine::getMetaDataAsync(const MetaDataQueryOptions& theOptions) const
+{
+  try
+  {
+    return itsAsyncExecutor->submit(theOptions.pgname,
+                                    [this, theOptions]() { return getMetaData(theOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the level of detail ladder of a shape in the background
+ *
+ * The levels are built once from the finest to the coarsest, so that
+ * each level is simplified from the previous one. Levels evicted from
+ * the cache later on are rebuilt on demand by getShape.
+ *
+ * Each filter and spatial reference has its own ladder. The built ladders
+ * are remembered up to the cache size, since more levels could not be
+ * kept in the cache anyway. After that the ladders are forgotten, and
+ * ladders which are still cached are rebuilt cheaply from cache hits.
+ */
+// ----------------------------------------------------------------------
+
+void Engine::buildLevels(const Fmi::SpatialReference* theSR, const MapOptions& theOptions) const
+{
+  try
+  {
+    auto options = theOptions;
+    options.mindistance.reset();
+    options.simplifier = Fmi::GeometrySimplifier();
+
+    auto hash = Fmi::hash_value(cache_keys(options, theSR).second);
+    {
+      std::lock_guard<std::mutex> lock(itsLODBuildMutex);
+      if (itsLODBuilds.count(hash) > 0)
+        return;
+      if (itsLODBuilds.size() >= static_cast<std::size_t>(itsConfig->getMaxCacheSize()))
+        itsLODBuilds.clear();
+      itsLODBuilds.insert(hash);
+    }
+
+    std::optional<Fmi::SpatialReference> sr;
+    if (theSR)
+      sr.emplace(*theSR);
+
+    boost::asio::post(
+        *itsThreadPool,
+        [this, sr, options]() mutable
         {
-          SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
-          if (!pFeature)
-            break;
-
-          tm timeinfo;
-
-          bool ret = pFeature->GetFieldAsDateTime(0,
-                                                  &timeinfo.tm_year,
-                                                  &timeinfo.tm_mon,
-                                                  &timeinfo.tm_mday,
-                                                  &timeinfo.tm_hour,
-                                                  &timeinfo.tm_min,
-                                                  &timeinfo.tm_sec,
-                                                  &timeinfo.tm_isdst);
-
-          if (!ret)
+          try
+          {
+            for (auto tolerance : itsConfig->getTableLOD(options.schema, options.table))
+            {
+              if (Spine::Reactor::isShuttingDown())
+                break;
+              options.mindistance = tolerance;
+              getShape(sr ? &*sr : nullptr, options);
+            }
+          }
+          catch (...)
           {
-            std::cout << "Reading values from '" << theOptions.schema << "." << theOptions.table
-                      << "." << *theOptions.time_column << "' failed!\n";
-            break;
+            // The levels will be built on demand instead
+            Fmi::Exception::Trace(BCP, "Background level of detail build failed!")
+                .addParameter("Table", options.schema + "." + options.table)
+                .printError();
           }
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-          timeinfo.tm_year -= 1900;  // years after 1900
-          timeinfo.tm_mon -= 1;      // months 0..11
+// ----------------------------------------------------------------------
+/*!
+ * \brief Refresh cached metadata in the background
+ *
+ * Nothing is done if a refresh for the same query is already in progress.
+ */
+// ----------------------------------------------------------------------
 
-          metadata.timesteps.push_back(Fmi::DateTime::from_tm(timeinfo));
-        }
-      }
+void Engine::refreshMetaData(const MetaDataQueryOptions& theOptions) const
+{
+  try
+  {
+    auto hash = theOptions.hash_value();
 
-      else
-      {
-        // Establish starttime and endtime
-        std::string sqlStmt = "SELECT min(" + *theOptions.time_column + ") as mintime, max(" +
-                              *theOptions.time_column + ") as maxtime FROM " + theOptions.schema +
-                              "." + theOptions.table + " WHERE " + *theOptions.time_column +
-                              " IS NOT NULL";
-
-        SafeLayer pLayer(connection->ExecuteSQL(sqlStmt.c_str(), nullptr, nullptr), layerdeleter);
-
-        if (!pLayer)
-          throw Fmi::Exception(BCP, "Gis-engine: PostGIS metadata query failed: '" + sqlStmt + "'");
-
-        SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
-
-        if (!pFeature)
-          throw Fmi::Exception(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
-
-        tm start_tm;
-        tm end_tm;
-
-        bool ret1 = pFeature->GetFieldAsDateTime(0,
-                                                 &start_tm.tm_year,
-                                                 &start_tm.tm_mon,
-                                                 &start_tm.tm_mday,
-                                                 &start_tm.tm_hour,
-                                                 &start_tm.tm_min,
-                                                 &start_tm.tm_sec,
-                                                 &start_tm.tm_isdst);
-        bool ret2 = pFeature->GetFieldAsDateTime(1,
-                                                 &end_tm.tm_year,
-                                                 &end_tm.tm_mon,
-                                                 &end_tm.tm_mday,
-                                                 &end_tm.tm_hour,
-                                                 &end_tm.tm_min,
-                                                 &end_tm.tm_sec,
-                                                 &end_tm.tm_isdst);
-
-        if (!ret1 || !ret2)
-        {
-          std::cout << "Reading values from '" << theOptions.schema << "." << theOptions.table
-                    << "." << *theOptions.time_column << "' failed!\n";
-        }
-        else
-        {
-          start_tm.tm_year -= 1900;  // years after 1900
-          start_tm.tm_mon -= 1;      // months 0..11
+    {
+      std::lock_guard<std::mutex> lock(itsMetaDataRefreshMutex);
+      if (!itsMetaDataRefreshes.insert(hash).second)
+        return;
+    }
+
+    boost::asio::post(*itsThreadPool,
+                      [this, theOptions, hash]()
+                      {
+                        try
+                        {
+                          if (!Spine::Reactor::isShuttingDown())
+                          {
+                            auto entry = std::make_shared<MetaDataCacheEntry>();
+                            entry->metadata = queryMetaData(theOptions);
+                            entry->expiration_time =
+                                std::chrono::steady_clock::now() +
+                                std::chrono::seconds(itsConfig->getMetaDataTTL());
+                            itsMetaDataCache.insert(hash, entry);
+                          }
+                        }
+                        catch (...)
+                        {
+                          // The old entry will be served until the next attempt
+                          Fmi::Exception::Trace(BCP, "Background metadata refresh failed!")
+                              .addParameter("Table", theOptions.schema + "." + theOptions.table)
+                              .printError();
+                        }
+                        std::lock_guard<std::mutex> lock(itsMetaDataRefreshMutex);
+                        itsMetaDataRefreshes.erase(hash);
+                      });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-          end_tm.tm_year -= 1900;  // years after 1900
-          end_tm.tm_mon -= 1;      // months 0..11
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch meta data (timesteps and bounding box) from db
+ *
+ * \param theOptions query options
+ */
+// ----------------------------------------------------------------------
 
-          auto starttime = Fmi::DateTime::from_tm(start_tm);
-          auto endtime = Fmi::DateTime::from_tm(end_tm);
-          metadata.timeinterval = TimeInterval{starttime, endtime, *timestep};
-        }
+MetaData Engine::queryMetaData(const MetaDataQueryOptions& theOptions) const
+{
+  try
+  {
+    QueryTrace trace("metadata", theOptions.pgname, theOptions.schema + "." + theOptions.table);
+    QueryFailureCheck failure_check(*itsSlowQueryLog, trace);
+
+    auto start = Clock::now();
+    auto connection = itsConnectionPool->get(theOptions.pgname);
+    trace.addStage("connect", Clock::now() - start);
+
+    auto metadata = queryMetaData(theOptions, connection, trace);
+    itsPipelineStatistics.add(
+        statistics_name(theOptions.pgname, theOptions.schema, theOptions.table),
+        "metadata",
+        Clock::now() - start,
+        0,
+        0,
+        metadata.timesteps.size());
+    itsSlowQueryLog->check(trace);
+    return metadata;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+MetaData Engine::queryMetaData(const MetaDataQueryOptions& theOptions,
+                               const ConnectionPool::Connection& connection,
+                               QueryTrace& theTrace) const
+{
+  try
+  {
+    // Files are read directly, there is no need to cache parts of the result
+    if (itsConfig->getFileSource(theOptions.pgname))
+      return FileSource::read_metadata(*itsConfig, connection.get(), theOptions);
+
+    MetaData metadata;
+
+    // 1) Get timesteps unless they are regular, in which case the time range
+    //    is requested with the envelope below
+    std::optional<Fmi::TimeDuration> timestep;
+    if (theOptions.time_column)
+    {
+      timestep = itsConfig->getTableTimeStep(theOptions.schema, theOptions.table);
+      if (!timestep)
+      {
+        auto start = Clock::now();
+        metadata.timesteps = getTimeSteps(connection.get(), theOptions, theTrace);
+        theTrace.addStage("timesteps", Clock::now() - start);
       }
     }
 
@@ -682,35 +1648,185 @@ MetaData Engine::getMetaData(const MetaDataQueryOptions& theOptions) const
     metadata.xmax = 0.0;
     metadata.ymax = 0.0;
 
-    // Cache envelopes. We assume no need to reduce envelope sizes when old data is deleted
+    // Cache envelopes. We assume no need to reduce envelope sizes when old data is deleted.
+    // Only exact extents may change when new data arrives.
     auto hash = theOptions.hash_value();
-    if (theOptions.time_column && !metadata.timesteps.empty())
+    auto extent_mode = itsConfig->getTableExtentMode(theOptions.schema, theOptions.table);
+    bool time_dependent = (extent_mode == ExtentMode::Exact || extent_mode == ExtentMode::Latest);
+    if (time_dependent && theOptions.time_column && !metadata.timesteps.empty())
     {
       const auto& last_time = metadata.timesteps.back();
       Fmi::hash_merge(hash, Fmi::to_iso_string(last_time));
     }
 
-    auto obj = itsEnvelopeCache.find(hash);
-    if (obj)
+    const auto stats_table =
+        statistics_name(theOptions.pgname, theOptions.schema, theOptions.table);
+
+    auto envelope = itsEnvelopeCache.find(hash);
+    if (envelope)
+      itsEnvelopeCacheAccounting.hit(hash, stats_table);
+    else
+      itsEnvelopeCacheAccounting.miss(stats_table);
+
+    // 3) Request SRID, extent and time range with a single statement, skipping the
+    //    parts which are already known
+    std::string srid_key = theOptions.pgname + '|' + theOptions.schema + '|' + theOptions.table +
+                           '|' + theOptions.geometry_column;
+
+    std::optional<int> srid;
+    if (!envelope)
+    {
+      std::lock_guard<std::mutex> lock(itsSridCacheMutex);
+      auto pos = itsSridCache.find(srid_key);
+      if (pos != itsSridCache.end())
+        srid = pos->second;
+    }
+
+    // ST_EstimatedExtent returns NULL or fails depending on the PostGIS version if the
+    // table has not been analyzed. A failure would abort the combined statement, hence
+    // the estimate is requested separately and the exact extent is combined if needed.
+    std::optional<OGREnvelope> estimated_envelope;
+    if (!envelope && extent_mode == ExtentMode::Estimated)
+    {
+      auto start = Clock::now();
+      const auto sqlStmt = estimated_extent_sql(theOptions);
+      theTrace.addQuery(sqlStmt);
+      try
+      {
+        estimated_envelope = query_envelope(connection.get(), sqlStmt);
+      }
+      catch (...)
+      {
+        // The exact extent is queried instead, but a persistent failure should be noticed
+        if (!itsConfig->quiet())
+          Fmi::Exception::Trace(BCP, "Warning: Estimated extent query failed, using exact extent")
+              .addParameter("Table", theOptions.schema + "." + theOptions.table)
+              .printError();
+      }
+      theTrace.addStage("estimated_extent", Clock::now() - start);
+    }
+
+    const bool query_extent =
+        (!envelope && extent_mode != ExtentMode::Fixed && !estimated_envelope);
+
+    const std::string table_name = theOptions.schema + "." + theOptions.table;
+
+    std::vector<std::string> columns;
+    if (!envelope && !srid)
+      columns.push_back("(SELECT st_srid(" + theOptions.geometry_column + ") FROM " + table_name +
+                        " LIMIT 1) AS srid");
+    if (query_extent)
+      columns.push_back(extent_sql(*itsConfig, theOptions) + " AS extent");
+    if (timestep)
+    {
+      const auto& time_column = *theOptions.time_column;
+      auto time_range = time_range_sql(theOptions);
+      if (!time_range.empty())
+        time_range = " WHERE " + time_range;
+      columns.push_back("(SELECT " + epoch_sql("min(" + time_column + ")") + " FROM " +
+                        table_name + time_range + ") AS mintime");
+      columns.push_back("(SELECT " + epoch_sql("max(" + time_column + ")") + " FROM " +
+                        table_name + time_range + ") AS maxtime");
+    }
+
+    OGREnvelope table_envelope;
+
+    if (!columns.empty())
+    {
+      auto start = Clock::now();
+      std::string sqlStmt = "SELECT " + boost::algorithm::join(columns, ", ");
+      theTrace.addQuery(sqlStmt);
+
+      auto layerdeleter = [&](OGRLayer* p) { connection->ReleaseResultSet(p); };
+      using SafeLayer = std::unique_ptr<OGRLayer, decltype(layerdeleter)>;
+
+      SafeLayer pLayer(connection->ExecuteSQL(sqlStmt.c_str(), nullptr, nullptr), layerdeleter);
+
+      if (!pLayer)
+        throw Fmi::Exception(BCP, "Gis-engine: PostGIS metadata query failed: '" + sqlStmt + "'");
+
+      SafeFeature pFeature(pLayer->GetNextFeature(), featuredeleter);
+
+      if (!pFeature)
+        throw Fmi::Exception(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
+
+      if (timestep)
+      {
+        auto i1 = pFeature->GetFieldIndex("mintime");
+        auto i2 = pFeature->GetFieldIndex("maxtime");
+        if (!pFeature->IsFieldSetAndNotNull(i1) || !pFeature->IsFieldSetAndNotNull(i2))
+        {
+          std::cout << "Reading values from '" << table_name << "." << *theOptions.time_column
+                    << "' failed!\n";
+        }
+        else
+        {
+          auto starttime = TimeSteps::from_seconds(pFeature->GetFieldAsInteger64(i1));
+          auto endtime = TimeSteps::from_seconds(pFeature->GetFieldAsInteger64(i2));
+          metadata.timeinterval = TimeInterval{starttime, endtime, *timestep};
+        }
+      }
+
+      if (!envelope && !srid)
+      {
+        auto i = pFeature->GetFieldIndex("srid");
+        if (pFeature->IsFieldSetAndNotNull(i))
+        {
+          srid = pFeature->GetFieldAsInteger(i);
+          std::lock_guard<std::mutex> lock(itsSridCacheMutex);
+          itsSridCache[srid_key] = *srid;
+        }
+        else
+        {
+          // Empty table, do not cache the default
+          auto default_epsg = itsConfig->getDefaultEPSG();
+          if (!default_epsg)
+            throw Fmi::Exception(BCP, "Gis-engine: Null SRID received from " + sqlStmt);
+
+          if (!itsConfig->quiet())
+            std::cerr << "Warning: " << table_name
+                      << " SRID is null. Setting EPSG to default value " << *default_epsg << '\n';
+          srid = *default_epsg;
+        }
+      }
+
+      if (query_extent)
+      {
+        const OGRGeometry* pGeometry = pFeature->GetGeometryRef();
+        if (!pGeometry)
+        {
+          Fmi::Exception ex(BCP, "Gis-engine: PostGIS feature query failed: '" + sqlStmt + "'");
+          if (itsConfig->quiet())
+            ex.disableLogging();
+          throw ex;
+        }
+        pGeometry->getEnvelope(&table_envelope);
+      }
+      theTrace.addStage("metadata_query", Clock::now() - start);
+    }
+
+    if (envelope)
     {
-      metadata.xmin = obj->MinX;
-      metadata.ymin = obj->MinY;
-      metadata.xmax = obj->MaxX;
-      metadata.ymax = obj->MaxY;
+      metadata.xmin = envelope->MinX;
+      metadata.ymin = envelope->MinY;
+      metadata.xmax = envelope->MaxX;
+      metadata.ymax = envelope->MaxY;
       return metadata;
     }
 
-    OGREnvelope table_envelope = getTableEnvelope(connection,
-                                                  theOptions.schema,
-                                                  theOptions.table,
-                                                  theOptions.geometry_column,
-                                                  itsConfig->quiet());
+    if (extent_mode == ExtentMode::Fixed)
+    {
+      auto fixed_bbox = itsConfig->getTableBBox(theOptions.schema, theOptions.table);
+      table_envelope.MinX = fixed_bbox->west;
+      table_envelope.MinY = fixed_bbox->south;
+      table_envelope.MaxX = fixed_bbox->east;
+      table_envelope.MaxY = fixed_bbox->north;
+    }
+    else if (estimated_envelope)
+      table_envelope = *estimated_envelope;
 
     // convert source spatial reference system to EPSG:4326
-    int epsg = getEpsgCode(
-        connection, theOptions.schema, theOptions.table, theOptions.geometry_column, *itsConfig);
-
-    Fmi::SpatialReference source(epsg);
+    Fmi::SpatialReference source(*srid);
     Fmi::SpatialReference target("WGS84");
     Fmi::CoordinateTransformation transformation(source, target);
 
@@ -725,6 +1841,7 @@ MetaData Engine::getMetaData(const MetaDataQueryOptions& theOptions) const
     }
 
     itsEnvelopeCache.insert(hash, table_envelope);
+    itsEnvelopeCacheAccounting.insert(hash, stats_table, sizeof(hash) + sizeof(table_envelope));
 
     return metadata;
   }
@@ -734,6 +1851,196 @@ MetaData Engine::getMetaData(const MetaDataQueryOptions& theOptions) const
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief True if shapes are read in their own spatial reference and reprojected here
+ */
+// ----------------------------------------------------------------------
+
+bool Engine::reprojectsNatively() const
+{
+  return (itsConfig->getNativeReprojection() &&
+          (itsFastProjections || itsConfig->getParallelReprojectionPoints() > 0));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Reproject a geometry from its own spatial reference
+ *
+ * Large multipart geometries are split into parts which are reprojected
+ * in parallel and then reassembled in the original order.
+ */
+// ----------------------------------------------------------------------
+
+OGRGeometryPtr Engine::reproject(const OGRGeometry& theGeometry,
+                                 const Fmi::SpatialReference& theSR) const
+{
+  try
+  {
+    const auto min_points = itsConfig->getParallelReprojectionPoints();
+    const auto* collection = dynamic_cast<const OGRGeometryCollection*>(&theGeometry);
+
+    if (!collection || collection->getNumGeometries() < 2 || min_points == 0 ||
+        count_points(&theGeometry) < static_cast<std::size_t>(min_points))
+    {
+      std::unique_ptr<Fmi::CoordinateTransformation> transformation;
+      return OGRGeometryPtr(reprojectOne(theGeometry, theSR, transformation));
+    }
+
+    std::vector<const OGRGeometry*> parts;
+    for (int i = 0; i < collection->getNumGeometries(); i++)
+      parts.push_back(collection->getGeometryRef(i));
+
+    auto results = reproject(parts, theSR);
+
+    std::unique_ptr<OGRGeometry> geom(
+        OGRGeometryFactory::createGeometry(wkbFlatten(theGeometry.getGeometryType())));
+    auto* out = dynamic_cast<OGRGeometryCollection*>(geom.get());
+
+    for (auto& part : results)
+    {
+      if (!part || part->IsEmpty())
+        continue;
+
+      if (!out->getSpatialReference())
+        out->assignSpatialReference(part->getSpatialReference());
+
+      if (out->addGeometryDirectly(part.get()) == OGRERR_NONE)
+      {
+        part.release();
+        continue;
+      }
+
+      // Clipping may turn a part into a multipart geometry of the same kind
+      auto* multi = dynamic_cast<OGRGeometryCollection*>(part.get());
+      bool ok = (multi != nullptr);
+      while (ok && !multi->IsEmpty())
+      {
+        ok = (out->addGeometry(multi->getGeometryRef(0)) == OGRERR_NONE);
+        multi->removeGeometry(0);
+      }
+
+      if (!ok)
+      {
+        std::unique_ptr<Fmi::CoordinateTransformation> transformation;
+        return OGRGeometryPtr(reprojectOne(theGeometry, theSR, transformation));
+      }
+    }
+
+    if (out->IsEmpty())
+      return {};
+
+    return OGRGeometryPtr(geom.release());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Reproject geometries with a common spatial reference in parallel
+ *
+ * The geometries are split into work items with roughly equal point
+ * counts. PROJ transformations are not thread safe, hence each work
+ * item creates its own. Small inputs are handled by the calling thread.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<std::unique_ptr<OGRGeometry>> Engine::reproject(
+    const std::vector<const OGRGeometry*>& theGeometries, const Fmi::SpatialReference& theSR) const
+{
+  try
+  {
+    std::vector<std::size_t> points;
+    std::size_t total = 0;
+    for (const auto* geom : theGeometries)
+    {
+      points.push_back(count_points(geom));
+      total += points.back();
+    }
+
+    const auto min_points = static_cast<std::size_t>(itsConfig->getParallelReprojectionPoints());
+    const auto threads = static_cast<std::size_t>(itsConfig->getThreads());
+
+    // A few work items per thread balance the load of uneven parts
+    std::size_t items = 1;
+    if (min_points > 0 && total >= min_points)
+      items = std::min(theGeometries.size(), 4 * threads);
+
+    std::vector<std::size_t> bounds{0};
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < theGeometries.size(); i++)
+    {
+      sum += points[i];
+      if (sum * items >= total * bounds.size() && bounds.size() < items)
+        bounds.push_back(i + 1);
+    }
+    if (bounds.back() != theGeometries.size())
+      bounds.push_back(theGeometries.size());
+
+    std::vector<std::unique_ptr<OGRGeometry>> results(theGeometries.size());
+
+    parallel_for(*itsThreadPool,
+                 bounds.size() - 1,
+                 threads,
+                 [&](std::size_t item)
+                 {
+                   std::unique_ptr<Fmi::CoordinateTransformation> transformation;
+                   for (std::size_t i = bounds[item]; i < bounds[item + 1]; i++)
+                     if (theGeometries[i])
+                       results[i] = reprojectOne(*theGeometries[i], theSR, transformation);
+                 });
+
+    return results;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Reproject a single geometry
+ *
+ * The fast kernels are used for validated pairs, otherwise the given
+ * PROJ transformation which is created on first use.
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<OGRGeometry> Engine::reprojectOne(
+    const OGRGeometry& theGeometry,
+    const Fmi::SpatialReference& theSR,
+    std::unique_ptr<Fmi::CoordinateTransformation>& theTransformation) const
+{
+  try
+  {
+    const auto* source = theGeometry.getSpatialReference();
+
+    if (itsFastProjections)
+    {
+      auto fast = itsFastProjections->get(*source, *theSR.get());
+      if (fast)
+      {
+        std::unique_ptr<OGRGeometry> geom(fast->transformGeometry(theGeometry));
+        if (geom)
+          return geom;
+      }
+    }
+
+    if (!theTransformation)
+      theTransformation =
+          std::make_unique<Fmi::CoordinateTransformation>(Fmi::SpatialReference(*source), theSR);
+    return std::unique_ptr<OGRGeometry>(theTransformation->transformGeometry(theGeometry));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 void Engine::populateGeometryStorage(const PostGISIdentifierVector& thePostGISIdentifiers,
                                      GeometryStorage& theGeometryStorage) const
 {
@@ -815,105 +2122,77 @@ void Engine::populateGeometryStorage(const PostGISIdentifierVector& thePostGISId
             geomid_pgkey_map[geomName + Fmi::to_string(static_cast<int>(geomType))] = pgKey;
           }
 
-          // If same name and type found
-          if (theGeometryStorage.itsGeometries.find(geomType) ==
-              theGeometryStorage.itsGeometries.end())
-          {
-            // If that type of geometries not found, add new one
-            NameOGRGeometryMap nameOGRGeometryMap;
-            nameOGRGeometryMap.insert(
-                make_pair(geomName, std::shared_ptr<OGRGeometry>(geom->clone())));
-            theGeometryStorage.itsGeometries.insert(std::make_pair(geomType, nameOGRGeometryMap));
-          }
-          else
-          {
-            // That type of geometries found
-            NameOGRGeometryMap& nameOGRGeometryMap = theGeometryStorage.itsGeometries[geomType];
-            // If named area not found, add new one
-            if (nameOGRGeometryMap.find(geomName) == nameOGRGeometryMap.end())
-            {
-              nameOGRGeometryMap.insert(
-                  std::make_pair(geomName, std::shared_ptr<OGRGeometry>(geom->clone())));
-            }
-            else
-            {
-              // Do the merge with the new and old one
-              std::shared_ptr<OGRGeometry>& previousGeom = nameOGRGeometryMap[geomName];
-              if (geomType == wkbMultiLineString)
-              {
-                // Multilinestrings are merged with addGeometryDirectly-function
-                auto* geom_tmp = dynamic_cast<OGRMultiLineString*>(previousGeom->clone());
-                const auto* new_geom = dynamic_cast<const OGRMultiLineString*>(geom);
-                // Iterate the LINESTRINGS inside Multilinestring and add them to old one
-                for (int i = 0; i < new_geom->getNumGeometries(); i++)
-                {
-                  geom_tmp->addGeometryDirectly(new_geom->getGeometryRef(i)->clone());
-                }
-                previousGeom.reset(geom_tmp);
-              }
-              else
-              {
-                // For other geometries use Union-function
-                previousGeom.reset(previousGeom->Union(geom));
-              }
-            }
-          }
-
-          std::string svgString = Fmi::OGR::exportToSvg(*geom, Fmi::Box::identity(), 6);
-
-          if (geomType == wkbPolygon || geomType == wkbMultiPolygon)
-          {
-#ifdef MYDEBUG
-            cout << "POLYGON in SVG format: " << svgString << endl;
-#endif
-            if (theGeometryStorage.itsPolygons.find(geomName) !=
-                theGeometryStorage.itsPolygons.end())
-              theGeometryStorage.itsPolygons[geomName] = svgString;
-            else
-              theGeometryStorage.itsPolygons.insert(std::make_pair(geomName, svgString));
-          }
-          else if (geomType == wkbLineString || geomType == wkbMultiLineString)
-          {
-#ifdef MYDEBUG
-            std::cout << "LINE in SVG format: " << svgString << std::endl;
-#endif
-            if (theGeometryStorage.itsLines.find(geomName) != theGeometryStorage.itsLines.end())
-            {
-              theGeometryStorage.itsLines[geomName].append(svgString);
-            }
-            else
-              theGeometryStorage.itsLines.insert(std::make_pair(geomName, svgString));
-          }
-          else if (geomType == wkbPoint)
-          {
-            const auto* ogrPoint = reinterpret_cast<const OGRPoint*>(geom);
-            if (theGeometryStorage.itsPoints.find(geomName) != theGeometryStorage.itsPoints.end())
-              theGeometryStorage.itsPoints[geomName] =
-                  std::make_pair(ogrPoint->getX(), ogrPoint->getY());
-            else
-              theGeometryStorage.itsPoints.insert(
-                  std::make_pair(geomName, std::make_pair(ogrPoint->getX(), ogrPoint->getY())));
-          }
+          theGeometryStorage.add(geomName, *geom);
         }
       }
     }
-    // Add quotation mark in the beginning and in the end
-    for (auto& svg : theGeometryStorage.itsLines)
-    {
-      if (!svg.second.empty() && svg.second[0] != '"')
-      {
-        svg.second.insert(0, "\"");
-        svg.second.append("\"");
-      }
-    }
-    for (auto& svg : theGeometryStorage.itsPolygons)
-    {
-      if (!svg.second.empty() && svg.second[0] != '"')
-      {
-        svg.second.insert(0, "\"");
-        svg.second.append("\"");
-      }
-    }
+    theGeometryStorage.quoteSVGPaths();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return timing and volume statistics of the processing stages
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<Spine::Table> Engine::getPipelineStatistics() const
+{
+  try
+  {
+    return itsPipelineStatistics.table();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return recent slow operations, the latest first
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<Spine::Table> Engine::getSlowQueries() const
+{
+  try
+  {
+    return itsSlowQueryLog->table();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return estimated cache contents and counters per table
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<Spine::Table> Engine::getCacheAccounting() const
+{
+  try
+  {
+    auto ret = std::make_unique<Spine::Table>();
+    ret->setTitle("GIS Engine Cache Contents");
+    ret->setNames(CacheAccounting::names());
+
+    int row = 0;
+    itsGeometryCacheAccounting.addRows(*ret, row);
+    if (itsCompressedCache)
+      itsCompressedCache->addRows(*ret, row);
+    if (itsSharedCache)
+      itsSharedCache->addRows(*ret, row);
+    itsFeaturesCacheAccounting.addRows(*ret, row);
+    itsEnvelopeCacheAccounting.addRows(*ret, row);
+    return ret;
   }
   catch (...)
   {
@@ -928,6 +2207,7 @@ Fmi::Cache::CacheStatistics Engine::getCacheStats() const
   ret.insert(std::make_pair("Gis::geometry_cache", itsCache.statistics()));
   ret.insert(std::make_pair("Gis::features_cache", itsFeaturesCache.statistics()));
   ret.insert(std::make_pair("Gis::envelope_cache", itsEnvelopeCache.statistics()));
+  ret.insert(std::make_pair("Gis::metadata_cache", itsMetaDataCache.statistics()));
   ret.insert(std::make_pair("Gis::gis-library::projection_info_cache",
                             Fmi::SpatialReference::getCacheStats()));
   ret.insert(std::make_pair("Gis::gis-library::spatial_reference_cache",
@@ -2,11 +2,22 @@
 
 #pragma once
 
+#include "AsyncExecutor.h"
+#include "CacheAccounting.h"
+#include "CompressedCache.h"
 #include "Config.h"
+#include "ConnectionPool.h"
+#include "FastProjection.h"
+#include "FlatGeometry.h"
 #include "GeometryStorage.h"
 #include "MapOptions.h"
 #include "MetaData.h"
+#include "PipelineStatistics.h"
+#include "SharedCache.h"
+#include "SlowQueryLog.h"
+#include <boost/asio/thread_pool.hpp>
 #include <memory>
+#include <gis/CoordinateTransformation.h>
 #include <gis/SpatialReference.h>
 #include <gis/Types.h>
 #include <macgyver/Cache.h>
@@ -14,7 +25,13 @@
 #include <spine/SmartMetEngine.h>
 #include <libconfig.h++>
 #include <ogr_geometry.h>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -42,23 +59,75 @@ class Engine : public SmartMet::Spine::SmartMetEngine
   Fmi::Features getFeatures(const MapOptions& theOptions) const;
   Fmi::Features getFeatures(const Fmi::SpatialReference& theSR, const MapOptions& theOptions) const;
 
+  // the cached flat representations, for readers which need only the coordinates
+  std::shared_ptr<const FlatGeometry> getFlatShape(const Fmi::SpatialReference* theSR,
+                                                   const MapOptions& theOptions) const;
+  std::shared_ptr<const FlatFeatures> getFlatFeatures(const MapOptions& theOptions) const;
+  std::shared_ptr<const FlatFeatures> getFlatFeatures(const Fmi::SpatialReference& theSR,
+                                                      const MapOptions& theOptions) const;
+
   MetaData getMetaData(const MetaDataQueryOptions& theOptions) const;
+  std::vector<MetaData> getMetaData(const std::vector<MetaDataQueryOptions>& theOptions) const;
 
   void populateGeometryStorage(const PostGISIdentifierVector& thePostGISIdentifiers,
                                GeometryStorage& theGeometryStorage) const;
 
+  // asynchronous variants with a limited number of concurrent requests per pgname
+  std::future<OGRGeometryPtr> getShapeAsync(const Fmi::SpatialReference* theSR,
+                                            const MapOptions& theOptions) const;
+  std::future<Fmi::Features> getFeaturesAsync(const MapOptions& theOptions) const;
+  std::future<Fmi::Features> getFeaturesAsync(const Fmi::SpatialReference& theSR,
+                                              const MapOptions& theOptions) const;
+  std::future<MetaData> getMetaDataAsync(const MetaDataQueryOptions& theOptions) const;
+
+  // timing and volume statistics of database reads and processing stages
+  std::unique_ptr<Spine::Table> getPipelineStatistics() const;
+
+  // estimated bytes, hits, misses, evictions and entry ages of the caches per table
+  std::unique_ptr<Spine::Table> getCacheAccounting() const;
+
+  // recent operations which exceeded the slow query thresholds
+  std::unique_ptr<Spine::Table> getSlowQueries() const;
+
  protected:
   void init() override;
   void shutdown() override;
 
  private:
   Fmi::Features getFeatures(const Fmi::SpatialReference* theSR, const MapOptions& theOptions) const;
-
-  OGREnvelope getTableEnvelope(const GDALDataPtr& connection,
-                               const std::string& schema,
-                               const std::string& table,
-                               const std::string& geometry_column,
-                               bool quiet) const;
+  std::shared_ptr<const FlatFeatures> getFlatFeatures(const Fmi::SpatialReference* theSR,
+                                                      const MapOptions& theOptions) const;
+  std::shared_ptr<const FlatGeometry> getFlatShape(const Fmi::SpatialReference* theSR,
+                                                   const MapOptions& theOptions,
+                                                   bool theStage) const;
+  std::shared_ptr<const FlatGeometry> findShape(const std::string& theKey,
+                                                const std::string& theTable,
+                                                bool theStage) const;
+  std::shared_ptr<const FlatGeometry> cacheShape(const std::string& theKey,
+                                                 const std::string& theTable,
+                                                 std::unique_ptr<FlatGeometry> theGeom) const;
+
+  MetaData queryMetaData(const MetaDataQueryOptions& theOptions) const;
+  MetaData queryMetaData(const MetaDataQueryOptions& theOptions,
+                         const ConnectionPool::Connection& connection,
+                         QueryTrace& theTrace) const;
+  void refreshMetaData(const MetaDataQueryOptions& theOptions) const;
+  void buildLevels(const Fmi::SpatialReference* theSR, const MapOptions& theOptions) const;
+
+  TimeSteps getTimeSteps(const GDALDataPtr& connection,
+                         const MetaDataQueryOptions& theOptions,
+                         QueryTrace& theTrace) const;
+
+  bool reprojectsNatively() const;
+  OGRGeometryPtr reproject(const OGRGeometry& theGeometry,
+                           const Fmi::SpatialReference& theSR) const;
+  std::vector<std::unique_ptr<OGRGeometry>> reproject(
+      const std::vector<const OGRGeometry*>& theGeometries,
+      const Fmi::SpatialReference& theSR) const;
+  std::unique_ptr<OGRGeometry> reprojectOne(
+      const OGRGeometry& theGeometry,
+      const Fmi::SpatialReference& theSR,
+      std::unique_ptr<Fmi::CoordinateTransformation>& theTransformation) const;
 
   Fmi::Cache::CacheStatistics getCacheStats() const override;
 
@@ -66,17 +135,78 @@ class Engine : public SmartMet::Spine::SmartMetEngine
   std::unique_ptr<Config> itsConfig;  // ptr for delayed initialization
 
   // Cached contents
-  using GeometryCache = Fmi::Cache::Cache<std::string, OGRGeometryPtr>;
+  using GeometryCache = Fmi::Cache::Cache<std::string, std::shared_ptr<const FlatGeometry>>;
   mutable GeometryCache itsCache;
 
+  // compressed second tier for geometries evicted from the cache, destroyed
+  // before the cache so that the final evictions are not compressed
+  std::shared_ptr<CompressedCache> itsCompressedCache;
+
+  // geometries shared with the other server processes of the node
+  std::unique_ptr<SharedCache> itsSharedCache;
+
   // cache for geometries with attributes
-  using FeaturesCache = Fmi::Cache::Cache<std::string, Fmi::Features>;
+  using FeaturesCache = Fmi::Cache::Cache<std::string, std::shared_ptr<const FlatFeatures>>;
   mutable FeaturesCache itsFeaturesCache;
 
   // cache for envelopes
   using EnvelopeCache = Fmi::Cache::Cache<std::size_t, OGREnvelope>;
   mutable EnvelopeCache itsEnvelopeCache;
 
+  // per table accounting of the above caches
+  mutable CacheAccounting itsGeometryCacheAccounting{"Gis::geometry_cache"};
+  mutable CacheAccounting itsFeaturesCacheAccounting{"Gis::features_cache"};
+  mutable CacheAccounting itsEnvelopeCacheAccounting{"Gis::envelope_cache"};
+
+  // cache for timesteps of tables without a fixed timestep. The entries are updated
+  // incrementally, the mutex in each entry prevents simultaneous updates.
+  struct TimeStepCacheEntry
+  {
+    std::mutex mutex;
+    TimeSteps timesteps;
+    std::chrono::steady_clock::time_point reconcile_time;
+  };
+  mutable std::mutex itsTimeStepCacheMutex;
+  mutable std::map<std::string, std::shared_ptr<TimeStepCacheEntry>> itsTimeStepCache;
+
+  // cache for full metadata. Expired entries are returned as is while they are
+  // refreshed in the background.
+  struct MetaDataCacheEntry
+  {
+    MetaData metadata;
+    std::chrono::steady_clock::time_point expiration_time;
+  };
+  using MetaDataCache = Fmi::Cache::Cache<std::size_t, std::shared_ptr<const MetaDataCacheEntry>>;
+  mutable MetaDataCache itsMetaDataCache;
+
+  // metadata refreshes in progress
+  mutable std::mutex itsMetaDataRefreshMutex;
+  mutable std::set<std::size_t> itsMetaDataRefreshes;
+
+  // level of detail ladders built or being built in the background, at most the cache size
+  mutable std::mutex itsLODBuildMutex;
+  mutable std::set<std::size_t> itsLODBuilds;
+
+  // cache for geometry column SRIDs, which practically never change
+  mutable std::mutex itsSridCacheMutex;
+  mutable std::map<std::string, int> itsSridCache;
+
+  // processing statistics
+  mutable PipelineStatistics itsPipelineStatistics;
+  std::unique_ptr<SlowQueryLog> itsSlowQueryLog;
+
+  // validated fast projections, nullptr if disabled
+  std::unique_ptr<FastProjections> itsFastProjections;
+
+  // database connections
+  std::unique_ptr<ConnectionPool> itsConnectionPool;
+
+  // worker threads for background tasks, destroyed first to join the tasks
+  std::unique_ptr<boost::asio::thread_pool> itsThreadPool;
+
+  // executor for asynchronous requests, destroyed before the above
+  std::unique_ptr<AsyncExecutor> itsAsyncExecutor;
+
 };  // class Engine
 
 }  // namespace Gis
@@ -0,0 +1,567 @@
+#include "FastProjection.h"
+#include "GdalUtils.h"
+#include <gis/CoordinateTransformation.h>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Projection formulas for a single CRS
+ *
+ * The kernels convert whole arrays in place between longitude/latitude
+ * in degrees and the projected coordinates. The loops have no branches
+ * so that the compiler can vectorize them.
+ */
+// ----------------------------------------------------------------------
+
+class FastProjectionKernel
+{
+ public:
+  FastProjectionKernel(double theWest, double theEast, double theSouth, double theNorth)
+      : west(theWest), east(theEast), south(theSouth), north(theNorth)
+  {
+  }
+  virtual ~FastProjectionKernel() = default;
+
+  virtual bool geographic() const { return false; }
+
+  // longitude/latitude to projected coordinates
+  virtual void forward(std::size_t theCount, double* x, double* y) const = 0;
+
+  // projected coordinates to longitude/latitude
+  virtual void inverse(std::size_t theCount, double* x, double* y) const = 0;
+
+  // true if all the longitudes and latitudes are in the validated area
+  bool contains(std::size_t theCount, const double* lon, const double* lat) const
+  {
+    bool ok = true;
+    for (std::size_t i = 0; i < theCount; i++)
+      ok &= (lon[i] >= west) & (lon[i] <= east) & (lat[i] >= south) & (lat[i] <= north);
+    return ok;
+  }
+
+  // validated area in degrees
+  const double west;
+  const double east;
+  const double south;
+  const double north;
+};
+
+namespace
+{
+const double deg_to_rad = M_PI / 180.0;
+const double rad_to_deg = 180.0 / M_PI;
+
+// Geographic coordinates, no conversion needed
+class Geographic : public FastProjectionKernel
+{
+ public:
+  Geographic() : FastProjectionKernel(-180, 180, -90, 90) {}
+
+  bool geographic() const override { return true; }
+  void forward(std::size_t /* theCount */, double* /* x */, double* /* y */) const override {}
+  void inverse(std::size_t /* theCount */, double* /* x */, double* /* y */) const override {}
+};
+
+// EPSG:3857, spherical mercator on the WGS84 major axis
+class WebMercator : public FastProjectionKernel
+{
+ public:
+  WebMercator() : FastProjectionKernel(-180, 180, -85, 85) {}
+
+  void forward(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      x[i] = a * deg_to_rad * x[i];
+      y[i] = a * std::asinh(std::tan(deg_to_rad * y[i]));
+    }
+  }
+
+  void inverse(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      x[i] = rad_to_deg * x[i] / a;
+      y[i] = rad_to_deg * std::atan(std::sinh(y[i] / a));
+    }
+  }
+
+ private:
+  static constexpr double a = 6378137.0;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Ellipsoidal transverse mercator
+ *
+ * Krüger series to sixth order in the third flattening as given by
+ * Karney (2011), accurate to nanometers within thousands of kilometers
+ * from the central meridian.
+ */
+// ----------------------------------------------------------------------
+
+class TransverseMercator : public FastProjectionKernel
+{
+ public:
+  TransverseMercator(double theA,
+                     double theInvF,
+                     double theLon0,
+                     double theK0,
+                     double theFalseEasting,
+                     double theFalseNorthing,
+                     double theWest,
+                     double theEast,
+                     double theSouth,
+                     double theNorth)
+      : FastProjectionKernel(theWest, theEast, theSouth, theNorth),
+        lon0(theLon0),
+        fe(theFalseEasting),
+        fn(theFalseNorthing)
+  {
+    const double f = 1 / theInvF;
+    e = std::sqrt(f * (2 - f));
+    const double n = f / (2 - f);
+    const double n2 = n * n;
+    const double n3 = n2 * n;
+    const double n4 = n3 * n;
+    const double n5 = n4 * n;
+    const double n6 = n5 * n;
+
+    ka = theK0 * theA / (1 + n) * (1 + n2 / 4 + n4 / 64 + n6 / 256);
+
+    alpha[0] = n / 2 - 2 * n2 / 3 + 5 * n3 / 16 + 41 * n4 / 180 - 127 * n5 / 288 +
+               7891 * n6 / 37800;
+    alpha[1] = 13 * n2 / 48 - 3 * n3 / 5 + 557 * n4 / 1440 + 281 * n5 / 630 -
+               1983433 * n6 / 1935360;
+    alpha[2] = 61 * n3 / 240 - 103 * n4 / 140 + 15061 * n5 / 26880 + 167603 * n6 / 181440;
+    alpha[3] = 49561 * n4 / 161280 - 179 * n5 / 168 + 6601661 * n6 / 7257600;
+    alpha[4] = 34729 * n5 / 80640 - 3418889 * n6 / 1995840;
+    alpha[5] = 212378941 * n6 / 319334400;
+
+    beta[0] = n / 2 - 2 * n2 / 3 + 37 * n3 / 96 - n4 / 360 - 81 * n5 / 512 + 96199 * n6 / 604800;
+    beta[1] = n2 / 48 + n3 / 15 - 437 * n4 / 1440 + 46 * n5 / 105 - 1118711 * n6 / 3870720;
+    beta[2] = 17 * n3 / 480 - 37 * n4 / 840 - 209 * n5 / 4480 + 5569 * n6 / 90720;
+    beta[3] = 4397 * n4 / 161280 - 11 * n5 / 504 - 830251 * n6 / 7257600;
+    beta[4] = 4583 * n5 / 161280 - 108847 * n6 / 3991680;
+    beta[5] = 20648693 * n6 / 638668800;
+  }
+
+  void forward(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      const double lambda = deg_to_rad * (x[i] - lon0);
+      const double tau = std::tan(deg_to_rad * y[i]);
+
+      // conformal latitude
+      const double sigma = std::sinh(e * std::atanh(e * tau / std::sqrt(1 + tau * tau)));
+      const double taup = tau * std::sqrt(1 + sigma * sigma) - sigma * std::sqrt(1 + tau * tau);
+
+      const double coslambda = std::cos(lambda);
+      const double xip = std::atan2(taup, coslambda);
+      const double etap =
+          std::asinh(std::sin(lambda) / std::sqrt(taup * taup + coslambda * coslambda));
+
+      double xi = xip;
+      double eta = etap;
+      for (int j = 0; j < 6; j++)
+      {
+        const double k = 2 * (j + 1);
+        xi += alpha[j] * std::sin(k * xip) * std::cosh(k * etap);
+        eta += alpha[j] * std::cos(k * xip) * std::sinh(k * etap);
+      }
+
+      x[i] = fe + ka * eta;
+      y[i] = fn + ka * xi;
+    }
+  }
+
+  void inverse(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      const double eta = (x[i] - fe) / ka;
+      const double xi = (y[i] - fn) / ka;
+
+      double xip = xi;
+      double etap = eta;
+      for (int j = 0; j < 6; j++)
+      {
+        const double k = 2 * (j + 1);
+        xip -= beta[j] * std::sin(k * xi) * std::cosh(k * eta);
+        etap -= beta[j] * std::cos(k * xi) * std::sinh(k * eta);
+      }
+
+      const double sinhetap = std::sinh(etap);
+      const double cosxip = std::cos(xip);
+      const double taup = std::sin(xip) / std::sqrt(sinhetap * sinhetap + cosxip * cosxip);
+
+      // Newton iteration from the conformal latitude, converges in a few steps
+      const double e2 = e * e;
+      double tau = taup;
+      for (int iter = 0; iter < 5; iter++)
+      {
+        const double tau2 = 1 + tau * tau;
+        const double sigma = std::sinh(e * std::atanh(e * tau / std::sqrt(tau2)));
+        const double taui = tau * std::sqrt(1 + sigma * sigma) - sigma * std::sqrt(tau2);
+        tau += (taup - taui) / std::sqrt(1 + taui * taui) * (1 + (1 - e2) * tau * tau) /
+               ((1 - e2) * std::sqrt(tau2));
+      }
+
+      x[i] = lon0 + rad_to_deg * std::atan2(sinhetap, cosxip);
+      y[i] = rad_to_deg * std::atan(tau);
+    }
+  }
+
+ private:
+  double lon0;
+  double fe;
+  double fn;
+  double e = 0;
+  double ka = 0;  // scale factor times the rectifying radius
+  double alpha[6];
+  double beta[6];
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Ellipsoidal Lambert azimuthal equal area (EPSG method 9820)
+ */
+// ----------------------------------------------------------------------
+
+class LambertAzimuthalEqualArea : public FastProjectionKernel
+{
+ public:
+  LambertAzimuthalEqualArea(double theA,
+                            double theInvF,
+                            double theLon0,
+                            double theLat0,
+                            double theFalseEasting,
+                            double theFalseNorthing,
+                            double theWest,
+                            double theEast,
+                            double theSouth,
+                            double theNorth)
+      : FastProjectionKernel(theWest, theEast, theSouth, theNorth),
+        lon0(theLon0),
+        fe(theFalseEasting),
+        fn(theFalseNorthing)
+  {
+    const double f = 1 / theInvF;
+    e = std::sqrt(f * (2 - f));
+    const double e2 = e * e;
+    const double phi0 = deg_to_rad * theLat0;
+    const double sinphi0 = std::sin(phi0);
+
+    qp = q(1.0);
+    const double beta0 = std::asin(q(sinphi0) / qp);
+    sinbeta0 = std::sin(beta0);
+    cosbeta0 = std::cos(beta0);
+    rq = theA * std::sqrt(qp / 2);
+    d = theA * std::cos(phi0) / (std::sqrt(1 - e2 * sinphi0 * sinphi0) * rq * cosbeta0);
+  }
+
+  void forward(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      const double dlambda = deg_to_rad * (x[i] - lon0);
+      const double sinbeta = q(std::sin(deg_to_rad * y[i])) / qp;
+      const double cosbeta = std::sqrt(std::max(0.0, 1 - sinbeta * sinbeta));
+      const double cosdlambda = std::cos(dlambda);
+      const double b =
+          rq * std::sqrt(2 / (1 + sinbeta0 * sinbeta + cosbeta0 * cosbeta * cosdlambda));
+
+      x[i] = fe + b * d * cosbeta * std::sin(dlambda);
+      y[i] = fn + (b / d) * (cosbeta0 * sinbeta - sinbeta0 * cosbeta * cosdlambda);
+    }
+  }
+
+  void inverse(std::size_t theCount, double* __restrict x, double* __restrict y) const override
+  {
+    const double e2 = e * e;
+    for (std::size_t i = 0; i < theCount; i++)
+    {
+      const double dx = x[i] - fe;
+      const double dy = y[i] - fn;
+      const double rho = std::max(1e-12, std::sqrt(dx * dx / (d * d) + d * d * dy * dy));
+      const double c = 2 * std::asin(std::min(1.0, rho / (2 * rq)));
+      const double sinc = std::sin(c);
+      const double cosc = std::cos(c);
+
+      const double sinbeta = cosc * sinbeta0 + d * dy * sinc * cosbeta0 / rho;
+      const double lambda =
+          std::atan2(dx * sinc, d * rho * cosbeta0 * cosc - d * d * dy * sinbeta0 * sinc);
+
+      // Newton iteration for the latitude with the given authalic latitude
+      const double qi = qp * sinbeta;
+      double phi = std::asin(std::max(-1.0, std::min(1.0, sinbeta)));
+      for (int iter = 0; iter < 5; iter++)
+      {
+        const double sinphi = std::sin(phi);
+        const double cosphi = std::max(1e-15, std::cos(phi));
+        const double w = 1 - e2 * sinphi * sinphi;
+        phi += w * w / (2 * cosphi) * (qi / (1 - e2) - sinphi / w + atanh_term(sinphi));
+      }
+
+      x[i] = lon0 + rad_to_deg * lambda;
+      y[i] = rad_to_deg * phi;
+    }
+  }
+
+ private:
+  // 1/(2e) * ln((1-e sin phi)/(1+e sin phi)) = -atanh(e sin phi)/e
+  double atanh_term(double theSinPhi) const { return -std::atanh(e * theSinPhi) / e; }
+
+  double q(double theSinPhi) const
+  {
+    const double e2 = e * e;
+    return (1 - e2) *
+           (theSinPhi / (1 - e2 * theSinPhi * theSinPhi) - atanh_term(theSinPhi));
+  }
+
+  double lon0;
+  double fe;
+  double fn;
+  double e = 0;
+  double qp = 0;
+  double rq = 0;
+  double d = 0;
+  double sinbeta0 = 0;
+  double cosbeta0 = 0;
+};
+
+const double grs80_a = 6378137.0;
+const double grs80_invf = 298.257222101;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The kernel for an EPSG code, or nullptr if there is none
+ *
+ * The validated areas cover the regions where the projections are used
+ * with a wide margin. ETRS89 is treated as equal to WGS84 like PROJ does
+ * when no datum grids are involved, the validation checks this too.
+ */
+// ----------------------------------------------------------------------
+
+const FastProjectionKernel* find_kernel(int theEPSG)
+{
+  static const Geographic geographic;
+  static const WebMercator webmercator;
+  static const TransverseMercator tm35fin(
+      grs80_a, grs80_invf, 27, 0.9996, 500000, 0, -13, 67, 30, 85);
+  static const LambertAzimuthalEqualArea laea(
+      grs80_a, grs80_invf, 10, 52, 4321000, 3210000, -45, 65, 15, 85);
+
+  switch (theEPSG)
+  {
+    case 4326:
+    case 4258:
+      return &geographic;
+    case 3857:
+      return &webmercator;
+    case 3067:
+      return &tm35fin;
+    case 3035:
+      return &laea;
+    default:
+      return nullptr;
+  }
+}
+
+std::optional<int> epsg(const OGRSpatialReference& theSR)
+{
+  const char* authority = theSR.GetAuthorityName(nullptr);
+  const char* code = theSR.GetAuthorityCode(nullptr);
+  if (authority == nullptr || code == nullptr || strcmp(authority, "EPSG") != 0)
+    return {};
+  return std::atoi(code);
+}
+
+}  // namespace
+
+FastProjection::FastProjection(const FastProjectionKernel& theSource,
+                               const FastProjectionKernel& theTarget,
+                               const OGRSpatialReference& theTargetSR)
+    : itsSource(theSource), itsTarget(theTarget), itsTargetSR(theTargetSR.Clone())
+{
+  // The kernels output x before y, and the results share this object between
+  // threads, so it is never modified after this
+  itsTargetSR->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+}
+
+FastProjection::~FastProjection()
+{
+  if (itsTargetSR)
+    itsTargetSR->Release();
+}
+
+bool FastProjection::transform(std::size_t theCount, double* theX, double* theY) const
+{
+  itsSource.inverse(theCount, theX, theY);
+  if (!itsSource.contains(theCount, theX, theY) || !itsTarget.contains(theCount, theX, theY))
+    return false;
+  itsTarget.forward(theCount, theX, theY);
+  return true;
+}
+
+OGRGeometry* FastProjection::transformGeometry(const OGRGeometry& theGeometry) const
+{
+  try
+  {
+    std::unique_ptr<OGRGeometry> geom(theGeometry.clone());
+    auto conv = make_geometry_conv([this](CoordinateConv::SizeType n, double* x, double* y)
+                                   { return transform(static_cast<std::size_t>(n), x, y); });
+
+    if (geom->transform(&conv) != OGRERR_NONE)
+      return nullptr;
+
+    geom->assignSpatialReference(itsTargetSR);
+    return geom.release();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compare against PROJ on a grid over the validated area
+ *
+ * Deviations of geographic targets are converted to meters.
+ */
+// ----------------------------------------------------------------------
+
+double FastProjection::validate(const Fmi::SpatialReference& theSource,
+                                const Fmi::SpatialReference& theTarget) const
+{
+  try
+  {
+    const double west = std::max(itsSource.west, itsTarget.west);
+    const double east = std::min(itsSource.east, itsTarget.east);
+    const double south = std::max(itsSource.south, itsTarget.south);
+    const double north = std::min(itsSource.north, itsTarget.north);
+
+    Fmi::SpatialReference wgs84("WGS84");
+    Fmi::CoordinateTransformation to_source(wgs84, theSource);
+    Fmi::CoordinateTransformation to_target(theSource, theTarget);
+
+    const int n = 40;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> px;
+    std::vector<double> py;
+    for (int i = 0; i <= n; i++)
+      for (int j = 0; j <= n; j++)
+      {
+        double lon = west + i * (east - west) / n;
+        double lat = south + j * (north - south) / n;
+        if (!to_source.transform(lon, lat))
+          return HUGE_VAL;
+        x.push_back(lon);
+        y.push_back(lat);
+        if (!to_target.transform(lon, lat))
+          return HUGE_VAL;
+        px.push_back(lon);
+        py.push_back(lat);
+      }
+
+    if (!transform(x.size(), x.data(), y.data()))
+      return HUGE_VAL;
+
+    const double scale = (itsTarget.geographic() ? 111320.0 : 1.0);
+    double error = 0;
+    for (std::size_t i = 0; i < x.size(); i++)
+      error = std::max(error, scale * std::hypot(x[i] - px[i], y[i] - py[i]));
+
+    // NaN is not smaller than any tolerance
+    return (std::isnan(error) ? HUGE_VAL : error);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+FastProjections::FastProjections(double theTolerance) : itsTolerance(theTolerance) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a validated fast projection
+ *
+ * The first request for a pair validates it, later requests only look
+ * up the result. Spatial references which do not use the traditional
+ * GIS axis order are left for PROJ, since the kernels assume x before y.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FastProjection> FastProjections::get(
+    const OGRSpatialReference& theSource, const OGRSpatialReference& theTarget) const
+{
+  try
+  {
+    auto source = epsg(theSource);
+    auto target = epsg(theTarget);
+    if (!source || !target || *source == *target)
+      return {};
+
+    // The kernels handle only data with x before y
+    const auto source_strategy = theSource.GetAxisMappingStrategy();
+    const auto target_strategy = theTarget.GetAxisMappingStrategy();
+    if (source_strategy != OAMS_TRADITIONAL_GIS_ORDER ||
+        target_strategy != OAMS_TRADITIONAL_GIS_ORDER)
+      return {};
+
+    const auto* source_kernel = find_kernel(*source);
+    const auto* target_kernel = find_kernel(*target);
+    if (!source_kernel || !target_kernel)
+      return {};
+
+    const auto key = std::make_tuple(*source, source_strategy, *target, target_strategy);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto pos = itsProjections.find(key);
+    if (pos != itsProjections.end())
+      return pos->second;
+
+    auto projection = std::make_shared<const FastProjection>(
+        *source_kernel, *target_kernel, theTarget);
+
+    try
+    {
+      auto error = projection->validate(Fmi::SpatialReference(theSource),
+                                        Fmi::SpatialReference(theTarget));
+      if (!(error <= itsTolerance))
+        projection.reset();
+    }
+    catch (...)
+    {
+      // PROJ could not handle the pair either, let it report the error later
+      projection.reset();
+    }
+
+    itsProjections[key] = projection;
+    return projection;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,85 @@
+// ======================================================================
+/*!
+ * \brief Fast reprojection between the most commonly used CRS
+ *
+ * WGS84, EPSG:3857 (web mercator), EPSG:3067 (ETRS-TM35FIN) and
+ * EPSG:3035 (ETRS-LAEA) are projected with dedicated kernels which
+ * process whole coordinate arrays. Each source and target pair is
+ * validated once against PROJ, and pairs which are not supported or
+ * which exceed the tolerance are left for PROJ to handle. Geometries
+ * extending outside the validated area are also left for PROJ.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/SpatialReference.h>
+#include <gis/Types.h>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ogr_spatialref.h>
+#include <tuple>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class FastProjectionKernel;
+
+class FastProjection
+{
+ public:
+  FastProjection(const FastProjectionKernel& theSource,
+                 const FastProjectionKernel& theTarget,
+                 const OGRSpatialReference& theTargetSR);
+  ~FastProjection();
+
+  FastProjection() = delete;
+  FastProjection(const FastProjection& other) = delete;
+  FastProjection& operator=(const FastProjection& other) = delete;
+
+  // Transform coordinates in place, false if some are outside the validated area
+  bool transform(std::size_t theCount, double* theX, double* theY) const;
+
+  // Transformed copy, or nullptr if the geometry is outside the validated area
+  OGRGeometry* transformGeometry(const OGRGeometry& theGeometry) const;
+
+  // Largest deviation from PROJ in target units over the validated area
+  double validate(const Fmi::SpatialReference& theSource,
+                  const Fmi::SpatialReference& theTarget) const;
+
+ private:
+  const FastProjectionKernel& itsSource;
+  const FastProjectionKernel& itsTarget;
+  OGRSpatialReference* itsTargetSR = nullptr;  // reference counted
+};
+
+class FastProjections
+{
+ public:
+  explicit FastProjections(double theTolerance);
+
+  FastProjections() = delete;
+  FastProjections(const FastProjections& other) = delete;
+  FastProjections& operator=(const FastProjections& other) = delete;
+
+  // Validated fast projection for the pair, or nullptr if PROJ must be used
+  std::shared_ptr<const FastProjection> get(const OGRSpatialReference& theSource,
+                                            const OGRSpatialReference& theTarget) const;
+
+ private:
+  const double itsTolerance;  // meters
+
+  // validated pairs by EPSG codes and axis mapping strategies, nullptr for rejected pairs
+  using Key = std::tuple<int, OSRAxisMappingStrategy, int, OSRAxisMappingStrategy>;
+  mutable std::mutex itsMutex;
+  mutable std::map<Key, std::shared_ptr<const FastProjection>> itsProjections;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
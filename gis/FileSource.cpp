@@ -0,0 +1,514 @@
+#include "FileSource.h"
+#include "Config.h"
+#include <gis/CoordinateTransformation.h>
+#include <macgyver/Exception.h>
+#include <gdal_priv.h>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <ogrsf_frmts.h>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace FileSource
+{
+namespace
+{
+const auto featuredeleter = [](OGRFeature* p) { OGRFeature::DestroyFeature(p); };
+using SafeFeature = std::unique_ptr<OGRFeature, decltype(featuredeleter)>;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Access to a layer of a pooled dataset
+ *
+ * Filters are part of the layer state, hence they are reset when the
+ * reader is destroyed so that the next user of the dataset gets a clean
+ * layer.
+ */
+// ----------------------------------------------------------------------
+
+class LayerReader
+{
+ public:
+  LayerReader(const GDALDataPtr& theDataset,
+              const std::string& theSchema,
+              const std::string& theTable,
+              const std::optional<std::string>& theWhereClause)
+  {
+    if (!theSchema.empty())
+      itsLayer = theDataset->GetLayerByName((theSchema + "." + theTable).c_str());
+    if (!itsLayer)
+      itsLayer = theDataset->GetLayerByName(theTable.c_str());
+    if (!itsLayer)
+      throw Fmi::Exception(BCP, "Layer not found from data source")
+          .addParameter("Layer", theTable)
+          .addParameter("Data source", theDataset->GetDescription());
+
+    if (theWhereClause && itsLayer->SetAttributeFilter(theWhereClause->c_str()) != OGRERR_NONE)
+    {
+      itsLayer->SetAttributeFilter(nullptr);
+      throw Fmi::Exception(BCP, "Invalid attribute filter for layer")
+          .addParameter("Layer", theTable)
+          .addParameter("Filter", *theWhereClause);
+    }
+    itsLayer->ResetReading();
+  }
+
+  ~LayerReader()
+  {
+    itsLayer->SetAttributeFilter(nullptr);
+    itsLayer->SetIgnoredFields(nullptr);
+    itsLayer->ResetReading();
+  }
+
+  LayerReader() = delete;
+  LayerReader(const LayerReader& other) = delete;
+  LayerReader& operator=(const LayerReader& other) = delete;
+  LayerReader(LayerReader&& other) = delete;
+  LayerReader& operator=(LayerReader&& other) = delete;
+
+  OGRLayer* get() const { return itsLayer; }
+  OGRLayer* operator->() const { return itsLayer; }
+
+ private:
+  OGRLayer* itsLayer = nullptr;
+};
+
+// Transformation from the layer spatial reference, or nullptr if none is needed
+std::unique_ptr<Fmi::CoordinateTransformation> make_transformation(
+    OGRLayer* theLayer, const Fmi::SpatialReference* theSR)
+{
+  if (!theSR)
+    return {};
+
+  const OGRSpatialReference* sr = theLayer->GetSpatialRef();
+  if (!sr)
+    throw Fmi::Exception(BCP, "Layer has no spatial reference, cannot reproject it")
+        .addParameter("Layer", theLayer->GetName());
+
+  Fmi::SpatialReference source(*sr);
+  return std::make_unique<Fmi::CoordinateTransformation>(source, *theSR);
+}
+
+OGRGeometryPtr transform(OGRGeometry* theGeometry,
+                         const Fmi::CoordinateTransformation* theTransformation)
+{
+  if (!theTransformation)
+    return OGRGeometryPtr(theGeometry);
+
+  std::unique_ptr<OGRGeometry> geom(theGeometry);
+  return OGRGeometryPtr(theTransformation->transformGeometry(*geom));
+}
+
+// Time from a date or datetime field in UTC
+std::optional<Fmi::DateTime> read_time(OGRFeature& theFeature, int theIndex)
+{
+  if (!theFeature.IsFieldSetAndNotNull(theIndex))
+    return {};
+
+  int year = 0;
+  int month = 0;
+  int day = 0;
+  int hour = 0;
+  int minute = 0;
+  int tz = 0;
+  float second = 0;
+  if (!theFeature.GetFieldAsDateTime(
+          theIndex, &year, &month, &day, &hour, &minute, &second, &tz))
+    return {};
+
+  auto t = Fmi::DateTime(Fmi::Date(year, month, day)) +
+           Fmi::Seconds(3600 * hour + 60 * minute + static_cast<int>(second));
+
+  // 0 = unknown, 1 = local time, 100 = UTC, others are offsets from UTC in 15 minute units
+  if (tz > 1 && tz != 100)
+    t -= Fmi::Seconds((tz - 100) * 15 * 60);
+
+  return t;
+}
+
+Fmi::Attribute read_attribute(OGRFeature& theFeature, int theIndex)
+{
+  if (!theFeature.IsFieldSetAndNotNull(theIndex))
+    return std::string();
+
+  switch (theFeature.GetFieldDefnRef(theIndex)->GetType())
+  {
+    case OFTInteger:
+      return theFeature.GetFieldAsInteger(theIndex);
+    case OFTInteger64:
+    {
+      auto value = theFeature.GetFieldAsInteger64(theIndex);
+      if (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max())
+        return static_cast<int>(value);
+      return static_cast<double>(value);
+    }
+    case OFTReal:
+      return theFeature.GetFieldAsDouble(theIndex);
+    case OFTDate:
+    case OFTDateTime:
+    {
+      auto t = read_time(theFeature, theIndex);
+      if (t)
+        return *t;
+      return std::string();
+    }
+    default:
+      return std::string(theFeature.GetFieldAsString(theIndex));
+  }
+}
+
+// The multi-geometry type for the combined geometries of a layer
+enum class Kind
+{
+  None,
+  Polygons,
+  Lines,
+  Points,
+  Mixed
+};
+
+Kind kind(const OGRGeometry& theGeometry)
+{
+  switch (wkbFlatten(theGeometry.getGeometryType()))
+  {
+    case wkbPolygon:
+    case wkbMultiPolygon:
+      return Kind::Polygons;
+    case wkbLineString:
+    case wkbMultiLineString:
+      return Kind::Lines;
+    case wkbPoint:
+    case wkbMultiPoint:
+      return Kind::Points;
+    default:
+      return Kind::Mixed;
+  }
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Open a file for reading
+ *
+ * The drivers use the spatial indexes of the files (GeoPackage R-tree,
+ * FlatGeobuf packed R-tree, Shapefile .qix) automatically.
+ */
+// ----------------------------------------------------------------------
+
+GDALDataPtr open(const std::string& thePath)
+{
+  try
+  {
+    auto* dataset = static_cast<GDALDataset*>(GDALOpenEx(
+        thePath.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, nullptr, nullptr, nullptr));
+    if (!dataset)
+      throw Fmi::Exception(BCP, "Failed to open data source").addParameter("Path", thePath);
+    return {dataset, [](GDALDataset* p) { GDALClose(p); }};
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Read all the geometries of a layer as a single geometry
+ *
+ * Homogeneous layers produce a multipolygon, multilinestring or
+ * multipoint, other layers a geometry collection.
+ */
+// ----------------------------------------------------------------------
+
+OGRGeometryPtr read(const Fmi::SpatialReference* theSR,
+                    const GDALDataPtr& theDataset,
+                    const std::string& theSchema,
+                    const std::string& theTable,
+                    const std::optional<std::string>& theWhereClause)
+{
+  try
+  {
+    LayerReader layer(theDataset, theSchema, theTable, theWhereClause);
+
+    // Attributes are not needed unless the filter refers to them
+    std::vector<const char*> ignored;
+    const auto* defn = layer->GetLayerDefn();
+    if (!theWhereClause)
+    {
+      for (int i = 0; i < defn->GetFieldCount(); i++)
+        ignored.push_back(defn->GetFieldDefn(i)->GetNameRef());
+      ignored.push_back(nullptr);
+      layer->SetIgnoredFields(ignored.data());
+    }
+
+    std::vector<std::unique_ptr<OGRGeometry>> geometries;
+    Kind result_kind = Kind::None;
+
+    while (true)
+    {
+      SafeFeature feature(layer->GetNextFeature(), featuredeleter);
+      if (!feature)
+        break;
+
+      std::unique_ptr<OGRGeometry> geom(feature->StealGeometry());
+      if (!geom || geom->IsEmpty())
+        continue;
+
+      auto k = kind(*geom);
+      if (result_kind == Kind::None)
+        result_kind = k;
+      else if (result_kind != k)
+        result_kind = Kind::Mixed;
+
+      geometries.push_back(std::move(geom));
+    }
+
+    if (geometries.empty())
+      return {};
+
+    std::unique_ptr<OGRGeometryCollection> result;
+    switch (result_kind)
+    {
+      case Kind::Polygons:
+        result = std::make_unique<OGRMultiPolygon>();
+        break;
+      case Kind::Lines:
+        result = std::make_unique<OGRMultiLineString>();
+        break;
+      case Kind::Points:
+        result = std::make_unique<OGRMultiPoint>();
+        break;
+      default:
+        result = std::make_unique<OGRGeometryCollection>();
+        break;
+    }
+
+    for (auto& geom : geometries)
+    {
+      auto* collection = dynamic_cast<OGRGeometryCollection*>(geom.get());
+      if (collection && result_kind != Kind::Mixed)
+      {
+        // Move the parts of multigeometries
+        while (!collection->IsEmpty())
+        {
+          result->addGeometryDirectly(collection->getGeometryRef(0));
+          collection->removeGeometry(0, FALSE);
+        }
+      }
+      else
+        result->addGeometryDirectly(geom.release());
+    }
+
+    result->assignSpatialReference(layer->GetSpatialRef());
+
+    auto transformation = make_transformation(layer.get(), theSR);
+    return transform(result.release(), transformation.get());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("Layer", theTable);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Read the geometries of a layer with the given attributes
+ */
+// ----------------------------------------------------------------------
+
+Fmi::Features read(const Fmi::SpatialReference* theSR,
+                   const GDALDataPtr& theDataset,
+                   const std::string& theSchema,
+                   const std::string& theTable,
+                   const std::set<std::string>& theFieldNames,
+                   const std::optional<std::string>& theWhereClause)
+{
+  try
+  {
+    LayerReader layer(theDataset, theSchema, theTable, theWhereClause);
+
+    const auto* defn = layer->GetLayerDefn();
+
+    std::vector<std::pair<std::string, int>> fields;
+    for (const auto& name : theFieldNames)
+    {
+      int index = defn->GetFieldIndex(name.c_str());
+      if (index < 0)
+        throw Fmi::Exception(BCP, "Field not found from layer").addParameter("Field", name);
+      fields.emplace_back(name, index);
+    }
+
+    // Other attributes are not needed unless the filter refers to them
+    std::vector<const char*> ignored;
+    if (!theWhereClause)
+    {
+      for (int i = 0; i < defn->GetFieldCount(); i++)
+        if (theFieldNames.find(defn->GetFieldDefn(i)->GetNameRef()) == theFieldNames.end())
+          ignored.push_back(defn->GetFieldDefn(i)->GetNameRef());
+      ignored.push_back(nullptr);
+      layer->SetIgnoredFields(ignored.data());
+    }
+
+    auto transformation = make_transformation(layer.get(), theSR);
+
+    Fmi::Features ret;
+
+    while (true)
+    {
+      SafeFeature feature(layer->GetNextFeature(), featuredeleter);
+      if (!feature)
+        break;
+
+      auto ret_feature = std::make_shared<Fmi::Feature>();
+
+      OGRGeometry* geom = feature->StealGeometry();
+      if (geom)
+        ret_feature->geom = transform(geom, transformation.get());
+
+      for (const auto& field : fields)
+        ret_feature->attributes[field.first] = read_attribute(*feature, field.second);
+
+      ret.push_back(ret_feature);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("Layer", theTable);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Read the times and the WGS84 extent of a layer
+ *
+ * The extent is the layer extent, which the drivers usually store in
+ * the file header. Hence the estimated, exact and latest extent modes
+ * all use the same full extent, only a fixed extent is different.
+ */
+// ----------------------------------------------------------------------
+
+MetaData read_metadata(const Config& theConfig,
+                       const GDALDataPtr& theDataset,
+                       const MetaDataQueryOptions& theOptions)
+{
+  try
+  {
+    MetaData metadata;
+
+    LayerReader layer(theDataset, theOptions.schema, theOptions.table, {});
+
+    if (theOptions.time_column)
+    {
+      const auto* defn = layer->GetLayerDefn();
+      int index = defn->GetFieldIndex(theOptions.time_column->c_str());
+      if (index < 0)
+        throw Fmi::Exception(BCP, "Time column not found from layer")
+            .addParameter("Column", *theOptions.time_column);
+
+      // Read only the times
+      std::vector<const char*> ignored;
+      for (int i = 0; i < defn->GetFieldCount(); i++)
+        if (i != index)
+          ignored.push_back(defn->GetFieldDefn(i)->GetNameRef());
+      ignored.push_back("OGR_GEOMETRY");
+      ignored.push_back(nullptr);
+      layer->SetIgnoredFields(ignored.data());
+
+      std::set<std::int64_t> times;
+      while (true)
+      {
+        SafeFeature feature(layer->GetNextFeature(), featuredeleter);
+        if (!feature)
+          break;
+        auto t = read_time(*feature, index);
+        if (!t)
+          continue;
+        if ((theOptions.starttime && *t < *theOptions.starttime) ||
+            (theOptions.endtime && *t > *theOptions.endtime))
+          continue;
+        times.insert(TimeSteps::to_seconds(*t));
+      }
+
+      auto timestep = theConfig.getTableTimeStep(theOptions.schema, theOptions.table);
+      if (!timestep)
+      {
+        for (auto t : times)
+          metadata.timesteps.push_back(TimeSteps::from_seconds(t));
+      }
+      else if (!times.empty())
+      {
+        metadata.timeinterval = TimeInterval{TimeSteps::from_seconds(*times.begin()),
+                                             TimeSteps::from_seconds(*times.rbegin()),
+                                             *timestep};
+      }
+      else
+      {
+        std::cout << "Reading values from '" << theOptions.table << "."
+                  << *theOptions.time_column << "' failed!\n";
+      }
+    }
+
+    OGREnvelope envelope;
+    auto extent_mode = theConfig.getTableExtentMode(theOptions.schema, theOptions.table);
+    if (extent_mode == ExtentMode::Fixed)
+    {
+      auto fixed_bbox = theConfig.getTableBBox(theOptions.schema, theOptions.table);
+      envelope.MinX = fixed_bbox->west;
+      envelope.MinY = fixed_bbox->south;
+      envelope.MaxX = fixed_bbox->east;
+      envelope.MaxY = fixed_bbox->north;
+    }
+    else if (layer->GetExtent(&envelope, TRUE) != OGRERR_NONE)
+      return metadata;  // empty layer
+
+    std::optional<Fmi::SpatialReference> source;
+    if (const auto* sr = layer->GetSpatialRef())
+      source.emplace(*sr);
+    else
+    {
+      auto default_epsg = theConfig.getDefaultEPSG();
+      if (!default_epsg)
+        throw Fmi::Exception(BCP, "Layer has no spatial reference");
+      if (!theConfig.quiet())
+        std::cerr << "Warning: " << theOptions.table
+                  << " has no spatial reference. Setting EPSG to default value " << *default_epsg
+                  << '\n';
+      source.emplace(*default_epsg);
+    }
+
+    Fmi::SpatialReference target("WGS84");
+    Fmi::CoordinateTransformation transformation(*source, target);
+
+    bool ok = (transformation.transform(envelope.MinX, envelope.MinY) &&
+               transformation.transform(envelope.MaxX, envelope.MaxY));
+    if (ok)
+    {
+      metadata.xmin = envelope.MinX;
+      metadata.ymin = envelope.MinY;
+      metadata.xmax = envelope.MaxX;
+      metadata.ymax = envelope.MaxY;
+    }
+
+    return metadata;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("Layer", theOptions.table);
+  }
+}
+
+}  // namespace FileSource
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,54 @@
+// ======================================================================
+/*!
+ * \brief Readers for layers in local files
+ *
+ * GeoPackage, FlatGeobuf, Shapefile and other vector formats supported
+ * by GDAL can be configured as data sources instead of PostGIS. The
+ * readers return the same results as the respective PostGIS readers.
+ * The table name of a query is the layer name, the schema is used
+ * only if there is a layer named "schema.table".
+ */
+// ======================================================================
+
+#pragma once
+
+#include "MetaData.h"
+#include <gis/SpatialReference.h>
+#include <gis/Types.h>
+#include <optional>
+#include <set>
+#include <string>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class Config;
+
+namespace FileSource
+{
+GDALDataPtr open(const std::string& thePath);
+
+OGRGeometryPtr read(const Fmi::SpatialReference* theSR,
+                    const GDALDataPtr& theDataset,
+                    const std::string& theSchema,
+                    const std::string& theTable,
+                    const std::optional<std::string>& theWhereClause);
+
+Fmi::Features read(const Fmi::SpatialReference* theSR,
+                   const GDALDataPtr& theDataset,
+                   const std::string& theSchema,
+                   const std::string& theTable,
+                   const std::set<std::string>& theFieldNames,
+                   const std::optional<std::string>& theWhereClause);
+
+MetaData read_metadata(const Config& theConfig,
+                       const GDALDataPtr& theDataset,
+                       const MetaDataQueryOptions& theOptions);
+
+}  // namespace FileSource
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,842 @@
+#include "FlatGeometry.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <ogr_geometry.h>
+#include <ogr_spatialref.h>
+#include <type_traits>
+#include <variant>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+// Flag added to the type of 3D geometries in the node stream, 0 marks an empty slot
+const std::uint32_t z_flag = 0x10000;
+
+// Node type of geometries stored as WKB, the count is the index of the WKB
+const std::uint32_t wkb_node = 0x20000;
+
+// Nesting limit of the collections, the same as in the WKB import of OGR
+const std::size_t max_depth = 32;
+
+const std::uint32_t null_feature = std::numeric_limits<std::uint32_t>::max();
+
+std::vector<OGRGeometryPtr> feature_geometries(const Fmi::Features& theFeatures)
+{
+  std::vector<OGRGeometryPtr> ret;
+  ret.reserve(theFeatures.size());
+  for (const auto& feature : theFeatures)
+    ret.push_back(feature ? feature->geom : OGRGeometryPtr());
+  return ret;
+}
+
+// Set the points of a linestring or a ring
+void set_points(OGRSimpleCurve& theCurve, const FlatGeometry::Part& thePart, bool is3D)
+{
+  theCurve.setPoints(static_cast<int>(thePart.points),
+                     reinterpret_cast<const OGRRawPoint*>(thePart.xy),
+                     is3D ? thePart.z : nullptr);
+}
+
+// True for the types stored in the node stream
+bool is_native(OGRwkbGeometryType theType)
+{
+  switch (theType)
+  {
+    case wkbPoint:
+    case wkbLineString:
+    case wkbPolygon:
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+std::size_t vector_bytes(const std::vector<T>& theVector)
+{
+  return theVector.capacity() * sizeof(T);
+}
+
+// Append the size and the contents of a vector
+template <typename T>
+void write_vector(std::string& theOutput, const std::vector<T>& theVector)
+{
+  const std::uint64_t n = theVector.size();
+  theOutput.append(reinterpret_cast<const char*>(&n), sizeof(n));
+  theOutput.append(reinterpret_cast<const char*>(theVector.data()), n * sizeof(T));
+}
+
+// Point a span to the contents of a vector written by write_vector
+template <typename Span>
+void read_span(const char* theData, std::size_t theSize, std::size_t& thePos, Span& theSpan)
+{
+  using T = std::remove_const_t<std::remove_pointer_t<decltype(theSpan.data)>>;
+
+  std::uint64_t n = 0;
+  if (theSize - thePos < sizeof(n))
+    throw Fmi::Exception(BCP, "Truncated flat geometry");
+  std::memcpy(&n, theData + thePos, sizeof(n));
+  thePos += sizeof(n);
+
+  if (n > (theSize - thePos) / sizeof(T))
+    throw Fmi::Exception(BCP, "Truncated flat geometry");
+  if (n > 0 && reinterpret_cast<std::uintptr_t>(theData + thePos) % alignof(T) != 0)
+    throw Fmi::Exception(BCP, "Misaligned flat geometry");
+
+  theSpan.data = reinterpret_cast<const T*>(theData + thePos);
+  theSpan.size = n;
+  thePos += n * sizeof(T);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Collects the buffers of flattened geometries
+ */
+// ----------------------------------------------------------------------
+
+class Builder
+{
+ public:
+  void add(const OGRGeometry* theGeometry);
+  std::string serialise() const;
+
+  // Spatial references in use, not referenced by the builder
+  std::vector<OGRSpatialReference*> spatialReferences;
+
+ private:
+  void addGeometry(const OGRGeometry& theGeometry);
+  void addPoints(const OGRSimpleCurve& theCurve);
+  void addWKB(const OGRGeometry& theGeometry);
+  std::size_t numPoints() const { return itsXY.size() / 2; }
+
+  bool itsHasZ = false;
+  std::vector<double> itsXY;
+  std::vector<double> itsZ;
+  std::vector<std::uint32_t> itsPartOffsets{0};
+  std::vector<std::uint32_t> itsNodes;
+  std::vector<std::uint32_t> itsRootNodes{0};
+  std::vector<std::uint32_t> itsRootParts{0};
+  std::vector<std::int32_t> itsRootSpatialReference;
+  std::vector<std::uint32_t> itsWKBOffsets{0};
+  std::vector<unsigned char> itsWKB;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append a geometry or an empty slot
+ *
+ * Consecutive geometries usually share the same spatial reference
+ * object, other duplicates are not searched for.
+ */
+// ----------------------------------------------------------------------
+
+void Builder::add(const OGRGeometry* theGeometry)
+{
+  if (!theGeometry)
+  {
+    itsNodes.push_back(0);
+    itsNodes.push_back(0);
+    itsRootSpatialReference.push_back(-1);
+  }
+  else
+  {
+    addGeometry(*theGeometry);
+
+    const auto* sr = theGeometry->getSpatialReference();
+    if (!sr)
+      itsRootSpatialReference.push_back(-1);
+    else
+    {
+      // OGR itself casts away the constness when sharing a spatial reference
+      if (spatialReferences.empty() || spatialReferences.back() != sr)
+        spatialReferences.push_back(const_cast<OGRSpatialReference*>(sr));
+      itsRootSpatialReference.push_back(static_cast<std::int32_t>(spatialReferences.size() - 1));
+    }
+  }
+
+  itsRootNodes.push_back(itsNodes.size());
+  itsRootParts.push_back(itsPartOffsets.size() - 1);
+}
+
+void Builder::addGeometry(const OGRGeometry& theGeometry)
+{
+  try
+  {
+    const auto type = wkbFlatten(theGeometry.getGeometryType());
+
+    if (theGeometry.IsMeasured() || !is_native(type))
+    {
+      addWKB(theGeometry);
+      return;
+    }
+
+    if (theGeometry.Is3D() && !itsHasZ)
+    {
+      itsHasZ = true;
+      itsZ.resize(numPoints(), 0.0);
+    }
+    const std::uint32_t flags = (theGeometry.Is3D() ? z_flag : 0);
+
+    switch (type)
+    {
+      case wkbPoint:
+      {
+        const auto& point = static_cast<const OGRPoint&>(theGeometry);
+        itsNodes.push_back(type | flags);
+        itsNodes.push_back(1);
+        if (!point.IsEmpty())
+        {
+          itsXY.push_back(point.getX());
+          itsXY.push_back(point.getY());
+          if (itsHasZ)
+            itsZ.push_back(point.getZ());
+        }
+        itsPartOffsets.push_back(numPoints());
+        break;
+      }
+      case wkbLineString:
+      {
+        itsNodes.push_back(type | flags);
+        itsNodes.push_back(1);
+        addPoints(static_cast<const OGRSimpleCurve&>(theGeometry));
+        break;
+      }
+      case wkbPolygon:
+      {
+        const auto& polygon = static_cast<const OGRPolygon&>(theGeometry);
+        itsNodes.push_back(wkbPolygon | flags);
+        if (polygon.IsEmpty())
+        {
+          itsNodes.push_back(0);
+          break;
+        }
+        itsNodes.push_back(polygon.getNumInteriorRings() + 1);
+        addPoints(*polygon.getExteriorRing());
+        for (int i = 0; i < polygon.getNumInteriorRings(); i++)
+          addPoints(*polygon.getInteriorRing(i));
+        break;
+      }
+      case wkbMultiPoint:
+      case wkbMultiLineString:
+      case wkbMultiPolygon:
+      case wkbGeometryCollection:
+      {
+        const auto& collection = static_cast<const OGRGeometryCollection&>(theGeometry);
+        itsNodes.push_back(type | flags);
+        itsNodes.push_back(collection.getNumGeometries());
+        for (int i = 0; i < collection.getNumGeometries(); i++)
+          addGeometry(*collection.getGeometryRef(i));
+        break;
+      }
+      default:
+        throw Fmi::Exception(BCP, "Unsupported geometry type")
+            .addParameter("Type", OGRGeometryTypeToName(theGeometry.getGeometryType()));
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Append the points of a linestring or a ring as a new part
+void Builder::addPoints(const OGRSimpleCurve& theCurve)
+{
+  const auto n = static_cast<std::size_t>(theCurve.getNumPoints());
+  const auto offset = numPoints();
+
+  itsXY.resize(2 * (offset + n));
+  if (itsHasZ)
+    itsZ.resize(offset + n, 0.0);
+
+  if (n > 0)
+  {
+    const int stride = 2 * sizeof(double);
+    theCurve.getPoints(&itsXY[2 * offset],
+                       stride,
+                       &itsXY[2 * offset + 1],
+                       stride,
+                       (itsHasZ && theCurve.Is3D()) ? &itsZ[offset] : nullptr,
+                       sizeof(double));
+  }
+  itsPartOffsets.push_back(numPoints());
+}
+
+// Append a geometry without a native encoding as WKB
+void Builder::addWKB(const OGRGeometry& theGeometry)
+{
+  const auto offset = itsWKB.size();
+  itsWKB.resize(offset + static_cast<std::size_t>(theGeometry.WkbSize()));
+  if (theGeometry.exportToWkb(wkbNDR, itsWKB.data() + offset, wkbVariantIso) != OGRERR_NONE)
+    throw Fmi::Exception(BCP, "Failed to export a geometry as WKB")
+        .addParameter("Type", OGRGeometryTypeToName(theGeometry.getGeometryType()));
+
+  itsNodes.push_back(wkb_node);
+  itsNodes.push_back(itsWKBOffsets.size() - 1);
+  itsWKBOffsets.push_back(itsWKB.size());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Serialise the buffers into a single block
+ *
+ * The flags are stored in a full word and the coordinates first so that
+ * all the buffers are aligned to their element size.
+ */
+// ----------------------------------------------------------------------
+
+std::string Builder::serialise() const
+{
+  std::string ret;
+  ret.reserve(sizeof(std::uint64_t) * 8 + vector_bytes(itsXY) + vector_bytes(itsZ) +
+              vector_bytes(itsPartOffsets) + vector_bytes(itsNodes) +
+              vector_bytes(itsRootNodes) + vector_bytes(itsRootParts) +
+              vector_bytes(itsRootSpatialReference) + vector_bytes(itsWKBOffsets) +
+              vector_bytes(itsWKB));
+
+  const std::uint64_t flags = (itsHasZ ? 1 : 0);
+  ret.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+  write_vector(ret, itsXY);
+  write_vector(ret, itsZ);
+  write_vector(ret, itsPartOffsets);
+  write_vector(ret, itsNodes);
+  write_vector(ret, itsRootNodes);
+  write_vector(ret, itsRootParts);
+  write_vector(ret, itsRootSpatialReference);
+  write_vector(ret, itsWKBOffsets);
+  write_vector(ret, itsWKB);
+  return ret;
+}
+
+}  // namespace
+
+FlatGeometry::FlatGeometry(const OGRGeometryPtr& theGeometry)
+    : FlatGeometry(std::vector<OGRGeometryPtr>{theGeometry})
+{
+}
+
+FlatGeometry::FlatGeometry(const std::vector<OGRGeometryPtr>& theGeometries)
+{
+  try
+  {
+    Builder builder;
+    for (const auto& geom : theGeometries)
+      builder.add(geom.get());
+
+    const auto data = builder.serialise();
+    itsBuffer.resize((data.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+    std::memcpy(itsBuffer.data(), data.data(), data.size());
+    bind(reinterpret_cast<const char*>(itsBuffer.data()), data.size());
+
+    for (auto* sr : builder.spatialReferences)
+    {
+      sr->Reference();
+      itsSpatialReferences.push_back(sr);
+    }
+
+    // The originals are handed out as long as they are in use
+    itsGeometries.assign(theGeometries.begin(), theGeometries.end());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+FlatGeometry::FlatGeometry(const Packed& thePacked)
+{
+  try
+  {
+    const auto& data = thePacked.data;
+    itsBuffer.resize((data.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+    std::memcpy(itsBuffer.data(), data.data(), data.size());
+    bind(reinterpret_cast<const char*>(itsBuffer.data()), data.size());
+    reference(thePacked.spatialReferences);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+FlatGeometry::FlatGeometry(
+    const char* theData,
+    std::size_t theSize,
+    const std::vector<std::shared_ptr<OGRSpatialReference>>& theSpatialReferences,
+    std::shared_ptr<const void> theStorage)
+    : itsStorage(std::move(theStorage))
+{
+  try
+  {
+    bind(theData, theSize);
+    reference(theSpatialReferences);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+FlatGeometry::~FlatGeometry()
+{
+  for (auto* sr : itsSpatialReferences)
+    sr->Release();
+}
+
+// Point the spans to the serialised buffers
+void FlatGeometry::bind(const char* theData, std::size_t theSize)
+{
+  std::uint64_t flags = 0;
+  if (theSize < sizeof(flags))
+    throw Fmi::Exception(BCP, "Truncated flat geometry");
+  std::memcpy(&flags, theData, sizeof(flags));
+
+  itsData = theData;
+  itsDataSize = theSize;
+  itsHasZ = (flags != 0);
+
+  std::size_t pos = sizeof(flags);
+  read_span(theData, theSize, pos, itsXY);
+  read_span(theData, theSize, pos, itsZ);
+  read_span(theData, theSize, pos, itsPartOffsets);
+  read_span(theData, theSize, pos, itsNodes);
+  read_span(theData, theSize, pos, itsRootNodes);
+  read_span(theData, theSize, pos, itsRootParts);
+  read_span(theData, theSize, pos, itsRootSpatialReference);
+  read_span(theData, theSize, pos, itsWKBOffsets);
+  read_span(theData, theSize, pos, itsWKB);
+
+  if (itsRootNodes.size == 0 || itsRootParts.size != itsRootNodes.size ||
+      itsRootSpatialReference.size != size() || itsPartOffsets.size == 0 ||
+      itsWKBOffsets.size == 0 || itsXY.size % 2 != 0 || (itsHasZ && itsZ.size != numPoints()))
+    throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+  // Shared buffers come from other processes, hence all offsets used by
+  // build() and part() are checked once here instead of on every access.
+  if (!std::is_sorted(itsPartOffsets.data, itsPartOffsets.data + itsPartOffsets.size) ||
+      itsPartOffsets[0] != 0 || itsPartOffsets[numParts()] != numPoints() ||
+      !std::is_sorted(itsWKBOffsets.data, itsWKBOffsets.data + itsWKBOffsets.size) ||
+      itsWKBOffsets[0] != 0 || itsWKBOffsets[itsWKBOffsets.size - 1] != itsWKB.size ||
+      itsRootNodes[0] != 0 || itsRootNodes[size()] != itsNodes.size || itsRootParts[0] != 0 ||
+      itsRootParts[size()] != numParts())
+    throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+  for (std::size_t i = 0; i < size(); i++)
+  {
+    std::size_t node = itsRootNodes[i];
+    std::size_t first = itsRootParts[i];
+    if (node >= itsNodes.size)
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+    if (itsNodes[node] == 0)
+      node += 2;
+    else
+      validate(node, first, 0);
+
+    if (node != itsRootNodes[i + 1] || first != itsRootParts[i + 1])
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+  }
+
+  itsGeometries.resize(size());
+  itsKeptGeometries.resize(size());
+  itsRequested.resize(size());
+}
+
+// Check the nodes of a geometry like build() would use them, advancing past them
+void FlatGeometry::validate(std::size_t& theNode, std::size_t& thePart, std::size_t theDepth) const
+{
+  if (theDepth > max_depth || itsNodes.size - theNode < 2)
+    throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+  const auto code = itsNodes[theNode++];
+  const auto count = itsNodes[theNode++];
+
+  if (code == wkb_node)
+  {
+    if (count >= itsWKBOffsets.size - 1)
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+    return;
+  }
+
+  if ((code & z_flag) != 0 && !itsHasZ)
+    throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+  const auto type = static_cast<OGRwkbGeometryType>(code & ~z_flag);
+  switch (type)
+  {
+    case wkbPoint:
+      if (count != 1 || thePart >= numParts() || part(thePart++).points > 1)
+        throw Fmi::Exception(BCP, "Corrupted flat geometry");
+      return;
+    case wkbLineString:
+      if (count != 1 || thePart >= numParts())
+        throw Fmi::Exception(BCP, "Corrupted flat geometry");
+      thePart++;
+      return;
+    case wkbPolygon:
+      if (count > numParts() - thePart)
+        throw Fmi::Exception(BCP, "Corrupted flat geometry");
+      thePart += count;
+      return;
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+      for (std::uint32_t i = 0; i < count; i++)
+      {
+        // The members of a multi geometry must be of its single type
+        const auto single = static_cast<std::uint32_t>(OGR_GT_GetSingle(type));
+        if (type != wkbGeometryCollection &&
+            (theNode >= itsNodes.size || (itsNodes[theNode] & ~z_flag) != single))
+          throw Fmi::Exception(BCP, "Corrupted flat geometry");
+        validate(theNode, thePart, theDepth + 1);
+      }
+      return;
+    default:
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+  }
+}
+
+// Reference the spatial references of packed buffers
+void FlatGeometry::reference(
+    const std::vector<std::shared_ptr<OGRSpatialReference>>& theSpatialReferences)
+{
+  for (const auto& sr : theSpatialReferences)
+    if (!sr)
+      throw Fmi::Exception(BCP, "Missing spatial reference for a flat geometry");
+
+  for (std::size_t i = 0; i < itsRootSpatialReference.size; i++)
+    if (itsRootSpatialReference[i] >= static_cast<std::int32_t>(theSpatialReferences.size()))
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+
+  for (const auto& sr : theSpatialReferences)
+  {
+    sr->Reference();
+    itsSpatialReferences.push_back(sr.get());
+  }
+}
+
+FlatGeometry::Part FlatGeometry::part(std::size_t thePart) const
+{
+  const auto first = itsPartOffsets[thePart];
+  return Part{itsXY.data + 2 * first,
+              itsHasZ ? itsZ.data + first : nullptr,
+              itsPartOffsets[thePart + 1] - first};
+}
+
+const OGRSpatialReference* FlatGeometry::spatialReference(std::size_t theIndex) const
+{
+  const auto index = itsRootSpatialReference[theIndex];
+  return (index < 0 ? nullptr : itsSpatialReferences[index]);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the OGR geometry starting at the given node and part
+ */
+// ----------------------------------------------------------------------
+
+OGRGeometry* FlatGeometry::build(std::size_t& theNode, std::size_t& thePart) const
+{
+  const auto code = itsNodes[theNode++];
+  const auto count = itsNodes[theNode++];
+
+  if (code == wkb_node)
+  {
+    const auto first = itsWKBOffsets[count];
+    OGRGeometry* geom = nullptr;
+    if (OGRGeometryFactory::createFromWkb(itsWKB.data + first,
+                                          nullptr,
+                                          &geom,
+                                          itsWKBOffsets[count + 1] - first,
+                                          wkbVariantIso) != OGRERR_NONE)
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+    return geom;
+  }
+
+  const bool is3D = ((code & z_flag) != 0);
+  const auto type = static_cast<OGRwkbGeometryType>(code & ~z_flag);
+
+  switch (type)
+  {
+    case wkbPoint:
+    {
+      const auto p = part(thePart++);
+      auto* point = new OGRPoint;
+      if (p.points > 0)
+      {
+        point->setX(p.xy[0]);
+        point->setY(p.xy[1]);
+        if (is3D)
+          point->setZ(p.z[0]);
+      }
+      if (is3D)
+        point->set3D(TRUE);
+      return point;
+    }
+    case wkbLineString:
+    {
+      auto* line = new OGRLineString;
+      set_points(*line, part(thePart++), is3D);
+      return line;
+    }
+    case wkbPolygon:
+    {
+      auto* polygon = new OGRPolygon;
+      for (std::uint32_t i = 0; i < count; i++)
+      {
+        auto* ring = new OGRLinearRing;
+        set_points(*ring, part(thePart++), is3D);
+        polygon->addRingDirectly(ring);
+      }
+      if (is3D)
+        polygon->set3D(TRUE);
+      return polygon;
+    }
+    case wkbMultiPoint:
+    case wkbMultiLineString:
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+    {
+      auto* collection =
+          static_cast<OGRGeometryCollection*>(OGRGeometryFactory::createGeometry(type));
+      for (std::uint32_t i = 0; i < count; i++)
+        collection->addGeometryDirectly(build(theNode, thePart));
+      if (is3D)
+        collection->set3D(TRUE);
+      return collection;
+    }
+    default:
+      throw Fmi::Exception(BCP, "Corrupted flat geometry");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the geometry, building it only if it is not in use
+ *
+ * A geometry requested a second time is kept for as long as this
+ * object lives, since it is likely to be requested again.
+ */
+// ----------------------------------------------------------------------
+
+OGRGeometryPtr FlatGeometry::geometry(std::size_t theIndex) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto& kept = itsKeptGeometries[theIndex];
+    if (kept)
+      return kept;
+
+    auto geom = itsGeometries[theIndex].lock();
+    if (!geom)
+    {
+      std::size_t node = itsRootNodes[theIndex];
+      std::size_t part = itsRootParts[theIndex];
+      if (itsNodes[node] == 0)
+        return {};
+
+      geom.reset(build(node, part));
+
+      const auto* sr = spatialReference(theIndex);
+      if (sr)
+        geom->assignSpatialReference(sr);
+      itsGeometries[theIndex] = geom;
+    }
+
+    if (itsRequested[theIndex])
+      kept = geom;
+    itsRequested[theIndex] = true;
+    return geom;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t FlatGeometry::bytes() const
+{
+  return sizeof(*this) + vector_bytes(itsBuffer) + vector_bytes(itsSpatialReferences) +
+         vector_bytes(itsGeometries) + vector_bytes(itsKeptGeometries) + itsRequested.size() / 8;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Copy the serialised buffers
+ *
+ * The spatial references are not serialised, the packed copy keeps
+ * references to the same objects instead.
+ */
+// ----------------------------------------------------------------------
+
+FlatGeometry::Packed FlatGeometry::pack() const
+{
+  try
+  {
+    Packed ret;
+    ret.data.assign(itsData, itsDataSize);
+    for (auto* sr : itsSpatialReferences)
+    {
+      sr->Reference();
+      ret.spatialReferences.emplace_back(sr, [](OGRSpatialReference* p) { p->Release(); });
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Flatten features
+ *
+ * The attribute values are stored in one vector in the order of the
+ * attribute names, and each distinct set of names is stored once.
+ */
+// ----------------------------------------------------------------------
+
+FlatFeatures::FlatFeatures(const Fmi::Features& theFeatures)
+    : itsGeometries(feature_geometries(theFeatures))
+{
+  try
+  {
+    itsLayouts.reserve(theFeatures.size());
+    itsValueOffsets.reserve(theFeatures.size() + 1);
+    itsValueOffsets.push_back(0);
+
+    std::map<std::vector<std::string>, std::uint32_t> layouts;
+    std::vector<std::string> names;
+
+    for (const auto& feature : theFeatures)
+    {
+      if (!feature)
+        itsLayouts.push_back(null_feature);
+      else
+      {
+        names.clear();
+        for (const auto& attribute : feature->attributes)
+        {
+          names.push_back(attribute.first);
+          itsValues.push_back(attribute.second);
+        }
+
+        auto pos = layouts.find(names);
+        if (pos == layouts.end())
+        {
+          pos = layouts.insert(std::make_pair(names, itsNames.size())).first;
+          itsNames.push_back(names);
+        }
+        itsLayouts.push_back(pos->second);
+      }
+      itsValueOffsets.push_back(itsValues.size());
+    }
+
+    itsValues.shrink_to_fit();
+    itsFeatures.assign(theFeatures.begin(), theFeatures.end());
+    itsKeptFeatures.resize(theFeatures.size());
+    itsRequested.resize(theFeatures.size());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Build a feature unless it is still in use, the mutex must be locked. Like
+// geometries, features requested a second time are kept.
+Fmi::FeaturePtr FlatFeatures::materialise(std::size_t theIndex) const
+{
+  auto& kept = itsKeptFeatures[theIndex];
+  if (kept || itsLayouts[theIndex] == null_feature)
+    return kept;
+
+  auto feature = itsFeatures[theIndex].lock();
+  if (!feature)
+  {
+    feature = std::make_shared<Fmi::Feature>();
+    feature->geom = itsGeometries.geometry(theIndex);
+
+    const auto& names = itsNames[itsLayouts[theIndex]];
+    const auto offset = itsValueOffsets[theIndex];
+    for (std::size_t i = 0; i < names.size(); i++)
+      feature->attributes.emplace_hint(
+          feature->attributes.end(), names[i], itsValues[offset + i]);
+    itsFeatures[theIndex] = feature;
+  }
+
+  if (itsRequested[theIndex])
+    kept = feature;
+  itsRequested[theIndex] = true;
+  return feature;
+}
+
+Fmi::FeaturePtr FlatFeatures::feature(std::size_t theIndex) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    return materialise(theIndex);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Fmi::Features FlatFeatures::features() const
+{
+  try
+  {
+    Fmi::Features ret;
+    ret.reserve(size());
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    for (std::size_t i = 0; i < size(); i++)
+      ret.push_back(materialise(i));
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t FlatFeatures::bytes() const
+{
+  std::size_t n = sizeof(*this) - sizeof(itsGeometries) + itsGeometries.bytes() +
+                  vector_bytes(itsNames) + vector_bytes(itsLayouts) +
+                  vector_bytes(itsValueOffsets) + vector_bytes(itsValues) +
+                  vector_bytes(itsFeatures) + vector_bytes(itsKeptFeatures) +
+                  itsRequested.size() / 8;
+  for (const auto& names : itsNames)
+  {
+    n += vector_bytes(names);
+    for (const auto& name : names)
+      n += name.capacity();
+  }
+  for (const auto& value : itsValues)
+    if (const auto* str = std::get_if<std::string>(&value))
+      n += str->capacity();
+  return n;
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
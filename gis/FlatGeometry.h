@@ -0,0 +1,194 @@
+// ======================================================================
+/*!
+ * \brief Compact storage for cached geometries and features
+ *
+ * The coordinates of a sequence of geometries are stored in a single
+ * interleaved xy buffer. Each point sequence (point, linestring or
+ * ring) is a part with an offset into the buffer, and the geometry
+ * structure is encoded as a short stream of type and count pairs.
+ * The buffers are serialised into a single block, which may also be
+ * owned by external storage such as a shared memory segment. OGR
+ * objects are materialised only when requested and are shared with
+ * later callers for as long as someone holds them. A geometry requested
+ * again is kept with the block, so that hits on entries which are in
+ * use do not rebuild it. Readers which only need the coordinates can
+ * access the parts directly.
+ *
+ * Types without a native encoding, such as curves, surfaces, TINs and
+ * triangles, and geometries with M values are stored as WKB so that
+ * they are returned unchanged. Their coordinates are not parts.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/Types.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class OGRSpatialReference;
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class FlatGeometry
+{
+ public:
+  // Serialised buffers, the spatial references are shared
+  struct Packed
+  {
+    std::string data;
+    std::vector<std::shared_ptr<OGRSpatialReference>> spatialReferences;
+  };
+
+  // Null geometries are stored as empty slots
+  explicit FlatGeometry(const OGRGeometryPtr& theGeometry);
+  explicit FlatGeometry(const std::vector<OGRGeometryPtr>& theGeometries);
+  explicit FlatGeometry(const Packed& thePacked);
+
+  // View to serialised buffers owned by the storage, which must be aligned to 8 bytes
+  FlatGeometry(const char* theData,
+               std::size_t theSize,
+               const std::vector<std::shared_ptr<OGRSpatialReference>>& theSpatialReferences,
+               std::shared_ptr<const void> theStorage);
+
+  ~FlatGeometry();
+
+  FlatGeometry() = delete;
+  FlatGeometry(const FlatGeometry& other) = delete;
+  FlatGeometry& operator=(const FlatGeometry& other) = delete;
+
+  // A point sequence in the coordinate buffer
+  struct Part
+  {
+    const double* xy;    // interleaved x and y
+    const double* z;     // nullptr for 2D data
+    std::size_t points;  // number of points
+  };
+
+  // Number of stored geometries
+  std::size_t size() const { return itsRootNodes.size - 1; }
+
+  // Materialised geometry, nullptr for an empty slot
+  OGRGeometryPtr geometry(std::size_t theIndex = 0) const;
+
+  // Direct access to the coordinates
+  std::size_t numPoints() const { return itsXY.size / 2; }
+  std::size_t numParts() const { return itsPartOffsets.size - 1; }
+  Part part(std::size_t thePart) const;
+
+  // Range of parts belonging to a geometry
+  std::size_t firstPart(std::size_t theIndex) const { return itsRootParts[theIndex]; }
+  std::size_t endPart(std::size_t theIndex) const { return itsRootParts[theIndex + 1]; }
+
+  const OGRSpatialReference* spatialReference(std::size_t theIndex = 0) const;
+  const std::vector<OGRSpatialReference*>& spatialReferences() const
+  {
+    return itsSpatialReferences;
+  }
+
+  // The serialised buffers
+  const char* data() const { return itsData; }
+  std::size_t dataSize() const { return itsDataSize; }
+  bool isView() const { return static_cast<bool>(itsStorage); }
+
+  // Estimated memory use, excluding the buffers of a view
+  std::size_t bytes() const;
+
+  Packed pack() const;
+
+ private:
+  template <typename T>
+  struct Span
+  {
+    const T* data = nullptr;
+    std::size_t size = 0;
+    const T& operator[](std::size_t i) const { return data[i]; }
+  };
+
+  void bind(const char* theData, std::size_t theSize);
+  void validate(std::size_t& theNode, std::size_t& thePart, std::size_t theDepth) const;
+  void reference(const std::vector<std::shared_ptr<OGRSpatialReference>>& theSpatialReferences);
+  OGRGeometry* build(std::size_t& theNode, std::size_t& thePart) const;
+
+  std::vector<std::uint64_t> itsBuffer;    // owned buffers, empty for a view
+  std::shared_ptr<const void> itsStorage;  // owner of the buffers of a view
+  const char* itsData = nullptr;
+  std::size_t itsDataSize = 0;
+
+  bool itsHasZ = false;
+  Span<double> itsXY;
+  Span<double> itsZ;  // empty unless some geometry is 3D
+
+  Span<std::uint32_t> itsPartOffsets;  // point offsets, one extra at the end
+  Span<std::uint32_t> itsNodes;        // type and count pairs in preorder
+
+  // Per geometry node and part offsets, one extra at the end
+  Span<std::uint32_t> itsRootNodes;
+  Span<std::uint32_t> itsRootParts;
+
+  // Referenced spatial references and the index of the one used by each geometry
+  std::vector<OGRSpatialReference*> itsSpatialReferences;
+  Span<std::int32_t> itsRootSpatialReference;
+
+  // Geometries without a native encoding and their byte offsets, one extra at the end
+  Span<std::uint32_t> itsWKBOffsets;
+  Span<unsigned char> itsWKB;
+
+  // Geometries handed out earlier, and those requested more than once
+  mutable std::mutex itsMutex;
+  mutable std::vector<std::weak_ptr<OGRGeometry>> itsGeometries;
+  mutable std::vector<OGRGeometryPtr> itsKeptGeometries;
+  mutable std::vector<bool> itsRequested;
+};
+
+class FlatFeatures
+{
+ public:
+  explicit FlatFeatures(const Fmi::Features& theFeatures);
+
+  FlatFeatures() = delete;
+  FlatFeatures(const FlatFeatures& other) = delete;
+  FlatFeatures& operator=(const FlatFeatures& other) = delete;
+
+  std::size_t size() const { return itsLayouts.size(); }
+  bool empty() const { return itsLayouts.empty(); }
+
+  // Materialised features, null features are returned as nullptr
+  Fmi::Features features() const;
+  Fmi::FeaturePtr feature(std::size_t theIndex) const;
+
+  // The geometries of the features in the same order
+  const FlatGeometry& geometries() const { return itsGeometries; }
+
+  // Estimated memory use
+  std::size_t bytes() const;
+
+ private:
+  Fmi::FeaturePtr materialise(std::size_t theIndex) const;
+
+  FlatGeometry itsGeometries;
+
+  // Attribute names are shared by all features with the same set of attributes
+  std::vector<std::vector<std::string>> itsNames;
+  std::vector<std::uint32_t> itsLayouts;       // index to names for each feature
+  std::vector<std::uint32_t> itsValueOffsets;  // one extra at the end
+  std::vector<Fmi::Attribute> itsValues;
+
+  // Features handed out earlier, and those requested more than once
+  mutable std::mutex itsMutex;
+  mutable std::vector<std::weak_ptr<Fmi::Feature>> itsFeatures;
+  mutable std::vector<Fmi::FeaturePtr> itsKeptFeatures;
+  mutable std::vector<bool> itsRequested;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
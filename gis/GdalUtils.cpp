@@ -107,33 +107,77 @@ std::string WKT(const OGRGeometry &geometry)
   }
 }
 
-GeometryConv::GeometryConv(boost::function1<NFmiPoint, NFmiPoint> theConv)
-    : conv(std::move(theConv))
+// ----------------------------------------------------------------------
+/*!
+ * \brief Count the vertices of a geometry
+ */
+// ----------------------------------------------------------------------
+
+std::size_t count_points(const OGRGeometry *geometry)
 {
+  if (geometry == nullptr)
+    return 0;
+
+  switch (wkbFlatten(geometry->getGeometryType()))
+  {
+    case wkbPoint:
+      return (geometry->IsEmpty() ? 0 : 1);
+    case wkbLineString:
+    case wkbLinearRing:
+    case wkbCircularString:
+      return static_cast<std::size_t>(geometry->toSimpleCurve()->getNumPoints());
+    case wkbPolygon:
+    case wkbCurvePolygon:
+    case wkbTriangle:
+    {
+      std::size_t n = 0;
+      for (const auto *ring : *geometry->toCurvePolygon())
+        n += count_points(ring);
+      return n;
+    }
+    case wkbCompoundCurve:
+    {
+      std::size_t n = 0;
+      for (const auto *curve : *geometry->toCompoundCurve())
+        n += count_points(curve);
+      return n;
+    }
+    default:
+      break;
+  }
+
+  if (OGR_GT_IsSubClassOf(geometry->getGeometryType(), wkbGeometryCollection))
+  {
+    std::size_t n = 0;
+    for (const auto *part : *geometry->toGeometryCollection())
+      n += count_points(part);
+    return n;
+  }
+
+  return 0;
 }
 
-GeometryConv::~GeometryConv() = default;
+CoordinateConv::~CoordinateConv() = default;
 
-#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 1)
-OGRCoordinateTransformation *GeometryConv::Clone() const
+#if GDAL_VERSION_MAJOR < 3
+int CoordinateConv::Transform(int nCount, double *x, double *y, double *z)
 {
-  throw Fmi::Exception(BCP, "Attempt to clone GeometryConv");
+  return TransformEx(nCount, x, y, z, nullptr);
 }
-#endif
 
-#if GDAL_VERSION_MAJOR < 3
-// BUG?? nCount is unused
-int GeometryConv::Transform(int /* nCount */, double *x, double *y, double *z)
+int CoordinateConv::TransformEx(int nCount, double *x, double *y, double *z, int *pabSuccess)
 {
   try
   {
-    NFmiPoint src(*x, *y);
-    NFmiPoint dest = conv(src);
-    *x = dest.X();
-    *y = dest.Y();
-    if (z)
-      *z = 0.0;
-    return TRUE;
+    const int ok = (convert(nCount, x, y) ? TRUE : FALSE);
+    for (int i = 0; i < nCount; i++)
+    {
+      if (z)
+        z[i] = 0.0;
+      if (pabSuccess != nullptr)
+        pabSuccess[i] = ok;
+    }
+    return ok;
   }
   catch (...)
   {
@@ -143,23 +187,24 @@ int GeometryConv::Transform(int /* nCount */, double *x, double *y, double *z)
 #endif
 
 #if GDAL_VERSION_MAJOR >= 3
-int GeometryConv::Transform(GeometryConv::SizeType nCount, double *x, double *y, double *z, double *t, int *pabSuccess)
+int CoordinateConv::Transform(CoordinateConv::SizeType nCount,
+                              double *x,
+                              double *y,
+                              double *z,
+                              double * /* t */,
+                              int *pabSuccess)
 {
   try
   {
-    (void)t;
-    for (GeometryConv::SizeType i = 0; i < nCount; i++)
+    const int ok = (convert(nCount, x, y) ? TRUE : FALSE);
+    for (CoordinateConv::SizeType i = 0; i < nCount; i++)
     {
-      NFmiPoint src(x[i], y[i]);
-      NFmiPoint dest = conv(src);
-      x[i] = dest.X();
-      y[i] = dest.Y();
       if (z)
         z[i] = 0.0;
       if (pabSuccess != nullptr)
-        pabSuccess[i] = TRUE;
+        pabSuccess[i] = ok;
     }
-    return TRUE;
+    return ok;
   }
   catch (...)
   {
@@ -168,48 +213,79 @@ int GeometryConv::Transform(GeometryConv::SizeType nCount, double *x, double *y,
 }
 #endif
 
-#if GDAL_VERSION_MAJOR < 3
-int GeometryConv::TransformEx(int nCount, double *x, double *y, double *z, int *pabSuccess)
+#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 3)
+int CoordinateConv::TransformWithErrorCodes(CoordinateConv::SizeType nCount,
+                                            double *x,
+                                            double *y,
+                                            double *z,
+                                            double * /* t */,
+                                            int *panErrorCodes)
 {
   try
   {
-    for (int i = 0; i < nCount; i++)
+    const bool ok = convert(nCount, x, y);
+    for (CoordinateConv::SizeType i = 0; i < nCount; i++)
     {
-      NFmiPoint src(x[i], y[i]);
-      NFmiPoint dest = conv(src);
-      x[i] = dest.X();
-      y[i] = dest.Y();
       if (z)
         z[i] = 0.0;
-      if (pabSuccess != nullptr)
-        pabSuccess[i] = TRUE;
+      if (panErrorCodes != nullptr)
+        panErrorCodes[i] = (ok ? 0 : -1);
     }
-    return TRUE;
+    return (ok ? TRUE : FALSE);
   }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
+
+OGRCoordinateTransformation *CoordinateConv::GetInverse() const
+{
+  throw Fmi::Exception(BCP, "Attempt to call CoordinateConv::GetInverse");
+}
 #endif
 
-#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 3)
-int GeometryConv::TransformWithErrorCodes(GeometryConv::SizeType /* nCount*/,
-                                          double * /* x */,
-                                          double * /* y */,
-                                          double * /* z */,
-                                          double * /* t */,
-                                          int * /* panErrorCodes */)
-{
-  throw Fmi::Exception(BCP, "Attempt to call GeometryConv::TransformWithErrorCodes");
+GeometryConv::GeometryConv(boost::function1<NFmiPoint, NFmiPoint> theConv)
+    : conv(std::move(theConv))
+{
 }
 
-OGRCoordinateTransformation *GeometryConv::GetInverse() const
+GeometryConv::~GeometryConv() = default;
+
+#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 1)
+OGRCoordinateTransformation *GeometryConv::Clone() const
 {
-  throw Fmi::Exception(BCP, "Attempt to call GeometryConv::GetInverse");
+  throw Fmi::Exception(BCP, "Attempt to clone GeometryConv");
 }
 #endif
 
+bool GeometryConv::convert(CoordinateConv::SizeType nCount, double *x, double *y) const
+{
+  for (CoordinateConv::SizeType i = 0; i < nCount; i++)
+  {
+    NFmiPoint dest = conv(NFmiPoint(x[i], y[i]));
+    x[i] = dest.X();
+    y[i] = dest.Y();
+  }
+  return true;
+}
+
+BatchGeometryConv::BatchGeometryConv(Function theConv) : itsConv(std::move(theConv)) {}
+
+BatchGeometryConv::~BatchGeometryConv() = default;
+
+#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 1)
+OGRCoordinateTransformation *BatchGeometryConv::Clone() const
+{
+  return new BatchGeometryConv(itsConv);
+}
+#endif
+
+bool BatchGeometryConv::convert(CoordinateConv::SizeType nCount, double *x, double *y) const
+{
+  return itsConv(nCount, x, y);
+}
+
 }  // namespace Gis
 }  // namespace Engine
 }  // namespace SmartMet
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <boost/function.hpp>
+#include <functional>
 #include <memory>
 #include <newbase/NFmiPoint.h>
 #include <newbase/NFmiRect.h>
@@ -27,7 +28,19 @@ std::shared_ptr<OGRPolygon> bbox2polygon(
 
 std::string WKT(const OGRGeometry &geometry);
 
-class GeometryConv : public OGRCoordinateTransformation
+std::size_t count_points(const OGRGeometry *geometry);
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Base class for custom coordinate conversions of OGR geometries
+ *
+ * OGR passes the coordinates of each geometry part as arrays. Derived
+ * classes convert the arrays in place, hence there is at most one virtual
+ * call per part instead of one per point.
+ */
+// ----------------------------------------------------------------------
+
+class CoordinateConv : public OGRCoordinateTransformation
 {
  public:
 #if GDAL_VERSION_ID < 309
@@ -36,9 +49,7 @@ class GeometryConv : public OGRCoordinateTransformation
   using SizeType = std::size_t;
 #endif
 
-  explicit GeometryConv(boost::function1<NFmiPoint, NFmiPoint> conv);
-
-  ~GeometryConv() override;
+  ~CoordinateConv() override;
 
 #if GDAL_VERSION_MAJOR < 3
   virtual int Transform(int nCount, double *x, double *y, double *z = nullptr);
@@ -46,11 +57,8 @@ class GeometryConv : public OGRCoordinateTransformation
   virtual int TransformEx(
       int nCount, double *x, double *y, double *z = nullptr, int *pabSuccess = nullptr);
 #else
-  int Transform(SizeType nCount, double *x, double *y, double *z, double *t, int *pabSuccess) override;
-
-#if GDAL_VERSION_ID >= 301
-  OGRCoordinateTransformation *Clone() const override;
-#endif
+  int Transform(
+      SizeType nCount, double *x, double *y, double *z, double *t, int *pabSuccess) override;
 
 #if GDAL_VERSION_ID >= 303
   int TransformWithErrorCodes(
@@ -61,6 +69,10 @@ class GeometryConv : public OGRCoordinateTransformation
 
 #endif
 
+ protected:
+  // Convert the coordinates in place, return false on failure
+  virtual bool convert(SizeType nCount, double *x, double *y) const = 0;
+
  private:
 #if GDAL_VERSION_ID >= 307
   const OGRSpatialReference *GetSourceCS() const override { return nullptr; }
@@ -69,10 +81,87 @@ class GeometryConv : public OGRCoordinateTransformation
   OGRSpatialReference *GetSourceCS() override { return nullptr; }
   OGRSpatialReference *GetTargetCS() override { return nullptr; }
 #endif
+};
+
+// Point by point conversion through NFmiPoint
+class GeometryConv : public CoordinateConv
+{
+ public:
+  explicit GeometryConv(boost::function1<NFmiPoint, NFmiPoint> conv);
+
+  ~GeometryConv() override;
+
+#if GDAL_VERSION_ID >= 301
+  OGRCoordinateTransformation *Clone() const override;
+#endif
 
+ protected:
+  bool convert(SizeType nCount, double *x, double *y) const override;
+
+ private:
   boost::function1<NFmiPoint, NFmiPoint> conv;
 };
 
+// Conversion of whole coordinate arrays, for example by a bulk area transformation
+class BatchGeometryConv : public CoordinateConv
+{
+ public:
+  using Function = std::function<bool(SizeType nCount, double *x, double *y)>;
+
+  explicit BatchGeometryConv(Function theConv);
+
+  ~BatchGeometryConv() override;
+
+#if GDAL_VERSION_ID >= 301
+  OGRCoordinateTransformation *Clone() const override;
+#endif
+
+ protected:
+  bool convert(SizeType nCount, double *x, double *y) const override;
+
+ private:
+  Function itsConv;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Conversion of whole coordinate arrays with a functor known at compile time
+ *
+ * The functor is called as conv(nCount, x, y) like in BatchGeometryConv,
+ * but without the type erasure the call and any per-point loop in the
+ * functor can be inlined and vectorized by the compiler.
+ */
+// ----------------------------------------------------------------------
+
+template <typename Conv>
+class InlineGeometryConv : public CoordinateConv
+{
+ public:
+  explicit InlineGeometryConv(Conv theConv) : itsConv(std::move(theConv)) {}
+
+#if GDAL_VERSION_ID >= 301
+  OGRCoordinateTransformation *Clone() const override
+  {
+    return new InlineGeometryConv<Conv>(itsConv);
+  }
+#endif
+
+ protected:
+  bool convert(SizeType nCount, double *x, double *y) const override
+  {
+    return itsConv(nCount, x, y);
+  }
+
+ private:
+  Conv itsConv;
+};
+
+template <typename Conv>
+InlineGeometryConv<Conv> make_geometry_conv(Conv theConv)
+{
+  return InlineGeometryConv<Conv>(std::move(theConv));
+}
+
 }  // namespace Gis
 }  // namespace Engine
 }  // namespace SmartMet
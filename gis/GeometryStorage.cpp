@@ -1,6 +1,7 @@
 #include "GeometryStorage.h"
 #include "MapOptions.h"
 #include "Normalize.h"
+#include <gis/Box.h>
 #include <macgyver/Exception.h>
 #include <spine/HTTP.h>
 #include <spine/TableFormatterOptions.h>
@@ -83,6 +84,155 @@ const OGRGeometry* GeometryStorage::getOGRGeometry(const std::string& name, int
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the prepared geometry for the given normalized name and type
+ *
+ * Returns an empty pointer if there is no such geometry.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<GeometryStorage::PreparedGeometry> GeometryStorage::getPreparedGeometry(
+    const std::string& key, int type) const
+{
+  try
+  {
+    auto geomtype = itsGeometries.find(type);
+    if (geomtype == itsGeometries.end())
+      return {};
+
+    auto geom = geomtype->second.find(key);
+    if (geom == geomtype->second.end() || !geom->second)
+      return {};
+
+    std::lock_guard<std::mutex> lock(itsPreparedCache->mutex);
+
+    auto& prepared = itsPreparedCache->geometries[std::make_pair(type, key)];
+
+    // Rebuild if the storage has replaced the geometry since
+    if (!prepared || prepared->geom != geom->second)
+    {
+      auto tmp = std::make_shared<PreparedGeometry>();
+      tmp->geom = geom->second;
+      tmp->prepared.reset(OGRCreatePreparedGeometry(tmp->geom.get()));
+      tmp->geom->getEnvelope(&tmp->envelope);
+      if (!tmp->prepared)
+        throw Fmi::Exception(BCP, "Failed to create prepared geometry").addParameter("Name", key);
+      prepared = tmp;
+    }
+
+    return prepared;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test which of the points are inside the named polygon
+ *
+ * Points outside unknown areas are reported as not being contained.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<bool> GeometryStorage::contains(const std::string& name,
+                                            const PointVector& points) const
+{
+  try
+  {
+    std::vector<bool> ret(points.size(), false);
+
+    std::string key = name;
+    normalize_string(key);
+
+    for (auto type : {wkbMultiPolygon, wkbPolygon})
+    {
+      auto prepared = getPreparedGeometry(key, type);
+      if (!prepared)
+        continue;
+
+      std::lock_guard<std::mutex> lock(prepared->mutex);
+
+      const auto& env = prepared->envelope;
+
+      OGRPoint point;
+      for (std::size_t i = 0; i < points.size(); i++)
+      {
+        if (ret[i])
+          continue;
+
+        const auto x = points[i].first;
+        const auto y = points[i].second;
+
+        // Cheap rejection before calling GEOS
+        if (x < env.MinX || x > env.MaxX || y < env.MinY || y > env.MaxY)
+          continue;
+
+        point.setX(x);
+        point.setY(y);
+        ret[i] = (OGRPreparedGeometryContains(prepared->prepared.get(), &point) != 0);
+      }
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("Name", name);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether any geometry with the given name intersects the envelope
+ */
+// ----------------------------------------------------------------------
+
+bool GeometryStorage::intersects(const std::string& name, const OGREnvelope& envelope) const
+{
+  try
+  {
+    std::string key = name;
+    normalize_string(key);
+
+    std::unique_ptr<OGRPolygon> box;
+
+    for (const auto& type_geoms : itsGeometries)
+    {
+      auto prepared = getPreparedGeometry(key, type_geoms.first);
+      if (!prepared)
+        continue;
+
+      if (!prepared->envelope.Intersects(envelope))
+        continue;
+
+      if (!box)
+      {
+        auto* ring = new OGRLinearRing;
+        ring->addPoint(envelope.MinX, envelope.MinY);
+        ring->addPoint(envelope.MinX, envelope.MaxY);
+        ring->addPoint(envelope.MaxX, envelope.MaxY);
+        ring->addPoint(envelope.MaxX, envelope.MinY);
+        ring->closeRings();
+        box = std::make_unique<OGRPolygon>();
+        box->addRingDirectly(ring);
+      }
+
+      std::lock_guard<std::mutex> lock(prepared->mutex);
+      if (OGRPreparedGeometryIntersects(prepared->prepared.get(), box.get()) != 0)
+        return true;
+    }
+
+    return false;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("Name", name);
+  }
+}
+
 bool GeometryStorage::geoObjectExists(const std::string& name) const
 {
   try
@@ -160,6 +310,131 @@ std::list<std::string> GeometryStorage::areaNames() const
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add a geometry with a normalized name
+ *
+ * Geometries of the same name and type are merged. Call quoteSVGPaths()
+ * once all the geometries have been added.
+ */
+// ----------------------------------------------------------------------
+
+void GeometryStorage::add(const std::string& name, const OGRGeometry& geometry)
+{
+  try
+  {
+    const OGRGeometry* geom = &geometry;
+    OGRwkbGeometryType geomType = geom->getGeometryType();
+
+    // If same name and type found
+    if (itsGeometries.find(geomType) == itsGeometries.end())
+    {
+      // If that type of geometries not found, add new one
+      NameOGRGeometryMap nameOGRGeometryMap;
+      nameOGRGeometryMap.insert(make_pair(name, std::shared_ptr<OGRGeometry>(geom->clone())));
+      itsGeometries.insert(std::make_pair(geomType, nameOGRGeometryMap));
+    }
+    else
+    {
+      // That type of geometries found
+      NameOGRGeometryMap& nameOGRGeometryMap = itsGeometries[geomType];
+      // If named area not found, add new one
+      if (nameOGRGeometryMap.find(name) == nameOGRGeometryMap.end())
+      {
+        nameOGRGeometryMap.insert(
+            std::make_pair(name, std::shared_ptr<OGRGeometry>(geom->clone())));
+      }
+      else
+      {
+        // Do the merge with the new and old one
+        std::shared_ptr<OGRGeometry>& previousGeom = nameOGRGeometryMap[name];
+        if (geomType == wkbMultiLineString)
+        {
+          // Multilinestrings are merged with addGeometryDirectly-function
+          auto* geom_tmp = dynamic_cast<OGRMultiLineString*>(previousGeom->clone());
+          const auto* new_geom = dynamic_cast<const OGRMultiLineString*>(geom);
+          // Iterate the LINESTRINGS inside Multilinestring and add them to old one
+          for (int i = 0; i < new_geom->getNumGeometries(); i++)
+          {
+            geom_tmp->addGeometryDirectly(new_geom->getGeometryRef(i)->clone());
+          }
+          previousGeom.reset(geom_tmp);
+        }
+        else
+        {
+          // For other geometries use Union-function
+          previousGeom.reset(previousGeom->Union(geom));
+        }
+      }
+    }
+
+    std::string svgString = Fmi::OGR::exportToSvg(*geom, Fmi::Box::identity(), 6);
+
+    if (geomType == wkbPolygon || geomType == wkbMultiPolygon)
+    {
+      if (itsPolygons.find(name) != itsPolygons.end())
+        itsPolygons[name] = svgString;
+      else
+        itsPolygons.insert(std::make_pair(name, svgString));
+    }
+    else if (geomType == wkbLineString || geomType == wkbMultiLineString)
+    {
+      if (itsLines.find(name) != itsLines.end())
+      {
+        itsLines[name].append(svgString);
+      }
+      else
+        itsLines.insert(std::make_pair(name, svgString));
+    }
+    else if (geomType == wkbPoint)
+    {
+      const auto* ogrPoint = reinterpret_cast<const OGRPoint*>(geom);
+      if (itsPoints.find(name) != itsPoints.end())
+        itsPoints[name] = std::make_pair(ogrPoint->getX(), ogrPoint->getY());
+      else
+        itsPoints.insert(
+            std::make_pair(name, std::make_pair(ogrPoint->getX(), ogrPoint->getY())));
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!").addParameter("Name", name);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add quotation marks to the beginning and the end of SVG paths
+ */
+// ----------------------------------------------------------------------
+
+void GeometryStorage::quoteSVGPaths()
+{
+  try
+  {
+    for (auto& svg : itsLines)
+    {
+      if (!svg.second.empty() && svg.second[0] != '"')
+      {
+        svg.second.insert(0, "\"");
+        svg.second.append("\"");
+      }
+    }
+    for (auto& svg : itsPolygons)
+    {
+      if (!svg.second.empty() && svg.second[0] != '"')
+      {
+        svg.second.insert(0, "\"");
+        svg.second.append("\"");
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 std::unique_ptr<Spine::Table> GeometryStorage::dumpContents() const
 {
   try
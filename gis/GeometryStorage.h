@@ -13,10 +13,13 @@
 #include <gis/OGR.h>
 #include <macgyver/StringConversion.h>
 #include <spine/Table.h>
+#include <ogr_geometry.h>
 #include <list>
 #include <map>
+#include <mutex>
 #include <ostream>
 #include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -55,6 +58,7 @@ struct AttributeToString
 
 using PostGISIdentifierVector = std::vector<postgis_identifier>;
 using NameOGRGeometryMap = std::map<std::string, std::shared_ptr<OGRGeometry> >;
+using PointVector = std::vector<std::pair<double, double> >;
 
 class GeometryStorage
 {
@@ -69,6 +73,16 @@ class GeometryStorage
 
   const OGRGeometry* getOGRGeometry(const std::string& name, int type) const;
 
+  // Batch spatial predicates against the named polygon / any named geometry. The GEOS
+  // prepared geometries are built lazily on first use and reused on later calls.
+  std::vector<bool> contains(const std::string& name, const PointVector& points) const;
+  bool intersects(const std::string& name, const OGREnvelope& envelope) const;
+
+  // Add a geometry with a normalized name, merging geometries of the same name and type.
+  // The SVG paths must be quoted once all geometries have been added.
+  void add(const std::string& name, const OGRGeometry& geometry);
+  void quoteSVGPaths();
+
   std::unique_ptr<Spine::Table> dumpContents() const;
   void dumpContents(std::ostream& out, const std::string& format) const;
 
@@ -82,6 +96,31 @@ class GeometryStorage
   std::map<int, NameOGRGeometryMap> itsGeometries;  // int == OGRwkbGeometryType
   std::map<std::string, int> itsQueryParameters;
 
+  // Lazily built prepared geometries. The source geometry is held to detect replaced
+  // geometries, and the mutex serializes use since GEOS prepared geometries are not
+  // thread safe. Copies of the storage share the cache.
+  struct PreparedGeometry
+  {
+    std::shared_ptr<OGRGeometry> geom;
+    OGRPreparedGeometryUniquePtr prepared;
+    OGREnvelope envelope;
+    std::mutex mutex;
+  };
+
+  using PreparedGeometryMap =
+      std::map<std::pair<int, std::string>, std::shared_ptr<PreparedGeometry> >;
+
+  struct PreparedGeometryCache
+  {
+    std::mutex mutex;
+    PreparedGeometryMap geometries;
+  };
+
+  std::shared_ptr<PreparedGeometry> getPreparedGeometry(const std::string& key, int type) const;
+
+  std::shared_ptr<PreparedGeometryCache> itsPreparedCache =
+      std::make_shared<PreparedGeometryCache>();
+
   friend class SmartMet::Engine::Gis::Engine;
 };  // class GeometryStorage
 
@@ -1,5 +1,6 @@
 #include "MetaData.h"
 #include <macgyver/Hash.h>
+#include <macgyver/StringConversion.h>
 
 namespace SmartMet
 {
@@ -15,9 +16,20 @@ std::size_t MetaDataQueryOptions::hash_value() const
   Fmi::hash_combine(hash, Fmi::hash_value(geometry_column));
   if (time_column)
     Fmi::hash_combine(hash, Fmi::hash_value(*time_column));
+  if (starttime)
+    Fmi::hash_combine(hash, Fmi::hash_value(Fmi::to_iso_string(*starttime)));
+  if (endtime)
+    Fmi::hash_combine(hash, Fmi::hash_value(Fmi::to_iso_string(*endtime)));
   return hash;
 }
 
+bool MetaDataQueryOptions::operator==(const MetaDataQueryOptions& theOther) const
+{
+  return (pgname == theOther.pgname && schema == theOther.schema && table == theOther.table &&
+          geometry_column == theOther.geometry_column && time_column == theOther.time_column &&
+          starttime == theOther.starttime && endtime == theOther.endtime);
+}
+
 }  // namespace Gis
 }  // namespace Engine
 }  // namespace SmartMet
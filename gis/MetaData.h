@@ -1,5 +1,6 @@
 #pragma once
 
+#include "TimeSteps.h"
 #include <macgyver/DateTime.h>
 #include <optional>
 #include <vector>
@@ -24,7 +25,13 @@ struct MetaDataQueryOptions
   std::string table;
   std::string geometry_column;
   std::optional<std::string> time_column;
+
+  // optional time range, used only if there is a time column
+  std::optional<Fmi::DateTime> starttime;
+  std::optional<Fmi::DateTime> endtime;
+
   std::size_t hash_value() const;
+  bool operator==(const MetaDataQueryOptions& theOther) const;
 };
 
 struct TimeInterval
@@ -37,7 +44,7 @@ struct TimeInterval
 struct MetaData
 {
   // list of steps or fixed steps
-  std::vector<Fmi::DateTime> timesteps;
+  TimeSteps timesteps;
   std::optional<TimeInterval> timeinterval;
 
   // bounding box of geometries
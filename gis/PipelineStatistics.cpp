@@ -0,0 +1,149 @@
+#include "PipelineStatistics.h"
+#include <fmt/format.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cmath>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+void DurationHistogram::add(std::chrono::steady_clock::duration theDuration)
+{
+  const auto us = std::chrono::duration_cast<std::chrono::microseconds>(theDuration).count();
+
+  std::size_t bucket = 0;
+  for (auto value = us; value > 0 && bucket + 1 < itsBuckets.size(); value >>= 1)
+    ++bucket;
+
+  const auto value = static_cast<std::uint64_t>(std::max<decltype(us)>(us, 0));
+  itsBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  itsCount.fetch_add(1, std::memory_order_relaxed);
+  itsTotal.fetch_add(value, std::memory_order_relaxed);
+
+  auto old_max = itsMax.load(std::memory_order_relaxed);
+  while (value > old_max &&
+         !itsMax.compare_exchange_weak(old_max, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimate a percentile in milliseconds
+ *
+ * The upper limit of the bucket is returned, hence the estimate is
+ * at most twice the actual value.
+ */
+// ----------------------------------------------------------------------
+
+double DurationHistogram::percentile(double theFraction) const
+{
+  const auto n = count();
+  if (n == 0)
+    return 0;
+
+  const auto limit = static_cast<std::uint64_t>(std::ceil(theFraction * n));
+
+  std::uint64_t sum = 0;
+  for (std::size_t i = 0; i < itsBuckets.size(); i++)
+  {
+    sum += itsBuckets[i];
+    if (sum >= limit)
+      return std::min(max(), std::ldexp(1.0, static_cast<int>(i)) / 1000.0);
+  }
+  return max();
+}
+
+void PipelineStatistics::add(const std::string& theTable,
+                             const std::string& theStage,
+                             Duration theDuration,
+                             std::size_t thePointsIn,
+                             std::size_t thePointsOut,
+                             std::size_t theRows,
+                             std::size_t theBytes)
+{
+  const auto key = std::make_pair(theTable, theStage);
+
+  StageStatistics* stats = nullptr;
+  {
+    std::shared_lock<std::shared_mutex> lock(itsMutex);
+    auto pos = itsStatistics.find(key);
+    if (pos != itsStatistics.end())
+      stats = &pos->second;
+  }
+
+  if (!stats)
+  {
+    std::unique_lock<std::shared_mutex> lock(itsMutex);
+    stats = &itsStatistics[key];
+  }
+
+  stats->time.add(theDuration);
+  stats->points_in.fetch_add(thePointsIn, std::memory_order_relaxed);
+  stats->points_out.fetch_add(thePointsOut, std::memory_order_relaxed);
+  stats->rows.fetch_add(theRows, std::memory_order_relaxed);
+  stats->bytes.fetch_add(theBytes, std::memory_order_relaxed);
+}
+
+std::unique_ptr<Spine::Table> PipelineStatistics::table() const
+{
+  try
+  {
+    auto ret = std::make_unique<Spine::Table>();
+
+    ret->setTitle("GIS Engine Pipeline Statistics");
+    ret->setNames({"Table",
+                   "Stage",
+                   "Calls",
+                   "Rows",
+                   "Bytes",
+                   "PointsIn",
+                   "PointsOut",
+                   "TotalMs",
+                   "MeanMs",
+                   "P50Ms",
+                   "P90Ms",
+                   "P99Ms",
+                   "MaxMs"});
+
+    std::shared_lock<std::shared_mutex> lock(itsMutex);
+
+    int row = 0;
+    for (const auto& item : itsStatistics)
+    {
+      const auto& stats = item.second;
+      const auto& time = stats.time;
+      const auto mean = (time.count() > 0 ? time.total() / time.count() : 0.0);
+
+      int col = 0;
+      ret->set(col++, row, item.first.first);
+      ret->set(col++, row, item.first.second);
+      ret->set(col++, row, Fmi::to_string(time.count()));
+      ret->set(col++, row, Fmi::to_string(stats.rows.load()));
+      ret->set(col++, row, Fmi::to_string(stats.bytes.load()));
+      ret->set(col++, row, Fmi::to_string(stats.points_in.load()));
+      ret->set(col++, row, Fmi::to_string(stats.points_out.load()));
+      ret->set(col++, row, fmt::format("{:.3f}", time.total()));
+      ret->set(col++, row, fmt::format("{:.3f}", mean));
+      ret->set(col++, row, fmt::format("{:.3f}", time.percentile(0.5)));
+      ret->set(col++, row, fmt::format("{:.3f}", time.percentile(0.9)));
+      ret->set(col++, row, fmt::format("{:.3f}", time.percentile(0.99)));
+      ret->set(col++, row, fmt::format("{:.3f}", time.max()));
+      ++row;
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,83 @@
+// ======================================================================
+/*!
+ * \brief Timing and volume statistics of the engine processing stages
+ *
+ * Statistics are collected per table and stage, for example the
+ * database read and each of the simplification stages of getShape.
+ * Durations are collected into power of two histograms so that
+ * percentiles can be estimated without storing the samples. The
+ * counters are atomic so that concurrent requests only share a read
+ * lock once the table and stage have been seen.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <spine/Table.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class DurationHistogram
+{
+ public:
+  void add(std::chrono::steady_clock::duration theDuration);
+
+  std::uint64_t count() const { return itsCount; }
+  double total() const { return itsTotal / 1000.0; }  // milliseconds
+  double max() const { return itsMax / 1000.0; }      // milliseconds
+  double percentile(double theFraction) const;
+
+ private:
+  // bucket i holds durations in range [2^(i-1),2^i) microseconds
+  std::array<std::atomic<std::uint64_t>, 40> itsBuckets{};
+  std::atomic<std::uint64_t> itsCount{0};
+  std::atomic<std::uint64_t> itsTotal{0};  // microseconds
+  std::atomic<std::uint64_t> itsMax{0};    // microseconds
+};
+
+struct StageStatistics
+{
+  DurationHistogram time;
+  std::atomic<std::uint64_t> rows{0};
+  std::atomic<std::uint64_t> bytes{0};
+  std::atomic<std::uint64_t> points_in{0};
+  std::atomic<std::uint64_t> points_out{0};
+};
+
+class PipelineStatistics
+{
+ public:
+  using Duration = std::chrono::steady_clock::duration;
+
+  void add(const std::string& theTable,
+           const std::string& theStage,
+           Duration theDuration,
+           std::size_t thePointsIn,
+           std::size_t thePointsOut,
+           std::size_t theRows = 0,
+           std::size_t theBytes = 0);
+
+  std::unique_ptr<Spine::Table> table() const;
+
+ private:
+  // Entries are never removed, hence they can be updated after the lock is released
+  mutable std::shared_mutex itsMutex;
+  std::map<std::pair<std::string, std::string>, StageStatistics> itsStatistics;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,629 @@
+#include "SharedCache.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cpl_conv.h>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <new>
+#include <ogr_spatialref.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+const std::uint64_t file_magic = 0x48434143534947ULL;  // "GISCACH"
+const std::uint64_t file_version = 2;
+
+// The index starts at this offset, the records after the index at the next multiple
+const std::size_t alignment = 64;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "The shared cache requires lock free 64 bit atomics");
+
+struct Record
+{
+  std::uint64_t key_size;
+  std::uint64_t data_size;
+  std::uint64_t srs_size;
+};
+
+std::size_t pad(std::size_t theSize, std::size_t theAlignment = 8)
+{
+  return (theSize + theAlignment - 1) / theAlignment * theAlignment;
+}
+
+// FNV-1a, which unlike std::hash is the same in all processes. Zero marks an empty slot.
+std::uint64_t hash_key(const std::string& theKey)
+{
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : theKey)
+  {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return (hash == 0 ? 1 : hash);
+}
+
+// Read a record header, false if the record does not fit into the file
+bool read_record(const char* theBase,
+                 std::size_t theSize,
+                 std::uint64_t theOffset,
+                 Record& theRecord)
+{
+  if (theOffset > theSize || theSize - theOffset < sizeof(Record))
+    return false;
+  std::memcpy(&theRecord, theBase + theOffset, sizeof(Record));
+
+  const auto available = theSize - theOffset - sizeof(Record);
+  return (theRecord.key_size <= available && theRecord.data_size <= available &&
+          theRecord.srs_size <= available &&
+          pad(theRecord.key_size) + pad(theRecord.data_size) + theRecord.srs_size <= available);
+}
+
+void append(std::string& theOutput, std::uint64_t theValue)
+{
+  theOutput.append(reinterpret_cast<const char*>(&theValue), sizeof(theValue));
+}
+
+std::uint64_t extract(const char* theData, std::size_t theSize, std::size_t& thePos)
+{
+  std::uint64_t value = 0;
+  if (theSize - thePos < sizeof(value))
+    throw Fmi::Exception(BCP, "Corrupted shared cache record");
+  std::memcpy(&value, theData + thePos, sizeof(value));
+  thePos += sizeof(value);
+  return value;
+}
+
+// Closes the file unless it was handed over to a mapping. Closing also releases the
+// lock of this process.
+struct FileCloser
+{
+  int fd;
+  ~FileCloser()
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+};
+
+Fmi::Exception system_error(const char* theMessage, const std::string& thePath)
+{
+  return Fmi::Exception(BCP, theMessage)
+      .addParameter("Path", thePath)
+      .addParameter("Error", std::strerror(errno));
+}
+
+// Index entries are limited to this fraction of the slots so that the probes stay short
+const double max_load_factor = 0.7;
+
+// Published records are found within this many slots from their hash
+const std::uint64_t max_probes = 64;
+
+}  // namespace
+
+struct SharedCache::Header
+{
+  std::uint64_t magic;
+  std::uint64_t version;
+  std::uint64_t size;
+  std::uint64_t slots;
+  std::atomic<std::uint64_t> used;     // end of the allocated records
+  std::atomic<std::uint64_t> entries;  // published records
+  std::atomic<std::uint64_t> retired;  // nonzero once the file has been replaced
+};
+
+struct SharedCache::Slot
+{
+  std::atomic<std::uint64_t> hash;    // zero for an empty slot
+  std::atomic<std::uint64_t> offset;  // zero until the record is published
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief A mapped cache file
+ *
+ * The file descriptor is kept open with a shared lock for as long as the
+ * mapping exists, which tells other processes that the file is in use.
+ */
+// ----------------------------------------------------------------------
+
+class SharedCache::Mapping
+{
+ public:
+  Mapping(int theFd, void* theAddress, std::size_t theSize)
+      : itsFd(theFd), itsAddress(theAddress), itsSize(theSize)
+  {
+  }
+
+  ~Mapping()
+  {
+    munmap(itsAddress, itsSize);
+    close(itsFd);
+  }
+
+  Mapping() = delete;
+  Mapping(const Mapping& other) = delete;
+  Mapping& operator=(const Mapping& other) = delete;
+
+  char* address() const { return static_cast<char*>(itsAddress); }
+  std::size_t size() const { return itsSize; }
+  Header* header() const { return static_cast<Header*>(itsAddress); }
+  Slot* slots() const { return reinterpret_cast<Slot*>(address() + alignment); }
+
+ private:
+  int itsFd;
+  void* itsAddress;
+  std::size_t itsSize;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Map the cache file, emptying it if no other process uses it
+ *
+ * Each process holds a shared lock on the file it uses. If an exclusive
+ * lock can be taken at startup, all the previous users have exited and
+ * the file is emptied so that geometries changed in the database while
+ * the servers were down are not served. Otherwise the file must have
+ * been created with the same settings, since it cannot be resized while
+ * other processes use it.
+ */
+// ----------------------------------------------------------------------
+
+SharedCache::SharedCache(const std::string& thePath, std::size_t theBytes, std::size_t theSlots)
+    : itsPath(thePath), itsBytes(theBytes), itsSlots(theSlots)
+{
+  try
+  {
+    static_assert(sizeof(Header) <= alignment, "Shared cache header does not fit");
+
+    if (theSlots == 0 || theBytes <= records())
+      throw Fmi::Exception(BCP, "The shared cache is too small for its index")
+          .addParameter("Path", thePath);
+
+    int fd = open(thePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+    if (fd < 0)
+      throw system_error("Failed to open the shared cache file", thePath);
+    FileCloser closer{fd};
+
+    const bool reset = (flock(fd, LOCK_EX | LOCK_NB) == 0);
+    if (reset)
+    {
+      // Truncating fills the file with zeros. A replacement left behind by a
+      // process which failed while building it is removed too.
+      if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(theBytes)) != 0)
+        throw system_error("Failed to size the shared cache file", thePath);
+      unlink((thePath + ".new").c_str());
+    }
+    else if (flock(fd, LOCK_SH) != 0)
+      throw system_error("Failed to lock the shared cache file", thePath);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+      throw system_error("Failed to stat the shared cache file", thePath);
+    if (static_cast<std::size_t>(info.st_size) != theBytes)
+      throw Fmi::Exception(BCP, "The shared cache file has a different size")
+          .addParameter("Path", thePath)
+          .addParameter("Size", Fmi::to_string(static_cast<std::size_t>(info.st_size)));
+
+    auto mapping = map(fd);
+    closer.fd = -1;
+
+    const auto* header = mapping->header();
+    if (reset)
+    {
+      initialize(*mapping);
+      if (flock(fd, LOCK_SH) != 0)
+        throw system_error("Failed to lock the shared cache file", thePath);
+    }
+    else if (header->magic != file_magic || header->version != file_version ||
+             header->size != theBytes || header->slots != theSlots)
+      throw Fmi::Exception(BCP, "The shared cache file has different settings")
+          .addParameter("Path", thePath);
+
+    itsMapping = mapping;
+
+    // The accounting covers the entries inserted by this process
+    itsAccounting.resize(std::numeric_limits<std::size_t>::max());
+    itsAccounting.trackEntries(true);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Offset of the record area after the index
+std::size_t SharedCache::records() const
+{
+  return pad(alignment + itsSlots * sizeof(Slot), alignment);
+}
+
+// Map an open file of the configured size, the mapping takes the ownership of the descriptor
+std::shared_ptr<const SharedCache::Mapping> SharedCache::map(int theFd) const
+{
+  void* address = mmap(nullptr, itsBytes, PROT_READ | PROT_WRITE, MAP_SHARED, theFd, 0);
+  if (address == MAP_FAILED)
+    throw system_error("Failed to map the shared cache file", itsPath);
+  return std::make_shared<const Mapping>(theFd, address, itsBytes);
+}
+
+// Initialize a file filled with zeros, which is also an empty index
+void SharedCache::initialize(const Mapping& theMapping) const
+{
+  auto* header = new (theMapping.address()) Header;
+  header->version = file_version;
+  header->size = itsBytes;
+  header->slots = itsSlots;
+  header->used.store(records());
+  header->entries.store(0);
+  header->retired.store(0);
+  header->magic = file_magic;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The current file, switching to a new one if it has been replaced
+ *
+ * Views to the records of the previous file keep it mapped until they
+ * are released.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const SharedCache::Mapping> SharedCache::current()
+{
+  std::lock_guard<std::mutex> lock(itsMappingMutex);
+  if (itsMapping->header()->retired.load(std::memory_order_acquire) == 0)
+    return itsMapping;
+
+  try
+  {
+    int fd = open(itsPath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+      throw system_error("Failed to open the shared cache file", itsPath);
+    FileCloser closer{fd};
+
+    if (flock(fd, LOCK_SH) != 0)
+      throw system_error("Failed to lock the shared cache file", itsPath);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+      throw system_error("Failed to stat the shared cache file", itsPath);
+    if (static_cast<std::size_t>(info.st_size) != itsBytes)
+      throw Fmi::Exception(BCP, "The shared cache file has a different size")
+          .addParameter("Path", itsPath);
+
+    auto mapping = map(fd);
+    closer.fd = -1;
+
+    const auto* header = mapping->header();
+    if (header->magic != file_magic || header->version != file_version ||
+        header->size != itsBytes || header->slots != itsSlots)
+      throw Fmi::Exception(BCP, "The shared cache file has different settings")
+          .addParameter("Path", itsPath);
+
+    itsMapping = mapping;
+    itsAccounting.evictAll();
+  }
+  catch (...)
+  {
+    // Keep using the retired file, which is still valid but gets no new records
+    Fmi::Exception::Trace(BCP, "Failed to switch to the new shared cache file").printError();
+  }
+  return itsMapping;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Replace a full file by an empty one
+ *
+ * The replacement is built under a temporary name and renamed over the
+ * full file, after which the full file is marked retired. Processes
+ * switch to the new file when they notice it. Only one process builds
+ * the replacement, the others keep using the full file meanwhile.
+ */
+// ----------------------------------------------------------------------
+
+void SharedCache::reclaim(const std::shared_ptr<const Mapping>& theFull)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMappingMutex);
+    if (itsMapping != theFull || theFull->header()->retired.load(std::memory_order_acquire) != 0)
+      return;
+
+    const auto path = itsPath + ".new";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+    if (fd < 0)
+      return;
+    FileCloser closer{fd};
+
+    try
+    {
+      if (flock(fd, LOCK_SH) != 0)
+        throw system_error("Failed to lock the shared cache file", path);
+      if (ftruncate(fd, static_cast<off_t>(itsBytes)) != 0)
+        throw system_error("Failed to size the shared cache file", path);
+
+      auto mapping = map(fd);
+      closer.fd = -1;
+      initialize(*mapping);
+
+      if (rename(path.c_str(), itsPath.c_str()) != 0)
+        throw system_error("Failed to replace the shared cache file", itsPath);
+
+      theFull->header()->retired.store(1, std::memory_order_release);
+      itsMapping = mapping;
+      itsAccounting.evictAll();
+    }
+    catch (...)
+    {
+      unlink(path.c_str());
+      throw;
+    }
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to replace the full shared cache file").printError();
+  }
+}
+
+// Offset of the published record of the key, zero if there is none
+std::uint64_t SharedCache::lookup(const Mapping& theMapping,
+                                  const std::string& theKey,
+                                  std::uint64_t theHash) const
+{
+  const auto* slots = theMapping.slots();
+  const auto count = theMapping.header()->slots;
+  for (std::uint64_t i = 0; i < std::min(count, max_probes); i++)
+  {
+    const auto& slot = slots[(theHash + i) % count];
+    const auto hash = slot.hash.load(std::memory_order_acquire);
+    if (hash == 0)
+      return 0;
+    if (hash != theHash)
+      continue;
+
+    const auto offset = slot.offset.load(std::memory_order_acquire);
+    if (offset != 0 && matches(theMapping, offset, theKey))
+      return offset;
+  }
+  return 0;
+}
+
+bool SharedCache::matches(const Mapping& theMapping,
+                          std::uint64_t theOffset,
+                          const std::string& theKey) const
+{
+  Record record;
+  if (!read_record(theMapping.address(), theMapping.size(), theOffset, record))
+    return false;
+  return (record.key_size == theKey.size() &&
+          std::memcmp(theMapping.address() + theOffset + sizeof(Record),
+                      theKey.data(),
+                      theKey.size()) == 0);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a geometry
+ *
+ * The table is part of the key, since the cache keys of the engine do
+ * not identify the database.
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<FlatGeometry> SharedCache::find(const std::string& theKey,
+                                                const std::string& theTable)
+{
+  try
+  {
+    const auto key = theTable + '|' + theKey;
+    const auto hash = hash_key(key);
+    const auto mapping = current();
+    const auto offset = lookup(*mapping, key, hash);
+    if (offset == 0)
+    {
+      itsAccounting.miss(theTable);
+      return {};
+    }
+
+    Record record;
+    const char* base = mapping->address();
+    if (!read_record(base, mapping->size(), offset, record))
+      throw Fmi::Exception(BCP, "Corrupted shared cache record");
+
+    const char* data = base + offset + sizeof(Record) + pad(record.key_size);
+    const char* srs = data + pad(record.data_size);
+
+    std::vector<std::shared_ptr<OGRSpatialReference>> spatial_references;
+    std::size_t pos = 0;
+    const auto count = extract(srs, record.srs_size, pos);
+    for (std::uint64_t i = 0; i < count; i++)
+    {
+      const auto strategy = static_cast<int>(extract(srs, record.srs_size, pos));
+      const auto length = extract(srs, record.srs_size, pos);
+      if (length > record.srs_size - pos)
+        throw Fmi::Exception(BCP, "Corrupted shared cache record");
+      spatial_references.push_back(spatialReference(std::string(srs + pos, length), strategy));
+      pos += length;
+    }
+
+    auto ret = std::make_unique<FlatGeometry>(data, record.data_size, spatial_references, mapping);
+    itsAccounting.hit(hash, theTable);
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Share a geometry
+ *
+ * The record is written to freshly allocated space before it is
+ * published in the index. If another process publishes the same key
+ * at the same time, the space of one of the records is wasted. When
+ * the records or the index are full, the file is replaced by an empty
+ * one.
+ */
+// ----------------------------------------------------------------------
+
+bool SharedCache::insert(const std::string& theKey,
+                         const std::string& theTable,
+                         const FlatGeometry& theGeometry)
+{
+  try
+  {
+    // The records of a view are shared already
+    if (theGeometry.isView())
+      return false;
+
+    const auto key = theTable + '|' + theKey;
+    const auto hash = hash_key(key);
+    const auto mapping = current();
+    auto* header = mapping->header();
+    if (lookup(*mapping, key, hash) != 0)
+      return false;
+
+    const auto entries = header->entries.load(std::memory_order_relaxed);
+    if (static_cast<double>(entries) >= max_load_factor * static_cast<double>(header->slots))
+    {
+      reclaim(mapping);
+      return false;
+    }
+
+    // Spatial references as WKT with the axis mapping strategy. Custom axis
+    // mappings are not supported.
+    std::string srs;
+    append(srs, theGeometry.spatialReferences().size());
+    for (const auto* sr : theGeometry.spatialReferences())
+    {
+      const auto strategy = sr->GetAxisMappingStrategy();
+      if (strategy == OAMS_CUSTOM)
+        return false;
+
+      char* wkt = nullptr;
+      const char* const options[] = {"FORMAT=WKT2_2019", nullptr};
+      if (sr->exportToWkt(&wkt, options) != OGRERR_NONE)
+      {
+        CPLFree(wkt);
+        return false;
+      }
+      std::string text(wkt);
+      CPLFree(wkt);
+
+      append(srs, static_cast<std::uint64_t>(strategy));
+      append(srs, text.size());
+      srs += text;
+    }
+
+    const Record record{key.size(), theGeometry.dataSize(), srs.size()};
+    const auto bytes =
+        sizeof(Record) + pad(record.key_size) + pad(record.data_size) + pad(record.srs_size);
+
+    // Geometries larger than the record area are never shared
+    if (bytes > header->size - records())
+      return false;
+
+    // Allocate and write the record. A failed allocation means the file is full.
+    const auto offset = header->used.fetch_add(bytes);
+    if (offset + bytes > header->size)
+    {
+      reclaim(mapping);
+      return false;
+    }
+
+    char* base = mapping->address() + offset;
+    std::memcpy(base, &record, sizeof(Record));
+    base += sizeof(Record);
+    std::memcpy(base, key.data(), key.size());
+    base += pad(record.key_size);
+    std::memcpy(base, theGeometry.data(), theGeometry.dataSize());
+    base += pad(record.data_size);
+    std::memcpy(base, srs.data(), srs.size());
+
+    // Publish the record within the probe limit
+    auto* slots = mapping->slots();
+    const auto count = header->slots;
+    for (std::uint64_t i = 0; i < std::min(count, max_probes); i++)
+    {
+      auto& slot = slots[(hash + i) % count];
+      std::uint64_t current = 0;
+      if (slot.hash.compare_exchange_strong(current, hash, std::memory_order_acq_rel))
+      {
+        slot.offset.store(offset, std::memory_order_release);
+        header->entries.fetch_add(1, std::memory_order_relaxed);
+        itsAccounting.insert(hash, theTable, bytes);
+        return true;
+      }
+
+      if (current == hash)
+      {
+        // Being published or published already by another process
+        const auto existing = slot.offset.load(std::memory_order_acquire);
+        if (existing == 0 || matches(*mapping, existing, key))
+          return false;
+      }
+    }
+
+    // The neighbourhood of the hash is full
+    return false;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Spatial reference parsed from WKT, shared by all the views of this process
+std::shared_ptr<OGRSpatialReference> SharedCache::spatialReference(const std::string& theWKT,
+                                                                   int theStrategy)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    const auto key = Fmi::to_string(theStrategy) + '|' + theWKT;
+    auto pos = itsSpatialReferences.find(key);
+    if (pos != itsSpatialReferences.end())
+      return pos->second;
+
+    std::shared_ptr<OGRSpatialReference> sr(new OGRSpatialReference,
+                                            [](OGRSpatialReference* p) { p->Release(); });
+    if (sr->importFromWkt(theWKT.c_str()) != OGRERR_NONE)
+      throw Fmi::Exception(BCP, "Failed to parse a spatial reference of the shared cache")
+          .addParameter("WKT", theWKT);
+    sr->SetAxisMappingStrategy(static_cast<OSRAxisMappingStrategy>(theStrategy));
+
+    itsSpatialReferences.insert(std::make_pair(key, sr));
+    return sr;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void SharedCache::addRows(Spine::Table& theTable, int& theRow) const
+{
+  itsAccounting.addRows(theTable, theRow);
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
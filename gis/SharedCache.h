@@ -0,0 +1,94 @@
+// ======================================================================
+/*!
+ * \brief Geometry cache shared by the server processes of a node
+ *
+ * The cache is a memory mapped file with a fixed size index and an
+ * append only record area. Records are written first and then
+ * published in an open addressing index with atomic operations, so no
+ * locks are needed and readers never see partially written records.
+ * Readers get views to the records without copying the coordinates.
+ *
+ * Records are never removed individually. The file is emptied when the
+ * first server process starts using it, and it is replaced by an empty
+ * file when the records or 70% of the index slots are used. Processes
+ * switch to the replacement when they notice the retired flag of the
+ * old file, views keep the old file mapped until they are released.
+ * The spatial references are stored as WKT and parsed once per process.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "CacheAccounting.h"
+#include "FlatGeometry.h"
+#include <spine/Table.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class SharedCache
+{
+ public:
+  SharedCache(const std::string& thePath, std::size_t theBytes, std::size_t theSlots);
+
+  SharedCache() = delete;
+  SharedCache(const SharedCache& other) = delete;
+  SharedCache& operator=(const SharedCache& other) = delete;
+
+  // View to a shared geometry, nullptr if there is none
+  std::unique_ptr<FlatGeometry> find(const std::string& theKey, const std::string& theTable);
+
+  // Share a geometry unless it is shared already or the file is full
+  bool insert(const std::string& theKey,
+              const std::string& theTable,
+              const FlatGeometry& theGeometry);
+
+  // Append accounting rows for each table and the total
+  void addRows(Spine::Table& theTable, int& theRow) const;
+
+ private:
+  struct Header;
+  struct Slot;
+  class Mapping;
+
+  std::size_t records() const;
+  std::shared_ptr<const Mapping> map(int theFd) const;
+  void initialize(const Mapping& theMapping) const;
+  std::shared_ptr<const Mapping> current();
+  void reclaim(const std::shared_ptr<const Mapping>& theFull);
+
+  std::uint64_t lookup(const Mapping& theMapping,
+                       const std::string& theKey,
+                       std::uint64_t theHash) const;
+  bool matches(const Mapping& theMapping, std::uint64_t theOffset, const std::string& theKey) const;
+  std::shared_ptr<OGRSpatialReference> spatialReference(const std::string& theWKT,
+                                                        int theStrategy);
+
+  const std::string itsPath;
+  const std::size_t itsBytes;
+  const std::size_t itsSlots;
+
+  // The current file, replaced when it is full
+  std::mutex itsMappingMutex;
+  std::shared_ptr<const Mapping> itsMapping;  // shared with the views
+
+  // Spatial references of the records parsed by this process, by strategy and WKT
+  std::mutex itsMutex;
+  std::map<std::string, std::shared_ptr<OGRSpatialReference>> itsSpatialReferences;
+
+  CacheAccounting itsAccounting{"Gis::shared_geometry_cache"};
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
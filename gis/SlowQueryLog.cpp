@@ -0,0 +1,173 @@
+#include "SlowQueryLog.h"
+#include <boost/algorithm/string/join.hpp>
+#include <fmt/format.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <iostream>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+double milliseconds(QueryTrace::Clock::duration theDuration)
+{
+  return std::chrono::duration<double, std::milli>(theDuration).count();
+}
+}  // namespace
+
+QueryTrace::QueryTrace(std::string theOperation, std::string thePGName, std::string theTable)
+    : itsOperation(std::move(theOperation)),
+      itsPGName(std::move(thePGName)),
+      itsTable(std::move(theTable)),
+      itsStartTime(Clock::now())
+{
+}
+
+void QueryTrace::addQuery(std::string theQuery)
+{
+  itsQueries.push_back(std::move(theQuery));
+}
+
+void QueryTrace::addStage(std::string theStage, Clock::duration theDuration)
+{
+  itsStages.emplace_back(std::move(theStage), theDuration);
+}
+
+SlowQueryLog::SlowQueryLog(std::map<std::string, int> theThresholds, std::size_t theHistorySize)
+    : itsThresholds(std::move(theThresholds)), itsHistorySize(theHistorySize)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Log the trace if the operation was slower than its threshold
+ */
+// ----------------------------------------------------------------------
+
+void SlowQueryLog::check(const QueryTrace& theTrace)
+{
+  try
+  {
+    auto pos = itsThresholds.find(theTrace.itsOperation);
+    if (pos == itsThresholds.end())
+      return;
+
+    const auto elapsed = milliseconds(theTrace.elapsed());
+    if (elapsed < pos->second)
+      return;
+
+    Entry entry;
+    entry.time = Fmi::SecondClock::universal_time();
+    entry.elapsed = elapsed;
+    entry.wait = milliseconds(theTrace.itsWait);
+    entry.operation = theTrace.itsOperation;
+    entry.pgname = theTrace.itsPGName;
+    entry.table = theTrace.itsTable;
+    entry.rows = theTrace.itsRows;
+    entry.failed = theTrace.itsFailed;
+
+    std::vector<std::string> stages;
+    for (const auto& stage : theTrace.itsStages)
+      stages.push_back(fmt::format("{}={:.3f}", stage.first, milliseconds(stage.second)));
+    entry.stages = boost::algorithm::join(stages, " ");
+    entry.queries = boost::algorithm::join(theTrace.itsQueries, "; ");
+
+    std::cerr << fmt::format(
+        "{} GIS engine slow {}{}: {:.3f} ms pgname={} table={} rows={} wait={:.3f} ms stages: {} "
+        "queries: {}\n",
+        Fmi::to_iso_extended_string(entry.time),
+        entry.operation,
+        entry.failed ? " (failed)" : "",
+        entry.elapsed,
+        entry.pgname,
+        entry.table,
+        entry.rows,
+        entry.wait,
+        entry.stages,
+        entry.queries);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsHistory.push_back(std::move(entry));
+    while (itsHistory.size() > itsHistorySize)
+      itsHistory.pop_front();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// The check must not throw while an exception is propagating
+QueryFailureCheck::~QueryFailureCheck()
+{
+  if (std::uncaught_exceptions() <= itsExceptions)
+    return;
+
+  try
+  {
+    itsTrace.setFailed();
+    itsLog.check(itsTrace);
+  }
+  catch (...)
+  {
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Recent slow operations, the latest first
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<Spine::Table> SlowQueryLog::table() const
+{
+  try
+  {
+    auto ret = std::make_unique<Spine::Table>();
+
+    ret->setTitle("GIS Engine Slow Queries");
+    ret->setNames({"Time",
+                   "Operation",
+                   "PGName",
+                   "Table",
+                   "ElapsedMs",
+                   "WaitMs",
+                   "Rows",
+                   "Status",
+                   "Stages",
+                   "Queries"});
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    int row = 0;
+    for (auto it = itsHistory.rbegin(); it != itsHistory.rend(); ++it)
+    {
+      int col = 0;
+      ret->set(col++, row, Fmi::to_iso_extended_string(it->time));
+      ret->set(col++, row, it->operation);
+      ret->set(col++, row, it->pgname);
+      ret->set(col++, row, it->table);
+      ret->set(col++, row, fmt::format("{:.3f}", it->elapsed));
+      ret->set(col++, row, fmt::format("{:.3f}", it->wait));
+      ret->set(col++, row, Fmi::to_string(it->rows));
+      ret->set(col++, row, it->failed ? "failed" : "ok");
+      ret->set(col++, row, it->stages);
+      ret->set(col++, row, it->queries);
+      ++row;
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,128 @@
+// ======================================================================
+/*!
+ * \brief Log of slow database operations
+ *
+ * Each operation type (shape, features, metadata) has its own threshold.
+ * A trace of the queries, rows and stage durations is collected while an
+ * operation is processed. If the operation is slower than its threshold,
+ * the trace is printed and kept in a short history for status queries.
+ * Operations which fail with an exception, for example due to a statement
+ * timeout, are checked too and marked as failed.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/DateTime.h>
+#include <spine/Table.h>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class QueryTrace
+{
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  QueryTrace(std::string theOperation, std::string thePGName, std::string theTable);
+
+  QueryTrace() = delete;
+
+  void addQuery(std::string theQuery);
+  void addStage(std::string theStage, Clock::duration theDuration);
+  void addRows(std::size_t theRows) { itsRows += theRows; }
+
+  // Time spent waiting for the same data to be computed by another request
+  void addWait(Clock::duration theDuration) { itsWait += theDuration; }
+
+  void setFailed() { itsFailed = true; }
+
+  const std::string& operation() const { return itsOperation; }
+  Clock::duration elapsed() const { return Clock::now() - itsStartTime; }
+
+ private:
+  friend class SlowQueryLog;
+
+  std::string itsOperation;
+  std::string itsPGName;
+  std::string itsTable;
+  Clock::time_point itsStartTime;
+  std::vector<std::string> itsQueries;
+  std::vector<std::pair<std::string, Clock::duration>> itsStages;
+  std::size_t itsRows = 0;
+  Clock::duration itsWait{0};
+  bool itsFailed = false;
+};
+
+class SlowQueryLog
+{
+ public:
+  // thresholds in milliseconds per operation, other operations are not logged
+  SlowQueryLog(std::map<std::string, int> theThresholds, std::size_t theHistorySize);
+
+  SlowQueryLog() = delete;
+
+  bool enabled() const { return !itsThresholds.empty(); }
+
+  // Log the trace if the operation has been too slow
+  void check(const QueryTrace& theTrace);
+
+  std::unique_ptr<Spine::Table> table() const;
+
+ private:
+  struct Entry
+  {
+    Fmi::DateTime time;
+    double elapsed;  // milliseconds
+    double wait;     // milliseconds
+    std::string operation;
+    std::string pgname;
+    std::string table;
+    std::size_t rows;
+    bool failed;
+    std::string stages;
+    std::string queries;
+  };
+
+  const std::map<std::string, int> itsThresholds;
+  const std::size_t itsHistorySize;
+
+  mutable std::mutex itsMutex;
+  std::deque<Entry> itsHistory;
+};
+
+// Checks the trace as failed if the operation exits with an exception
+class QueryFailureCheck
+{
+ public:
+  QueryFailureCheck(SlowQueryLog& theLog, QueryTrace& theTrace)
+      : itsLog(theLog), itsTrace(theTrace), itsExceptions(std::uncaught_exceptions())
+  {
+  }
+  ~QueryFailureCheck();
+
+  QueryFailureCheck() = delete;
+  QueryFailureCheck(const QueryFailureCheck& other) = delete;
+  QueryFailureCheck& operator=(const QueryFailureCheck& other) = delete;
+
+ private:
+  SlowQueryLog& itsLog;
+  QueryTrace& itsTrace;
+  int itsExceptions;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
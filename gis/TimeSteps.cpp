@@ -0,0 +1,375 @@
+#include "TimeSteps.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+namespace
+{
+const Fmi::DateTime epoch(Fmi::Date(1970, 1, 1));
+}
+
+std::int64_t TimeSteps::to_seconds(const Fmi::DateTime& theTime)
+{
+  return (theTime - epoch).total_seconds();
+}
+
+Fmi::DateTime TimeSteps::from_seconds(std::int64_t theSeconds)
+{
+  return epoch + Fmi::Seconds(theSeconds);
+}
+
+Fmi::DateTime TimeSteps::const_iterator::operator*() const
+{
+  const auto& run = itsTimeSteps->itsRuns[itsRun];
+  const auto pos = itsIndex - itsTimeSteps->itsOffsets[itsRun];
+  return from_seconds(run.start + run.step * static_cast<std::int64_t>(pos));
+}
+
+TimeSteps::const_iterator& TimeSteps::const_iterator::operator++()
+{
+  ++itsIndex;
+  const auto& runs = itsTimeSteps->itsRuns;
+  if (itsRun < runs.size() && itsIndex - itsTimeSteps->itsOffsets[itsRun] >= runs[itsRun].count)
+    ++itsRun;
+  return *this;
+}
+
+TimeSteps::const_iterator TimeSteps::const_iterator::operator++(int)
+{
+  auto tmp = *this;
+  ++(*this);
+  return tmp;
+}
+
+TimeSteps::const_iterator& TimeSteps::const_iterator::operator--()
+{
+  --itsIndex;
+  if (itsRun >= itsTimeSteps->itsRuns.size() || itsIndex < itsTimeSteps->itsOffsets[itsRun])
+    --itsRun;
+  return *this;
+}
+
+TimeSteps::const_iterator TimeSteps::const_iterator::operator--(int)
+{
+  auto tmp = *this;
+  --(*this);
+  return tmp;
+}
+
+TimeSteps::const_iterator& TimeSteps::const_iterator::operator+=(difference_type n)
+{
+  itsIndex = static_cast<std::size_t>(static_cast<difference_type>(itsIndex) + n);
+  itsRun = itsTimeSteps->run_of(itsIndex);
+  return *this;
+}
+
+TimeSteps::TimeSteps(const std::vector<Fmi::DateTime>& theTimes)
+{
+  for (const auto& t : theTimes)
+    push_back(t);
+}
+
+void TimeSteps::clear()
+{
+  itsRuns.clear();
+  itsOffsets.clear();
+  itsSize = 0;
+}
+
+void TimeSteps::push_back(const Fmi::DateTime& theTime)
+{
+  try
+  {
+    append(to_seconds(theTime));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("Time", Fmi::to_iso_string(theTime));
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append a time, extending the last run when possible
+ *
+ * A run of two times is split if the third time does not continue it,
+ * so that a regular sequence following an irregular time is not broken
+ * into pairs. Repeated times are ignored, they may be produced by rounding
+ * sub-second times.
+ */
+// ----------------------------------------------------------------------
+
+void TimeSteps::append(std::int64_t theTime)
+{
+  if (itsRuns.empty())
+  {
+    itsRuns.push_back(Run{theTime, 0, 1});
+    itsOffsets.push_back(0);
+    itsSize = 1;
+    return;
+  }
+
+  auto& last = itsRuns.back();
+  const auto last_time = last.start + last.step * static_cast<std::int64_t>(last.count - 1);
+
+  if (theTime == last_time)
+    return;
+
+  if (theTime < last_time)
+    throw Fmi::Exception(BCP, "Times must be added in increasing order");
+
+  if (last.count == 1)
+  {
+    last.step = theTime - last.start;
+    last.count = 2;
+  }
+  else if (theTime == last_time + last.step)
+  {
+    ++last.count;
+  }
+  else if (last.count == 2)
+  {
+    last.step = 0;
+    last.count = 1;
+    itsRuns.push_back(Run{last_time, theTime - last_time, 2});
+    itsOffsets.push_back(itsSize - 1);
+  }
+  else
+  {
+    itsRuns.push_back(Run{theTime, 0, 1});
+    itsOffsets.push_back(itsSize);
+  }
+
+  ++itsSize;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append a run of times following the current ones
+ *
+ * Short runs are appended time by time so that they may be merged with
+ * the previous run as usual.
+ */
+// ----------------------------------------------------------------------
+
+void TimeSteps::append_run(std::int64_t theStart, std::int64_t theStep, std::size_t theCount)
+{
+  if (theCount < 3 || theStep <= 0)
+  {
+    for (std::size_t k = 0; k < theCount; k++)
+      append(theStart + theStep * static_cast<std::int64_t>(k));
+    return;
+  }
+
+  if (!itsRuns.empty())
+  {
+    const auto& last = itsRuns.back();
+    const auto last_time = last.start + last.step * static_cast<std::int64_t>(last.count - 1);
+    if (theStart <= last_time)
+      throw Fmi::Exception(BCP, "Times must be added in increasing order");
+  }
+
+  itsRuns.push_back(Run{theStart, theStep, theCount});
+  itsOffsets.push_back(itsSize);
+  itsSize += theCount;
+}
+
+Fmi::DateTime TimeSteps::front() const
+{
+  if (empty())
+    throw Fmi::Exception(BCP, "Attempt to access first time of empty timesteps");
+  return from_seconds(itsRuns.front().start);
+}
+
+Fmi::DateTime TimeSteps::back() const
+{
+  if (empty())
+    throw Fmi::Exception(BCP, "Attempt to access last time of empty timesteps");
+  const auto& last = itsRuns.back();
+  return from_seconds(last.start + last.step * static_cast<std::int64_t>(last.count - 1));
+}
+
+Fmi::DateTime TimeSteps::operator[](std::size_t theIndex) const
+{
+  if (theIndex >= itsSize)
+    throw Fmi::Exception(BCP, "Timestep index out of range")
+        .addParameter("Index", Fmi::to_string(theIndex))
+        .addParameter("Size", Fmi::to_string(itsSize));
+
+  const auto i = run_of(theIndex);
+  const auto& run = itsRuns[i];
+  return from_seconds(run.start + run.step * static_cast<std::int64_t>(theIndex - itsOffsets[i]));
+}
+
+// Index of the run containing the time with the given index, the number of runs past the end
+std::size_t TimeSteps::run_of(std::size_t theIndex) const
+{
+  if (theIndex >= itsSize)
+    return itsRuns.size();
+  auto pos = std::upper_bound(itsOffsets.begin(), itsOffsets.end(), theIndex);
+  return static_cast<std::size_t>(pos - itsOffsets.begin()) - 1;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Index of the last run starting at or before the time
+ *
+ * Returns the number of runs if there is no such run.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t TimeSteps::find_run(std::int64_t theTime) const
+{
+  auto pos = std::upper_bound(itsRuns.begin(),
+                              itsRuns.end(),
+                              theTime,
+                              [](std::int64_t t, const Run& run) { return t < run.start; });
+  if (pos == itsRuns.begin())
+    return itsRuns.size();
+  return static_cast<std::size_t>(pos - itsRuns.begin()) - 1;
+}
+
+bool TimeSteps::contains(const Fmi::DateTime& theTime) const
+{
+  try
+  {
+    const auto t = to_seconds(theTime);
+    const auto i = find_run(t);
+    if (i >= itsRuns.size())
+      return false;
+
+    const auto& run = itsRuns[i];
+    const auto offset = t - run.start;
+    if (offset == 0)
+      return true;
+    if (run.step == 0 || offset % run.step != 0)
+      return false;
+    return static_cast<std::size_t>(offset / run.step) < run.count;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract the times within the given inclusive limits
+ */
+// ----------------------------------------------------------------------
+
+TimeSteps TimeSteps::slice(const std::optional<Fmi::DateTime>& theStartTime,
+                           const std::optional<Fmi::DateTime>& theEndTime) const
+{
+  try
+  {
+    TimeSteps ret;
+
+    const auto t1 = (theStartTime ? to_seconds(*theStartTime) : INT64_MIN);
+    const auto t2 = (theEndTime ? to_seconds(*theEndTime) : INT64_MAX);
+    if (t1 > t2)
+      return ret;
+
+    for (const auto& run : itsRuns)
+    {
+      const auto count = static_cast<std::int64_t>(run.count);
+      const auto last = run.start + run.step * (count - 1);
+      if (last < t1)
+        continue;
+      if (run.start > t2)
+        break;
+
+      // Index range of the run within the limits
+      std::int64_t k1 = 0;
+      std::int64_t k2 = count - 1;
+      if (run.step > 0)
+      {
+        if (run.start < t1)
+          k1 = (t1 - run.start + run.step - 1) / run.step;
+        if (last > t2)
+          k2 = (t2 - run.start) / run.step;
+      }
+
+      // The limits may fall between two consecutive times of the run
+      if (k2 < k1)
+        continue;
+
+      ret.append_run(run.start + k1 * run.step, run.step, static_cast<std::size_t>(k2 - k1 + 1));
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The time closest to the given one, earlier one if there is a tie
+ */
+// ----------------------------------------------------------------------
+
+std::optional<Fmi::DateTime> TimeSteps::nearest(const Fmi::DateTime& theTime) const
+{
+  try
+  {
+    if (empty())
+      return {};
+
+    const auto t = to_seconds(theTime);
+    const auto i = find_run(t);
+    if (i >= itsRuns.size())
+      return from_seconds(itsRuns.front().start);
+
+    // Closest time in the run, the time cannot be before the run start
+    const auto& run = itsRuns[i];
+    std::int64_t best = run.start;
+    if (run.step > 0)
+    {
+      auto k = (t - run.start + run.step / 2) / run.step;
+      k = std::min<std::int64_t>(k, static_cast<std::int64_t>(run.count) - 1);
+      best = run.start + k * run.step;
+      // Rounding up on a tie must be undone to prefer the earlier time
+      if (best > t && best - t == t - (best - run.step))
+        best -= run.step;
+    }
+
+    // The next run may start closer
+    if (i + 1 < itsRuns.size())
+    {
+      const auto next = itsRuns[i + 1].start;
+      if (next - t < std::abs(t - best))
+        best = next;
+    }
+
+    return from_seconds(best);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::vector<Fmi::DateTime> TimeSteps::expand() const
+{
+  std::vector<Fmi::DateTime> ret;
+  ret.reserve(itsSize);
+  for (const auto& t : *this)
+    ret.push_back(t);
+  return ret;
+}
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
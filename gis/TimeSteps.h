@@ -0,0 +1,138 @@
+// ======================================================================
+/*!
+ * \brief Run-length compressed list of increasing times
+ *
+ * Tables with regularly spaced times may contain hundreds of thousands
+ * of distinct times. They are stored here as runs of (start, step, count)
+ * with irregular times as runs of length one. Times are stored at one
+ * second resolution, which is the resolution used by the database queries.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/DateTime.h>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Gis
+{
+class TimeSteps
+{
+ public:
+  struct Run
+  {
+    std::int64_t start;  // seconds since epoch
+    std::int64_t step;   // seconds, zero for single times
+    std::size_t count;
+  };
+
+  // Random access iterator generating the times, hence the reference is a value
+  class const_iterator
+  {
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = Fmi::DateTime;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Fmi::DateTime*;
+    using reference = Fmi::DateTime;
+
+    const_iterator() = default;
+    const_iterator(const TimeSteps* theTimeSteps, std::size_t theIndex, std::size_t theRun)
+        : itsTimeSteps(theTimeSteps), itsIndex(theIndex), itsRun(theRun)
+    {
+    }
+
+    Fmi::DateTime operator*() const;
+    Fmi::DateTime operator[](difference_type n) const { return *(*this + n); }
+
+    const_iterator& operator++();
+    const_iterator operator++(int);
+    const_iterator& operator--();
+    const_iterator operator--(int);
+    const_iterator& operator+=(difference_type n);
+    const_iterator& operator-=(difference_type n) { return *this += -n; }
+
+    const_iterator operator+(difference_type n) const
+    {
+      auto tmp = *this;
+      return tmp += n;
+    }
+    const_iterator operator-(difference_type n) const
+    {
+      auto tmp = *this;
+      return tmp -= n;
+    }
+    difference_type operator-(const const_iterator& other) const
+    {
+      return static_cast<difference_type>(itsIndex) - static_cast<difference_type>(other.itsIndex);
+    }
+
+    bool operator==(const const_iterator& other) const { return itsIndex == other.itsIndex; }
+    bool operator!=(const const_iterator& other) const { return itsIndex != other.itsIndex; }
+    bool operator<(const const_iterator& other) const { return itsIndex < other.itsIndex; }
+    bool operator>(const const_iterator& other) const { return itsIndex > other.itsIndex; }
+    bool operator<=(const const_iterator& other) const { return itsIndex <= other.itsIndex; }
+    bool operator>=(const const_iterator& other) const { return itsIndex >= other.itsIndex; }
+
+   private:
+    const TimeSteps* itsTimeSteps = nullptr;
+    std::size_t itsIndex = 0;
+    std::size_t itsRun = 0;  // run containing the index
+  };
+
+  using value_type = Fmi::DateTime;
+  using size_type = std::size_t;
+
+  TimeSteps() = default;
+  explicit TimeSteps(const std::vector<Fmi::DateTime>& theTimes);
+
+  // Times must be added in increasing order, repeated times are ignored
+  void push_back(const Fmi::DateTime& theTime);
+  void clear();
+
+  bool empty() const { return itsSize == 0; }
+  std::size_t size() const { return itsSize; }
+
+  Fmi::DateTime front() const;
+  Fmi::DateTime back() const;
+  Fmi::DateTime operator[](std::size_t theIndex) const;
+  Fmi::DateTime at(std::size_t theIndex) const { return (*this)[theIndex]; }
+
+  const_iterator begin() const { return {this, 0, 0}; }
+  const_iterator end() const { return {this, itsSize, itsRuns.size()}; }
+
+  bool contains(const Fmi::DateTime& theTime) const;
+  TimeSteps slice(const std::optional<Fmi::DateTime>& theStartTime,
+                  const std::optional<Fmi::DateTime>& theEndTime) const;
+  std::optional<Fmi::DateTime> nearest(const Fmi::DateTime& theTime) const;
+
+  const std::vector<Run>& runs() const { return itsRuns; }
+  std::vector<Fmi::DateTime> expand() const;
+
+  // Implicit for code written when the metadata held the times in a vector
+  operator std::vector<Fmi::DateTime>() const { return expand(); }
+
+  static std::int64_t to_seconds(const Fmi::DateTime& theTime);
+  static Fmi::DateTime from_seconds(std::int64_t theSeconds);
+
+ private:
+  void append(std::int64_t theTime);
+  void append_run(std::int64_t theStart, std::int64_t theStep, std::size_t theCount);
+  std::size_t find_run(std::int64_t theTime) const;
+  std::size_t run_of(std::size_t theIndex) const;
+
+  std::vector<Run> itsRuns;
+  std::vector<std::size_t> itsOffsets;  // index of the first time of each run
+  std::size_t itsSize = 0;
+};
+
+}  // namespace Gis
+}  // namespace Engine
+}  // namespace SmartMet
@@ -3,8 +3,8 @@
 %define SPECNAME smartmet-engine-%{DIRNAME}
 Summary: SmartMet GIS engine
 Name: %{SPECNAME}
-Version: 26.5.8
-Release: 2%{?dist}.fmi
+Version: 26.10.18
+Release: 1%{?dist}.fmi
 License: MIT
 Group: SmartMet/Engines
 URL: https://github.com/fmidev/smartmet-engine-gis
@@ -104,6 +104,9 @@ rm -rf $RPM_BUILD_ROOT
 %{_includedir}/smartmet/engines/%{DIRNAME}/*.h
 
 %changelog
+* Sun Oct 18 2026 agent <agent@local> - 26.10.18-1.fmi
+- API change: MetaData::timesteps is a run-length compressed TimeSteps instead of std::vector<Fmi::DateTime>. It converts implicitly to a vector and has random access iterators, but plugins reading the metadata must be rebuilt
+
 * Fri May  8 2026 Mika Heiskanen <mika.heiskanen@fmi.fi> - 26.5.8-2.fmi
 - Fixed simplify() in the map fetch pipeline: newfeature was a default-constructed (null) shared_ptr, so the minarea branch dereferenced a null pointer and the no-options path silently dropped every feature. Now passes through the original feature when no minarea/mindistance/simplifier work is requested, otherwise allocates a private Feature copy before mutating geom (requires smartmet-library-gis >= 26.5.8-2 for GeometrySimplifier::active()).
 
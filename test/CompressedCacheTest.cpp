@@ -0,0 +1,172 @@
+#include "CompressedCache.h"
+#include "FlatGeometry.h"
+#include <macgyver/StringConversion.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::CompressedCache;
+using SmartMet::Engine::Gis::FlatGeometry;
+
+namespace Tests
+{
+const string table = "test.table";
+
+// A polygon with a hole, a 3D linestring and an empty slot
+vector<OGRGeometryPtr> geometries()
+{
+  auto* polygon = new OGRPolygon;
+  auto* shell = new OGRLinearRing;
+  auto* hole = new OGRLinearRing;
+  for (int i = 0; i <= 1000; i++)
+  {
+    const double angle = 2 * M_PI * i / 1000;
+    shell->addPoint(25 + 5 * cos(angle), 60 + 3 * sin(angle));
+    hole->addPoint(25 + cos(angle), 60 + 0.5 * sin(angle));
+  }
+  polygon->addRingDirectly(shell);
+  polygon->addRingDirectly(hole);
+
+  auto* line = new OGRLineString;
+  for (int i = 0; i < 500; i++)
+    line->addPoint(0.001 * i, 0.002 * i, 10.0 * i);
+
+  return {OGRGeometryPtr(polygon), OGRGeometryPtr(line), OGRGeometryPtr()};
+}
+
+// Compare the geometry structure and the coordinates
+string compare(const FlatGeometry& theExpected, const FlatGeometry& theResult)
+{
+  if (theResult.size() != theExpected.size())
+    return "Geometry count differs";
+  if (theResult.numParts() != theExpected.numParts())
+    return "Part count differs";
+  if (theResult.numPoints() != theExpected.numPoints())
+    return "Point count differs";
+
+  for (std::size_t i = 0; i < theExpected.size(); i++)
+    if (theResult.firstPart(i) != theExpected.firstPart(i) ||
+        theResult.endPart(i) != theExpected.endPart(i))
+      return "Parts of geometry " + Fmi::to_string(i) + " differ";
+
+  for (std::size_t i = 0; i < theExpected.numParts(); i++)
+  {
+    const auto expected = theExpected.part(i);
+    const auto result = theResult.part(i);
+    if (result.points != expected.points || (result.z == nullptr) != (expected.z == nullptr))
+      return "Part " + Fmi::to_string(i) + " differs";
+    for (std::size_t j = 0; j < expected.points; j++)
+      if (result.xy[2 * j] != expected.xy[2 * j] ||
+          result.xy[2 * j + 1] != expected.xy[2 * j + 1] ||
+          (expected.z && result.z[j] != expected.z[j]))
+        return "Point " + Fmi::to_string(j) + " of part " + Fmi::to_string(i) + " differs";
+  }
+  return {};
+}
+
+// Demotion happens in the background, wait for it
+std::unique_ptr<FlatGeometry> take(CompressedCache& theCache, const string& theKey)
+{
+  for (int i = 0; i < 500; i++)
+  {
+    auto ret = theCache.take(theKey, table);
+    if (ret)
+      return ret;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return {};
+}
+
+// ----------------------------------------------------------------------
+
+void roundtrip()
+{
+  auto cache = std::make_shared<CompressedCache>(100 * 1024 * 1024, 0);
+
+  const auto input = geometries();
+  const FlatGeometry expected(input);
+
+  auto shared = cache->manage("key", table, std::make_unique<FlatGeometry>(input));
+  if (!shared)
+    TEST_FAILED("manage() returned nothing");
+  if (cache->take("key", table))
+    TEST_FAILED("Geometry in use was found from the compressed tier");
+
+  // The last reference demotes the geometry
+  shared.reset();
+  auto result = take(*cache, "key");
+  if (!result)
+    TEST_FAILED("Released geometry was not demoted");
+
+  auto error = compare(expected, *result);
+  if (!error.empty())
+    TEST_FAILED(error);
+
+  if (result->geometry(2))
+    TEST_FAILED("Empty slot was not restored");
+  const auto* polygon = dynamic_cast<const OGRPolygon*>(result->geometry(0).get());
+  if (!polygon || polygon->getNumInteriorRings() != 1)
+    TEST_FAILED("Restored polygon differs");
+
+  // The entry is promoted out of the tier
+  if (cache->take("key", table))
+    TEST_FAILED("Taken geometry was still in the compressed tier");
+
+  cache->shutdown();
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void minimum()
+{
+  const FlatGeometry large(geometries());
+  auto cache = std::make_shared<CompressedCache>(100 * 1024 * 1024, large.bytes() / 2);
+
+  // Small geometries are shared as is and are not demoted
+  OGRGeometryPtr point(new OGRPoint(25, 60));
+  cache->manage("small", table, std::make_unique<FlatGeometry>(point)).reset();
+  cache->manage("large", table, std::make_unique<FlatGeometry>(geometries())).reset();
+
+  // Demotions are done in order, hence the small one would be there by now
+  if (!take(*cache, "large"))
+    TEST_FAILED("Large geometry was not demoted");
+  if (cache->take("small", table))
+    TEST_FAILED("Small geometry was demoted");
+
+  cache->shutdown();
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+// Test driver
+class tests : public tframe::tests
+{
+  // Overridden message separator
+  virtual const char *error_message_prefix() const { return "\n\t"; }
+  // Main test suite
+  void test()
+  {
+    TEST(roundtrip);
+    TEST(minimum);
+  }
+};  // class tests
+
+}  // namespace Tests
+
+int main(void)
+{
+  cout << endl
+       << "CompressedCache tester\n"
+          "======================"
+       << endl;
+  Tests::tests t;
+  return t.run();
+}
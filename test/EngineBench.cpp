@@ -0,0 +1,379 @@
+// ======================================================================
+/*!
+ * \brief Throughput and latency benchmarks for the GIS engine
+ *
+ * Generates synthetic polygon, line and point layers into a local
+ * throwaway PostGIS database and measures cold and warm latencies of
+ * the main engine calls under concurrent load. Results are written as
+ * JSON so that regressions can be tracked.
+ *
+ * Run with "make bench", see the Makefile for the settings.
+ */
+// ======================================================================
+
+#include "Config.h"
+#include "Engine.h"
+#include <gis/Host.h>
+#include <macgyver/DateTime.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <spine/Reactor.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cpl_error.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::Engine;
+
+namespace
+{
+struct Options
+{
+  string reactor_config = "cnf/bench-reactor.conf";
+  string gis_config = "cnf/bench.conf";
+  size_t size = 10000;   // rows per layer
+  size_t calls = 200;    // calls per benchmark
+  unsigned threads = 8;  // concurrent threads
+  string output;         // JSON output file, stdout if empty
+  bool generate = true;  // generate the data
+};
+
+struct Result
+{
+  string name;
+  string mode;
+  unsigned threads = 0;
+  size_t calls = 0;
+  double seconds = 0;
+  vector<double> latencies;  // milliseconds
+};
+
+Options parse_options(int argc, char* argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    auto value = [&]() -> string
+    {
+      if (i + 1 >= argc)
+        throw runtime_error("Option " + arg + " requires a value");
+      return argv[++i];
+    };
+
+    if (arg == "--reactor-config")
+      options.reactor_config = value();
+    else if (arg == "--gis-config")
+      options.gis_config = value();
+    else if (arg == "--size")
+      options.size = stoul(value());
+    else if (arg == "--calls")
+      options.calls = stoul(value());
+    else if (arg == "--threads")
+      options.threads = stoul(value());
+    else if (arg == "--output")
+      options.output = value();
+    else if (arg == "--no-generate")
+      options.generate = false;
+    else
+      throw runtime_error("Unknown option " + arg);
+  }
+  if (options.threads < 1)
+    throw runtime_error("Thread count must be positive");
+  return options;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the synthetic layers into schema 'bench'
+ */
+// ----------------------------------------------------------------------
+
+void generate_data(const Options& options)
+{
+  SmartMet::Engine::Gis::Config config(options.gis_config);
+  const auto& pgci = config.getPostGISConnectionInfo("");
+  Fmi::Host host(pgci.host, pgci.database, pgci.username, pgci.password, pgci.port);
+  auto connection = host.connect();
+
+  const auto n = Fmi::to_string(options.size);
+
+  const vector<string> statements = {
+      "DROP SCHEMA IF EXISTS bench CASCADE",
+      "CREATE SCHEMA bench",
+      "SELECT setseed(0.5)",
+      // Small polygons around Finland
+      "CREATE TABLE bench.polygons AS SELECT i AS id, 'polygon' || i AS name, "
+      "now() - (i % 288) * interval '5 minutes' AS valid_time, "
+      "ST_Buffer(ST_SetSRID(ST_MakePoint(20 + 12 * random(), 59 + 11 * random()), 4326), "
+      "0.01 + 0.05 * random(), 'quad_segs=8') AS geom FROM generate_series(1," +
+          n + ") AS i",
+      // Segmented lines of varying length
+      "CREATE TABLE bench.lines AS SELECT i AS id, 'line' || i AS name, "
+      "ST_Segmentize(ST_MakeLine(ST_SetSRID(ST_MakePoint(x, y), 4326), "
+      "ST_SetSRID(ST_MakePoint(x + random() - 0.5, y + random() - 0.5), 4326)), 0.01) AS geom "
+      "FROM (SELECT i, 20 + 12 * random() AS x, 59 + 11 * random() AS y "
+      "FROM generate_series(1," +
+          n + ") AS i) AS t",
+      // Named points
+      "CREATE TABLE bench.points AS SELECT i AS id, 'point' || i AS name, "
+      "ST_SetSRID(ST_MakePoint(20 + 12 * random(), 59 + 11 * random()), 4326) AS geom "
+      "FROM generate_series(1," +
+          n + ") AS i",
+      "CREATE INDEX ON bench.polygons USING GIST(geom)",
+      "CREATE INDEX ON bench.polygons(valid_time)",
+      "CREATE INDEX ON bench.lines USING GIST(geom)",
+      "CREATE INDEX ON bench.points USING GIST(geom)",
+      "ANALYZE bench.polygons",
+      "ANALYZE bench.lines",
+      "ANALYZE bench.points"};
+
+  for (const auto& sql : statements)
+  {
+    CPLErrorReset();
+    auto* layer = connection->ExecuteSQL(sql.c_str(), nullptr, nullptr);
+    if (layer != nullptr)
+      connection->ReleaseResultSet(layer);
+    if (CPLGetLastErrorType() == CE_Failure)
+      throw runtime_error("Failed to execute '" + sql + "': " + CPLGetLastErrorMsg());
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run the function the given number of times using N threads
+ */
+// ----------------------------------------------------------------------
+
+Result run(const string& name,
+           const string& mode,
+           unsigned threads,
+           size_t calls,
+           const function<void(size_t)>& fn)
+{
+  Result result;
+  result.name = name;
+  result.mode = mode;
+  result.threads = threads;
+  result.calls = calls;
+
+  atomic<size_t> next{0};
+  vector<vector<double>> latencies(threads);
+  vector<thread> workers;
+
+  const auto start = chrono::steady_clock::now();
+
+  for (unsigned t = 0; t < threads; t++)
+    workers.emplace_back(
+        [&, t]()
+        {
+          size_t i = 0;
+          while ((i = next++) < calls)
+          {
+            const auto t1 = chrono::steady_clock::now();
+            fn(i);
+            const auto t2 = chrono::steady_clock::now();
+            latencies[t].push_back(chrono::duration<double, milli>(t2 - t1).count());
+          }
+        });
+
+  for (auto& worker : workers)
+    worker.join();
+
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  for (const auto& v : latencies)
+    result.latencies.insert(result.latencies.end(), v.begin(), v.end());
+  sort(result.latencies.begin(), result.latencies.end());
+
+  return result;
+}
+
+double percentile(const vector<double>& sorted, double fraction)
+{
+  if (sorted.empty())
+    return 0;
+  auto pos = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[pos];
+}
+
+string to_json(const vector<Result>& results, const Options& options)
+{
+  ostringstream out;
+  out << "{\n  \"size\": " << options.size << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const auto& r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << r.name << "\", \"mode\": \"" << r.mode
+        << "\", \"threads\": " << r.threads << ", \"calls\": " << r.calls
+        << ", \"seconds\": " << r.seconds
+        << ", \"throughput\": " << (r.seconds > 0 ? r.calls / r.seconds : 0.0)
+        << ", \"p50_ms\": " << percentile(r.latencies, 0.5)
+        << ", \"p90_ms\": " << percentile(r.latencies, 0.9)
+        << ", \"p99_ms\": " << percentile(r.latencies, 0.99)
+        << ", \"max_ms\": " << (r.latencies.empty() ? 0.0 : r.latencies.back()) << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+SmartMet::Engine::Gis::MapOptions map_options(const string& table)
+{
+  SmartMet::Engine::Gis::MapOptions options;
+  options.schema = "bench";
+  options.table = table;
+  return options;
+}
+
+SmartMet::Engine::Gis::MetaDataQueryOptions metadata_options()
+{
+  SmartMet::Engine::Gis::MetaDataQueryOptions options;
+  options.schema = "bench";
+  options.table = "polygons";
+  options.geometry_column = "geom";
+  options.time_column = "valid_time";
+  return options;
+}
+
+vector<Result> run_benchmarks(Engine& engine, const Options& options)
+{
+  vector<Result> results;
+
+  // Unique where-clauses and time ranges defeat the caches for cold runs
+  atomic<size_t> unique{0};
+
+  Fmi::SpatialReference wgs84("WGS84");
+
+  for (const string table : {"polygons", "lines", "points"})
+  {
+    auto warm = map_options(table);
+    engine.getShape(&wgs84, warm);
+    engine.getFeatures(wgs84, warm);
+
+    results.push_back(run("getShape:" + table,
+                          "cold",
+                          options.threads,
+                          options.calls,
+                          [&](size_t)
+                          {
+                            auto mo = map_options(table);
+                            mo.where = "id <> " + Fmi::to_string(++unique);
+                            engine.getShape(&wgs84, mo);
+                          }));
+
+    results.push_back(run("getShape:" + table,
+                          "warm",
+                          options.threads,
+                          options.calls,
+                          [&](size_t) { engine.getShape(&wgs84, warm); }));
+
+    results.push_back(run("getFeatures:" + table,
+                          "cold",
+                          options.threads,
+                          options.calls,
+                          [&](size_t)
+                          {
+                            auto mo = map_options(table);
+                            mo.fieldnames.insert("name");
+                            mo.where = "id <> " + Fmi::to_string(++unique);
+                            engine.getFeatures(wgs84, mo);
+                          }));
+
+    results.push_back(run("getFeatures:" + table,
+                          "warm",
+                          options.threads,
+                          options.calls,
+                          [&](size_t) { engine.getFeatures(wgs84, warm); }));
+  }
+
+  auto warm_metadata = metadata_options();
+  engine.getMetaData(warm_metadata);
+  const auto base_time = Fmi::SecondClock::universal_time() - Fmi::Hours(48);
+
+  results.push_back(run("getMetaData",
+                        "cold",
+                        options.threads,
+                        options.calls,
+                        [&](size_t)
+                        {
+                          auto mdo = metadata_options();
+                          mdo.starttime = base_time + Fmi::Seconds(++unique);
+                          engine.getMetaData(mdo);
+                        }));
+
+  results.push_back(run("getMetaData",
+                        "warm",
+                        options.threads,
+                        options.calls,
+                        [&](size_t) { engine.getMetaData(warm_metadata); }));
+
+  SmartMet::Engine::Gis::postgis_identifier id;
+  id.pgname = "";
+  id.schema = "bench";
+  id.table = "points";
+  id.field = "name";
+  SmartMet::Engine::Gis::PostGISIdentifierVector ids{id};
+
+  results.push_back(run("populateGeometryStorage",
+                        "warm",
+                        options.threads,
+                        options.calls,
+                        [&](size_t)
+                        {
+                          SmartMet::Engine::Gis::GeometryStorage storage;
+                          engine.populateGeometryStorage(ids, storage);
+                        }));
+
+  return results;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+try
+{
+  auto options = parse_options(argc, argv);
+
+  if (options.generate)
+  {
+    cerr << "Generating " << options.size << " rows per layer\n";
+    generate_data(options);
+  }
+
+  SmartMet::Spine::Options opts;
+  opts.configfile = options.reactor_config;
+  opts.parseConfig();
+
+  SmartMet::Spine::Reactor reactor(opts);
+  reactor.init();
+
+  auto engine = reactor.getEngine<Engine>("Gis", nullptr);
+
+  auto results = run_benchmarks(*engine, options);
+  engine.reset();
+
+  auto json = to_json(results, options);
+  if (options.output.empty())
+    cout << json;
+  else
+  {
+    ofstream out(options.output);
+    out << json;
+    cerr << "Results written to " << options.output << '\n';
+  }
+
+  return 0;
+}
+catch (...)
+{
+  Fmi::Exception::Trace(BCP, "Benchmark failed!").printError();
+  return 1;
+}
@@ -0,0 +1,390 @@
+// ======================================================================
+/*!
+ * \brief Concurrent access stress test for the engine caches
+ *
+ * Generates synthetic layers into a local GeoPackage, preloads the
+ * caches with all the keys used and then calls getShape and getFeatures
+ * from an increasing number of threads with a Zipf distributed key mix.
+ * Since all calls are cache hits, throughput scaling and the latency
+ * inflation over the single threaded run measure contention in the
+ * cache lookups. No database is needed.
+ *
+ * Run with "make stress", see the Makefile for the settings.
+ */
+// ======================================================================
+
+#include "Engine.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <spine/Reactor.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <gdal_priv.h>
+#include <iostream>
+#include <ogrsf_frmts.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::Engine;
+using SmartMet::Engine::Gis::MapOptions;
+
+namespace
+{
+struct Options
+{
+  string reactor_config = "cnf/stress-reactor.conf";
+  string data = "cnf/stress.gpkg";
+  size_t layers = 20;    // generated layers
+  size_t size = 1000;    // polygons per layer
+  size_t variants = 50;  // where clauses per layer
+  double zipf = 1.1;     // Zipf exponent of the key popularity
+  unsigned threads = thread::hardware_concurrency();
+  double seconds = 5;  // duration of each run
+  string output;       // JSON output file, stdout if empty
+  bool generate = true;
+};
+
+struct Result
+{
+  unsigned threads = 0;
+  size_t calls = 0;
+  double seconds = 0;
+  vector<double> latencies;  // microseconds
+};
+
+Options parse_options(int argc, char* argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    auto value = [&]() -> string
+    {
+      if (i + 1 >= argc)
+        throw runtime_error("Option " + arg + " requires a value");
+      return argv[++i];
+    };
+
+    if (arg == "--reactor-config")
+      options.reactor_config = value();
+    else if (arg == "--data")
+      options.data = value();
+    else if (arg == "--layers")
+      options.layers = stoul(value());
+    else if (arg == "--size")
+      options.size = stoul(value());
+    else if (arg == "--variants")
+      options.variants = stoul(value());
+    else if (arg == "--zipf")
+      options.zipf = stod(value());
+    else if (arg == "--threads")
+      options.threads = stoul(value());
+    else if (arg == "--seconds")
+      options.seconds = stod(value());
+    else if (arg == "--output")
+      options.output = value();
+    else if (arg == "--no-generate")
+      options.generate = false;
+    else
+      throw runtime_error("Unknown option " + arg);
+  }
+  if (options.threads < 1)
+    options.threads = 1;
+  if (options.layers < 1 || options.size < 1 || options.variants < 1)
+    throw runtime_error("Layer, size and variant counts must be positive");
+  return options;
+}
+
+string layer_name(size_t theLayer)
+{
+  return "layer" + Fmi::to_string(theLayer);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate layers of small random polygons into a GeoPackage
+ */
+// ----------------------------------------------------------------------
+
+void generate_data(const Options& options)
+{
+  GDALAllRegister();
+
+  auto* driver = GetGDALDriverManager()->GetDriverByName("GPKG");
+  if (!driver)
+    throw runtime_error("GDAL GPKG driver not available");
+
+  std::filesystem::remove(options.data);
+  unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+      driver->Create(options.data.c_str(), 0, 0, 0, GDT_Unknown, nullptr),
+      [](GDALDataset* p) { GDALClose(p); });
+  if (!dataset)
+    throw runtime_error("Failed to create " + options.data);
+
+  OGRSpatialReference wgs84;
+  wgs84.SetWellKnownGeogCS("WGS84");
+  wgs84.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+
+  mt19937 gen(12345);
+  uniform_real_distribution<double> lon(20, 32);
+  uniform_real_distribution<double> lat(59, 70);
+  uniform_real_distribution<double> radius(0.01, 0.06);
+
+  for (size_t l = 0; l < options.layers; l++)
+  {
+    auto* layer =
+        dataset->CreateLayer(layer_name(l).c_str(), &wgs84, wkbPolygon, nullptr);
+    if (!layer)
+      throw runtime_error("Failed to create layer " + layer_name(l));
+
+    OGRFieldDefn id("id", OFTInteger);
+    OGRFieldDefn name("name", OFTString);
+    layer->CreateField(&id);
+    layer->CreateField(&name);
+
+    dataset->StartTransaction();
+    for (size_t i = 0; i < options.size; i++)
+    {
+      const double x = lon(gen);
+      const double y = lat(gen);
+      const double r = radius(gen);
+
+      auto* ring = new OGRLinearRing;
+      const int segments = 32;
+      for (int k = 0; k <= segments; k++)
+      {
+        const double angle = 2 * M_PI * (k % segments) / segments;
+        ring->addPoint(x + r * cos(angle), y + r * sin(angle));
+      }
+      OGRPolygon polygon;
+      polygon.addRingDirectly(ring);
+
+      OGRFeature feature(layer->GetLayerDefn());
+      feature.SetField("id", static_cast<int>(i));
+      feature.SetField("name", ("polygon" + Fmi::to_string(i)).c_str());
+      feature.SetGeometry(&polygon);
+      if (layer->CreateFeature(&feature) != OGRERR_NONE)
+        throw runtime_error("Failed to write to layer " + layer_name(l));
+    }
+    dataset->CommitTransaction();
+  }
+}
+
+// The options of a key. Each layer has several where clauses.
+MapOptions map_options(const Options& options, size_t theKey)
+{
+  MapOptions mo;
+  mo.pgname = "stress";
+  mo.schema = "stress";
+  mo.table = layer_name(theKey % options.layers);
+  auto variant = theKey / options.layers;
+  if (variant > 0)
+    mo.where = "id <= " + Fmi::to_string(options.size - variant);
+  return mo;
+}
+
+// Cumulative distribution of the key popularity, key 0 being the most popular
+vector<double> zipf_distribution(size_t theCount, double theExponent)
+{
+  vector<double> cdf(theCount);
+  double sum = 0;
+  for (size_t i = 0; i < theCount; i++)
+  {
+    sum += 1.0 / pow(static_cast<double>(i + 1), theExponent);
+    cdf[i] = sum;
+  }
+  for (auto& value : cdf)
+    value /= sum;
+  return cdf;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Call the engine from N threads for the given duration
+ *
+ * Seven calls out of ten are getShape calls, the rest getFeatures calls.
+ */
+// ----------------------------------------------------------------------
+
+Result run(Engine& engine,
+           const Options& options,
+           const vector<MapOptions>& keys,
+           const vector<double>& cdf,
+           unsigned threads)
+{
+  Result result;
+  result.threads = threads;
+
+  Fmi::SpatialReference wgs84("WGS84");
+
+  atomic<bool> stop{false};
+  atomic<size_t> calls{0};
+  vector<vector<double>> latencies(threads);
+  vector<thread> workers;
+
+  const auto start = chrono::steady_clock::now();
+
+  for (unsigned t = 0; t < threads; t++)
+    workers.emplace_back(
+        [&, t]()
+        {
+          mt19937 gen(1000 + t);
+          uniform_real_distribution<double> uniform(0, 1);
+          auto& times = latencies[t];
+          times.reserve(1000000);
+
+          while (!stop)
+          {
+            auto key = lower_bound(cdf.begin(), cdf.end(), uniform(gen)) - cdf.begin();
+            const auto& mo = keys[min(static_cast<size_t>(key), keys.size() - 1)];
+            const bool shape = (uniform(gen) < 0.7);
+
+            const auto t1 = chrono::steady_clock::now();
+            if (shape)
+              engine.getShape(&wgs84, mo);
+            else
+              engine.getFeatures(wgs84, mo);
+            const auto t2 = chrono::steady_clock::now();
+
+            times.push_back(chrono::duration<double, micro>(t2 - t1).count());
+            ++calls;
+          }
+        });
+
+  this_thread::sleep_for(chrono::duration<double>(options.seconds));
+  stop = true;
+
+  for (auto& worker : workers)
+    worker.join();
+
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  result.calls = calls;
+
+  for (const auto& v : latencies)
+    result.latencies.insert(result.latencies.end(), v.begin(), v.end());
+  sort(result.latencies.begin(), result.latencies.end());
+
+  return result;
+}
+
+double percentile(const vector<double>& sorted, double fraction)
+{
+  if (sorted.empty())
+    return 0;
+  auto pos = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[pos];
+}
+
+double mean(const vector<double>& values)
+{
+  if (values.empty())
+    return 0;
+  double sum = 0;
+  for (auto value : values)
+    sum += value;
+  return sum / values.size();
+}
+
+// Lock wait is estimated as the latency inflation over the single threaded run
+string to_json(const vector<Result>& results, const Options& options, size_t keys)
+{
+  const double base_throughput =
+      (results.empty() ? 0.0 : results.front().calls / results.front().seconds);
+  const double base_latency = (results.empty() ? 0.0 : mean(results.front().latencies));
+
+  ostringstream out;
+  out << "{\n  \"layers\": " << options.layers << ",\n  \"size\": " << options.size
+      << ",\n  \"keys\": " << keys << ",\n  \"zipf\": " << options.zipf
+      << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const auto& r = results[i];
+    const double throughput = r.calls / r.seconds;
+    const double latency = mean(r.latencies);
+    out << (i == 0 ? "\n" : ",\n") << "    {\"threads\": " << r.threads
+        << ", \"calls\": " << r.calls << ", \"throughput\": " << throughput
+        << ", \"speedup\": " << (base_throughput > 0 ? throughput / base_throughput : 0.0)
+        << ", \"efficiency\": "
+        << (base_throughput > 0 ? throughput / base_throughput / r.threads : 0.0)
+        << ", \"mean_us\": " << latency << ", \"p50_us\": " << percentile(r.latencies, 0.5)
+        << ", \"p99_us\": " << percentile(r.latencies, 0.99)
+        << ", \"max_us\": " << (r.latencies.empty() ? 0.0 : r.latencies.back())
+        << ", \"lock_wait_us\": " << max(0.0, latency - base_latency) << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+try
+{
+  auto options = parse_options(argc, argv);
+
+  if (options.generate)
+  {
+    cerr << "Generating " << options.layers << " layers of " << options.size << " polygons\n";
+    generate_data(options);
+  }
+
+  SmartMet::Spine::Options opts;
+  opts.configfile = options.reactor_config;
+  opts.parseConfig();
+
+  SmartMet::Spine::Reactor reactor(opts);
+  reactor.init();
+
+  auto engine = reactor.getEngine<Engine>("Gis", nullptr);
+
+  // Preload the caches so that only the lookups are measured
+  vector<MapOptions> keys;
+  for (size_t i = 0; i < options.layers * options.variants; i++)
+    keys.push_back(map_options(options, i));
+
+  cerr << "Preloading " << keys.size() << " keys\n";
+  Fmi::SpatialReference wgs84("WGS84");
+  for (const auto& mo : keys)
+  {
+    engine->getShape(&wgs84, mo);
+    engine->getFeatures(wgs84, mo);
+  }
+
+  const auto cdf = zipf_distribution(keys.size(), options.zipf);
+
+  vector<Result> results;
+  for (unsigned threads = 1;; threads = min(2 * threads, options.threads))
+  {
+    results.push_back(run(*engine, options, keys, cdf, threads));
+    cerr << threads << " threads: " << (results.back().calls / results.back().seconds)
+         << " calls/s\n";
+    if (threads == options.threads)
+      break;
+  }
+  engine.reset();
+
+  auto json = to_json(results, options, keys.size());
+  if (options.output.empty())
+    cout << json;
+  else
+  {
+    ofstream out(options.output);
+    out << json;
+    cerr << "Results written to " << options.output << '\n';
+  }
+
+  return 0;
+}
+catch (...)
+{
+  Fmi::Exception::Trace(BCP, "Stress test failed!").printError();
+  return 1;
+}
@@ -1,6 +1,10 @@
 #include "Engine.h"
+#include <macgyver/StringConversion.h>
 #include <regression/tframe.h>
 #include <spine/Reactor.h>
+#include <spine/Table.h>
+#include <optional>
+#include <stdexcept>
 
 using namespace std;
 
@@ -8,17 +12,49 @@ std::shared_ptr<SmartMet::Engine::Gis::Engine> gengine;
 
 namespace Tests
 {
-// ----------------------------------------------------------------------
-
-void getFeatures()
+SmartMet::Engine::Gis::MapOptions varoalueet()
 {
   SmartMet::Engine::Gis::MapOptions options;
   options.pgname = "";
   options.schema = "public";
   options.table = "varoalueet";
   options.fieldnames.insert("numero");
+  return options;
+}
+
+// Index of the column with the given name
+std::size_t column(const std::vector<std::string> &theNames, const std::string &theName)
+{
+  for (std::size_t i = 0; i < theNames.size(); i++)
+    if (theNames[i] == theName)
+      return i;
+  throw std::runtime_error("Column " + theName + " not found");
+}
+
+// First row with the given values in the given columns
+using Values = std::vector<std::pair<std::size_t, std::string>>;
+
+std::optional<std::size_t> find_row(const SmartMet::Spine::Table &theTable, const Values &theValues)
+{
+  if (theTable.empty())
+    return {};
+
+  for (std::size_t row = theTable.minj(); row <= theTable.maxj(); row++)
+  {
+    bool ok = true;
+    for (const auto &value : theValues)
+      ok = ok && (theTable.get(value.first, row) == value.second);
+    if (ok)
+      return row;
+  }
+  return {};
+}
 
-  auto features = gengine->getFeatures(options);
+// ----------------------------------------------------------------------
+
+void getFeatures()
+{
+  auto features = gengine->getFeatures(varoalueet());
 
   for (const auto &feature : features)
   {
@@ -42,13 +78,72 @@ void getFeatures()
 
 // ----------------------------------------------------------------------
 
+void pipelineStatistics()
+{
+  gengine->getFeatures(varoalueet());
+
+  // Columns Table, Stage and Calls
+  auto table = gengine->getPipelineStatistics();
+  auto row = find_row(*table, {{0, ":public.varoalueet"}, {1, "db_read_features"}});
+  if (!row)
+    TEST_FAILED("The database read of the features is missing");
+  if (Fmi::stoi(table->get(2, *row)) < 1)
+    TEST_FAILED("The database read of the features was not counted");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void cacheAccounting()
+{
+  // The second request is a hit
+  gengine->getFeatures(varoalueet());
+  gengine->getFeatures(varoalueet());
+
+  const auto names = SmartMet::Engine::Gis::CacheAccounting::names();
+  auto table = gengine->getCacheAccounting();
+  auto row = find_row(*table,
+                      {{column(names, "Cache"), "Gis::features_cache"},
+                       {column(names, "Table"), ":public.varoalueet"}});
+  if (!row)
+    TEST_FAILED("The features cache has no row for the table");
+  if (Fmi::stoi(table->get(column(names, "Hits"), *row)) < 1)
+    TEST_FAILED("The features cache hit was not counted");
+  if (Fmi::stoi(table->get(column(names, "Inserts"), *row)) < 1)
+    TEST_FAILED("The features cache insert was not counted");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void slowQueries()
+{
+  // The test configuration logs all features requests which read the database,
+  // the first request of the getFeatures test did. Columns Operation, Table and Status.
+  auto table = gengine->getSlowQueries();
+  if (!find_row(*table, {{1, "features"}, {3, "public.varoalueet"}, {7, "ok"}}))
+    TEST_FAILED("The features request was not logged");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
 // Test driver
 class tests : public tframe::tests
 {
   // Overridden message separator
   virtual const char *error_message_prefix() const { return "\n\t"; }
   // Main test suite
-  void test() { TEST(getFeatures); }
+  void test()
+  {
+    TEST(getFeatures);
+    TEST(pipelineStatistics);
+    TEST(cacheAccounting);
+    TEST(slowQueries);
+  }
 };  // class tests
 
 }  // namespace Tests
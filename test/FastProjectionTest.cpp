@@ -0,0 +1,163 @@
+#include "FastProjection.h"
+#include <gis/CoordinateTransformation.h>
+#include <gis/SpatialReference.h>
+#include <macgyver/StringConversion.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::FastProjections;
+
+namespace Tests
+{
+const double tolerance = 0.001;  // meters, the default setting
+
+// CRS with fast kernels
+const vector<int> supported = {4326, 4258, 3857, 3067, 3035};
+
+Fmi::SpatialReference crs(int theEPSG)
+{
+  return Fmi::SpatialReference("EPSG:" + Fmi::to_string(theEPSG));
+}
+
+string pair_name(int theSource, int theTarget)
+{
+  return Fmi::to_string(theSource) + " -> " + Fmi::to_string(theTarget);
+}
+
+// ----------------------------------------------------------------------
+
+void pairs()
+{
+  FastProjections projections(tolerance);
+
+  for (auto source : supported)
+    for (auto target : supported)
+    {
+      if (source == target)
+        continue;
+
+      auto source_sr = crs(source);
+      auto target_sr = crs(target);
+      auto fast = projections.get(*source_sr.get(), *target_sr.get());
+      if (!fast)
+        TEST_FAILED("Pair " + pair_name(source, target) + " was rejected");
+
+      const auto error = fast->validate(source_sr, target_sr);
+      if (!(error <= tolerance))
+        TEST_FAILED("Pair " + pair_name(source, target) + " deviates " +
+                    Fmi::to_string(error) + " meters from PROJ");
+
+      // The validated result is reused
+      if (projections.get(*source_sr.get(), *target_sr.get()) != fast)
+        TEST_FAILED("Pair " + pair_name(source, target) + " was validated again");
+    }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void unsupported()
+{
+  FastProjections projections(tolerance);
+
+  auto wgs84 = crs(4326);
+  auto ykj = crs(2393);
+  if (projections.get(*wgs84.get(), *ykj.get()))
+    TEST_FAILED("Pair 4326 -> 2393 has no fast kernels but was accepted");
+  if (projections.get(*wgs84.get(), *wgs84.get()))
+    TEST_FAILED("Identical spatial references need no projection");
+
+  // The same EPSG codes with the authority axis order are left for PROJ
+  auto tm35fin = crs(3067);
+  if (!projections.get(*wgs84.get(), *tm35fin.get()))
+    TEST_FAILED("Pair 4326 -> 3067 was rejected");
+
+  std::unique_ptr<OGRSpatialReference> latlon(wgs84.get()->Clone());
+  latlon->SetAxisMappingStrategy(OAMS_AUTHORITY_COMPLIANT);
+  if (projections.get(*latlon, *tm35fin.get()))
+    TEST_FAILED("Source with latitude before longitude was accepted");
+
+  std::unique_ptr<OGRSpatialReference> laea(crs(3035).get()->Clone());
+  laea->SetAxisMappingStrategy(OAMS_AUTHORITY_COMPLIANT);
+  if (projections.get(*tm35fin.get(), *laea))
+    TEST_FAILED("Target with northing before easting was accepted");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void geometries()
+{
+  FastProjections projections(tolerance);
+
+  auto wgs84 = crs(4326);
+  auto tm35fin = crs(3067);
+  auto fast = projections.get(*wgs84.get(), *tm35fin.get());
+  if (!fast)
+    TEST_FAILED("Pair 4326 -> 3067 was rejected");
+
+  // Helsinki is inside the validated area and matches PROJ
+  OGRPoint helsinki(24.94, 60.17);
+  helsinki.assignSpatialReference(wgs84.get());
+  unique_ptr<OGRGeometry> result(fast->transformGeometry(helsinki));
+  if (!result)
+    TEST_FAILED("Helsinki is inside the validated area");
+
+  double x = 24.94;
+  double y = 60.17;
+  Fmi::CoordinateTransformation proj(wgs84, tm35fin);
+  if (!proj.transform(x, y))
+    TEST_FAILED("PROJ failed to project Helsinki");
+
+  const auto* point = dynamic_cast<const OGRPoint*>(result.get());
+  if (!point || std::hypot(point->getX() - x, point->getY() - y) > tolerance)
+    TEST_FAILED("Projected Helsinki deviates from PROJ");
+  if (!result->getSpatialReference() || !result->getSpatialReference()->IsSame(tm35fin.get()))
+    TEST_FAILED("Projected geometry has the wrong spatial reference");
+
+  // A line reaching outside the validated area is left for PROJ
+  OGRLineString line;
+  line.addPoint(24.94, 60.17);
+  line.addPoint(100.0, 10.0);
+  line.assignSpatialReference(wgs84.get());
+  result.reset(fast->transformGeometry(line));
+  if (result)
+    TEST_FAILED("Line outside the validated area was projected");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+// Test driver
+class tests : public tframe::tests
+{
+  // Overridden message separator
+  virtual const char *error_message_prefix() const { return "\n\t"; }
+  // Main test suite
+  void test()
+  {
+    TEST(pairs);
+    TEST(unsupported);
+    TEST(geometries);
+  }
+};  // class tests
+
+}  // namespace Tests
+
+int main(void)
+{
+  cout << endl
+       << "FastProjection tester\n"
+          "====================="
+       << endl;
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,153 @@
+#include "FlatGeometry.h"
+#include <macgyver/StringConversion.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::FlatGeometry;
+
+namespace Tests
+{
+// A polygon with a hole, a 3D multipoint, a curve stored as WKB and an empty slot
+vector<OGRGeometryPtr> geometries()
+{
+  auto* polygon = new OGRPolygon;
+  auto* shell = new OGRLinearRing;
+  shell->addPoint(0, 0);
+  shell->addPoint(10, 0);
+  shell->addPoint(10, 10);
+  shell->addPoint(0, 0);
+  auto* hole = new OGRLinearRing;
+  hole->addPoint(2, 1);
+  hole->addPoint(8, 1);
+  hole->addPoint(8, 7);
+  hole->addPoint(2, 1);
+  polygon->addRingDirectly(shell);
+  polygon->addRingDirectly(hole);
+
+  auto* multipoint = new OGRMultiPoint;
+  multipoint->addGeometryDirectly(new OGRPoint(1, 2, 3));
+  multipoint->addGeometryDirectly(new OGRPoint(4, 5, 6));
+
+  auto* curve = new OGRCircularString;
+  curve->addPoint(0, 0);
+  curve->addPoint(1, 1);
+  curve->addPoint(2, 0);
+
+  return {OGRGeometryPtr(polygon),
+          OGRGeometryPtr(multipoint),
+          OGRGeometryPtr(curve),
+          OGRGeometryPtr()};
+}
+
+// ----------------------------------------------------------------------
+
+void roundtrip()
+{
+  const auto input = geometries();
+  const FlatGeometry flat(input);
+  const FlatGeometry copy(flat.pack());
+
+  for (std::size_t i = 0; i < input.size(); i++)
+  {
+    auto result = copy.geometry(i);
+    if (!input[i])
+    {
+      if (result)
+        TEST_FAILED("Empty slot was not restored");
+    }
+    else if (!result || !result->Equals(input[i].get()) ||
+             result->getGeometryType() != input[i]->getGeometryType())
+      TEST_FAILED("Geometry " + Fmi::to_string(i) + " differs");
+  }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void corrupted()
+{
+  const FlatGeometry flat(geometries());
+  const auto packed = flat.pack();
+
+  // Truncated buffers are rejected
+  for (std::size_t size = 0; size < packed.data.size(); size += 8)
+  {
+    auto copy = packed;
+    copy.data.resize(size);
+    bool accepted = true;
+    try
+    {
+      FlatGeometry broken(copy);
+    }
+    catch (...)
+    {
+      accepted = false;
+    }
+    if (accepted)
+      TEST_FAILED("Buffer truncated to " + Fmi::to_string(size) + " bytes was accepted");
+  }
+
+  // Any overwritten word is either rejected or builds valid geometries
+  for (std::size_t pos = 0; pos + 4 <= packed.data.size(); pos += 4)
+    for (std::uint32_t value : {0U, 1U, 3U, 0xFFFFU, 0xFFFFFFFFU})
+    {
+      auto copy = packed;
+      std::memcpy(&copy.data[pos], &value, sizeof(value));
+
+      std::unique_ptr<FlatGeometry> broken;
+      try
+      {
+        broken = std::make_unique<FlatGeometry>(copy);
+      }
+      catch (...)
+      {
+        continue;
+      }
+
+      try
+      {
+        for (std::size_t i = 0; i < broken->size(); i++)
+          broken->geometry(i);
+      }
+      catch (...)
+      {
+        // Invalid WKB content is only detected when it is parsed
+      }
+    }
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+// Test driver
+class tests : public tframe::tests
+{
+  // Overridden message separator
+  virtual const char *error_message_prefix() const { return "\n\t"; }
+  // Main test suite
+  void test()
+  {
+    TEST(roundtrip);
+    TEST(corrupted);
+  }
+};  // class tests
+
+}  // namespace Tests
+
+int main(void)
+{
+  cout << endl
+       << "FlatGeometry tester\n"
+          "==================="
+       << endl;
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,110 @@
+#include "GdalUtils.h"
+#include <macgyver/StringConversion.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+using SmartMet::Engine::Gis::CoordinateConv;
+using SmartMet::Engine::Gis::make_geometry_conv;
+
+namespace Tests
+{
+// A polygon with a hole, each ring is converted as one array
+unique_ptr<OGRGeometry> polygon()
+{
+  auto* shell = new OGRLinearRing;
+  shell->addPoint(0, 0);
+  shell->addPoint(10, 0);
+  shell->addPoint(10, 10);
+  shell->addPoint(0, 0);
+  auto* hole = new OGRLinearRing;
+  hole->addPoint(2, 1);
+  hole->addPoint(8, 1);
+  hole->addPoint(8, 7);
+  hole->addPoint(2, 1);
+
+  auto* ret = new OGRPolygon;
+  ret->addRingDirectly(shell);
+  ret->addRingDirectly(hole);
+  return unique_ptr<OGRGeometry>(ret);
+}
+
+// ----------------------------------------------------------------------
+
+void inline_conv()
+{
+  std::size_t calls = 0;
+  auto conv = make_geometry_conv(
+      [&calls](CoordinateConv::SizeType n, double* x, double* y)
+      {
+        ++calls;
+        for (CoordinateConv::SizeType i = 0; i < n; i++)
+        {
+          x[i] = 2 * x[i] + 1;
+          y[i] = y[i] - 5;
+        }
+        return true;
+      });
+
+  auto geom = polygon();
+  if (geom->transform(&conv) != OGRERR_NONE)
+    TEST_FAILED("Conversion failed");
+  if (calls != 2)
+    TEST_FAILED("Expected one call per ring, got " + Fmi::to_string(calls));
+
+  const auto* result = dynamic_cast<const OGRPolygon*>(geom.get());
+  const auto* hole = result->getInteriorRing(0);
+  if (hole->getX(1) != 17 || hole->getY(1) != -4)
+    TEST_FAILED("Converted hole differs");
+
+  auto expected = polygon();
+  const auto* shell = dynamic_cast<const OGRPolygon*>(expected.get())->getExteriorRing();
+  for (int i = 0; i < shell->getNumPoints(); i++)
+    if (result->getExteriorRing()->getX(i) != 2 * shell->getX(i) + 1 ||
+        result->getExteriorRing()->getY(i) != shell->getY(i) - 5)
+      TEST_FAILED("Converted point " + Fmi::to_string(i) + " differs");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void failure()
+{
+  auto conv = make_geometry_conv([](CoordinateConv::SizeType, double*, double*) { return false; });
+
+  auto geom = polygon();
+  if (geom->transform(&conv) == OGRERR_NONE)
+    TEST_FAILED("Failed conversion was not reported");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+// Test driver
+class tests : public tframe::tests
+{
+  // Overridden message separator
+  virtual const char *error_message_prefix() const { return "\n\t"; }
+  // Main test suite
+  void test()
+  {
+    TEST(inline_conv);
+    TEST(failure);
+  }
+};  // class tests
+
+}  // namespace Tests
+
+int main(void)
+{
+  cout << endl
+       << "GdalUtils tester\n"
+          "================"
+       << endl;
+  Tests::tests t;
+  return t.run();
+}
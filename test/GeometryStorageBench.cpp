@@ -0,0 +1,340 @@
+// ======================================================================
+/*!
+ * \brief Micro-benchmarks for GeometryStorage lookups and name normalization
+ *
+ * Builds a large synthetic storage with Nordic place names and measures
+ * the lookup throughput, the number of C++ allocations per lookup and
+ * the heap footprint of the storage. No database is needed.
+ *
+ * Run with "make microbench", see the Makefile for the settings.
+ */
+// ======================================================================
+
+#include "GeometryStorage.h"
+#include "Normalize.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::GeometryStorage;
+using SmartMet::Engine::Gis::normalize_string;
+
+// ----------------------------------------------------------------------
+// Allocation counting. Only C++ allocations are counted, OGR allocates
+// the coordinate buffers with CPLMalloc which is not hooked. The heap
+// footprint is measured from the malloc statistics instead, which cover
+// all allocations of this single threaded program.
+// ----------------------------------------------------------------------
+
+namespace
+{
+atomic<size_t> new_allocations{0};
+
+void* counted_malloc(size_t size)
+{
+  void* p = malloc(size == 0 ? 1 : size);
+  if (!p)
+    throw bad_alloc();
+  new_allocations.fetch_add(1, memory_order_relaxed);
+  return p;
+}
+
+void counted_free(void* p) noexcept
+{
+  free(p);
+}
+
+// Bytes in use in the malloc heap, including mmapped blocks
+long long heap_bytes()
+{
+  const auto info = mallinfo2();
+  return static_cast<long long>(info.uordblks + info.hblkhd);
+}
+}  // namespace
+
+void* operator new(size_t size)
+{
+  return counted_malloc(size);
+}
+void* operator new[](size_t size)
+{
+  return counted_malloc(size);
+}
+void operator delete(void* p) noexcept
+{
+  counted_free(p);
+}
+void operator delete[](void* p) noexcept
+{
+  counted_free(p);
+}
+void operator delete(void* p, size_t /* size */) noexcept
+{
+  counted_free(p);
+}
+void operator delete[](void* p, size_t /* size */) noexcept
+{
+  counted_free(p);
+}
+
+namespace
+{
+struct Options
+{
+  size_t names = 100000;     // names in the storage
+  size_t lookups = 1000000;  // lookups per benchmark
+  string output;             // JSON output file, stdout if empty
+};
+
+struct Result
+{
+  string name;
+  size_t calls = 0;
+  double seconds = 0;
+  size_t new_allocations = 0;
+};
+
+Options parse_options(int argc, char* argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    auto value = [&]() -> string
+    {
+      if (i + 1 >= argc)
+        throw runtime_error("Option " + arg + " requires a value");
+      return argv[++i];
+    };
+
+    if (arg == "--names")
+      options.names = stoul(value());
+    else if (arg == "--lookups")
+      options.lookups = stoul(value());
+    else if (arg == "--output")
+      options.output = value();
+    else
+      throw runtime_error("Unknown option " + arg);
+  }
+  return options;
+}
+
+// Place names in mixed case with Nordic characters, unique by the running number
+vector<string> generate_names(size_t theCount)
+{
+  const vector<string> prefixes = {"Ähtäri",
+                                   "Äänekoski",
+                                   "Åbo",
+                                   "Öjeby",
+                                   "Hämeen",
+                                   "Kärsä",
+                                   "Mänt",
+                                   "Pöytyä",
+                                   "Sävsjö",
+                                   "Vöråmark"};
+  const vector<string> suffixes = {"", "lä", "järvi", "ö", "Mäki", "nÄs", "by", "Åsen"};
+
+  mt19937 gen(12345);
+  uniform_int_distribution<size_t> prefix(0, prefixes.size() - 1);
+  uniform_int_distribution<size_t> suffix(0, suffixes.size() - 1);
+
+  vector<string> names;
+  names.reserve(theCount);
+  for (size_t i = 0; i < theCount; i++)
+    names.push_back(prefixes[prefix(gen)] + suffixes[suffix(gen)] + " " + to_string(i));
+  return names;
+}
+
+// Every tenth name is a polygon, every tenth a line and the rest are points
+OGRwkbGeometryType geometry_type(size_t theIndex)
+{
+  switch (theIndex % 10)
+  {
+    case 0:
+      return wkbPolygon;
+    case 1:
+      return wkbLineString;
+    default:
+      return wkbPoint;
+  }
+}
+
+unique_ptr<OGRGeometry> make_geometry(size_t theIndex)
+{
+  double x = 20 + static_cast<double>(theIndex % 1000) * 0.01;
+  double y = 60 + static_cast<double>(theIndex / 1000) * 0.01;
+
+  switch (geometry_type(theIndex))
+  {
+    case wkbPolygon:
+    {
+      auto* ring = new OGRLinearRing;
+      ring->addPoint(x, y);
+      ring->addPoint(x + 0.01, y);
+      ring->addPoint(x + 0.01, y + 0.01);
+      ring->addPoint(x, y + 0.01);
+      ring->addPoint(x, y);
+      auto polygon = make_unique<OGRPolygon>();
+      polygon->addRingDirectly(ring);
+      return polygon;
+    }
+    case wkbLineString:
+    {
+      auto line = make_unique<OGRLineString>();
+      line->addPoint(x, y);
+      line->addPoint(x + 0.01, y + 0.005);
+      line->addPoint(x + 0.02, y);
+      return line;
+    }
+    default:
+      return make_unique<OGRPoint>(x, y);
+  }
+}
+
+Result run(const string& theName, size_t theCalls, const function<void(size_t)>& theCall)
+{
+  Result result;
+  result.name = theName;
+  result.calls = theCalls;
+
+  size_t allocations_before = new_allocations.load();
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < theCalls; i++)
+    theCall(i);
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  result.new_allocations = new_allocations.load() - allocations_before;
+
+  cerr << theName << ": " << (1e9 * result.seconds / static_cast<double>(theCalls))
+       << " ns/call\n";
+  return result;
+}
+
+string to_json(const vector<Result>& results,
+               const Options& options,
+               double build_seconds,
+               size_t build_allocations,
+               long long footprint)
+{
+  ostringstream out;
+  out << "{\n  \"names\": " << options.names << ",\n  \"build_seconds\": " << build_seconds
+      << ",\n  \"build_new_allocations\": " << build_allocations
+      << ",\n  \"heap_footprint_bytes\": " << footprint
+      << ",\n  \"bytes_per_name\": " << (static_cast<double>(footprint) / options.names)
+      << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const auto& r = results[i];
+    auto calls = static_cast<double>(r.calls);
+    out << "    {\"name\": \"" << r.name << "\", \"calls\": " << r.calls
+        << ", \"ns_per_call\": " << (1e9 * r.seconds / calls)
+        << ", \"calls_per_second\": " << (calls / r.seconds)
+        << ", \"new_allocations_per_call\": " << (static_cast<double>(r.new_allocations) / calls)
+        << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+  return out.str();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+try
+{
+  auto options = parse_options(argc, argv);
+  if (options.names == 0 || options.lookups == 0)
+    throw runtime_error("Name and lookup counts must be positive");
+
+  auto names = generate_names(options.names);
+
+  // Lookups use the original names, every fifth one is a miss
+  vector<string> queries;
+  queries.reserve(options.names);
+  for (size_t i = 0; i < names.size(); i++)
+    queries.push_back(i % 5 == 4 ? names[i] + " missing" : names[i]);
+
+  cerr << "Building a storage of " << options.names << " names\n";
+
+  auto storage = make_unique<GeometryStorage>();
+
+  long long bytes_before = heap_bytes();
+  size_t allocations_before = new_allocations.load();
+  auto start = chrono::steady_clock::now();
+
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    auto geom = make_geometry(i);
+    string name = names[i];
+    normalize_string(name);
+    storage->add(name, *geom);
+  }
+  storage->quoteSVGPaths();
+
+  double build_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  size_t build_allocations = new_allocations.load() - allocations_before;
+  long long footprint = heap_bytes() - bytes_before;
+
+  const auto& storage_ref = *storage;
+  const size_t n = queries.size();
+  size_t found = 0;  // prevents optimizing the calls away
+
+  vector<Result> results;
+  results.push_back(run("normalize_string",
+                        options.lookups,
+                        [&](size_t i)
+                        {
+                          string name = queries[i % n];
+                          normalize_string(name);
+                          found += name.size();
+                        }));
+  results.push_back(run("geoObjectExists",
+                        options.lookups,
+                        [&](size_t i) { found += storage_ref.geoObjectExists(queries[i % n]); }));
+  results.push_back(run("getSVGPath",
+                        options.lookups,
+                        [&](size_t i) { found += storage_ref.getSVGPath(queries[i % n]).size(); }));
+  results.push_back(run("getPoint",
+                        options.lookups,
+                        [&](size_t i)
+                        { found += (storage_ref.getPoint(queries[i % n]).first < 1000 ? 1 : 0); }));
+  results.push_back(run(
+      "getOGRGeometry",
+      options.lookups,
+      [&](size_t i)
+      {
+        auto index = i % n;
+        found += (storage_ref.getOGRGeometry(queries[index], geometry_type(index)) != nullptr);
+      }));
+
+  cerr << "Checksum " << found << '\n';
+
+  auto json = to_json(results, options, build_seconds, build_allocations, footprint);
+  if (options.output.empty())
+    cout << json;
+  else
+  {
+    ofstream out(options.output);
+    out << json;
+    cerr << "Results written to " << options.output << '\n';
+  }
+
+  return 0;
+}
+catch (...)
+{
+  Fmi::Exception::Trace(BCP, "Benchmark failed!").printError();
+  return 1;
+}
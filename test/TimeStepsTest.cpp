@@ -0,0 +1,279 @@
+#include "TimeSteps.h"
+#include <macgyver/StringConversion.h>
+#include <regression/tframe.h>
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+using namespace std;
+using SmartMet::Engine::Gis::TimeSteps;
+
+namespace Tests
+{
+Fmi::DateTime t(int theHour, int theMinute = 0)
+{
+  return Fmi::DateTime(Fmi::Date(2026, 1, 1), Fmi::Hours(theHour) + Fmi::Minutes(theMinute));
+}
+
+// Hourly times 0-9, then 10:30, then every 15 minutes from 11:00 to 12:00
+vector<Fmi::DateTime> times()
+{
+  vector<Fmi::DateTime> ret;
+  for (int h = 0; h < 10; h++)
+    ret.push_back(t(h));
+  ret.push_back(t(10, 30));
+  for (int m = 0; m <= 60; m += 15)
+    ret.push_back(t(11, m));
+  return ret;
+}
+
+string str(const Fmi::DateTime& theTime)
+{
+  return Fmi::to_iso_string(theTime);
+}
+
+// ----------------------------------------------------------------------
+
+void runs()
+{
+  TimeSteps steps(times());
+
+  if (steps.size() != 16)
+    TEST_FAILED("Expected 16 times, got " + Fmi::to_string(steps.size()));
+  if (steps.runs().size() != 3)
+    TEST_FAILED("Expected 3 runs, got " + Fmi::to_string(steps.runs().size()));
+  if (steps.runs()[0].count != 10 || steps.runs()[1].count != 1 || steps.runs()[2].count != 5)
+    TEST_FAILED("Unexpected run lengths");
+
+  // Repeated times are ignored
+  steps.push_back(t(12));
+  if (steps.size() != 16)
+    TEST_FAILED("Repeated time was added");
+
+  // A pair is split when the third time does not continue it
+  TimeSteps pairs(vector<Fmi::DateTime>{t(0), t(5), t(6), t(7), t(8)});
+  if (pairs.runs().size() != 2 || pairs.runs()[0].count != 1 || pairs.runs()[1].count != 4)
+    TEST_FAILED("Irregular first time was not split from the regular times");
+
+  bool accepted = true;
+  try
+  {
+    steps.push_back(t(1));
+  }
+  catch (...)
+  {
+    accepted = false;
+  }
+  if (accepted)
+    TEST_FAILED("Decreasing time was accepted");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void indexing()
+{
+  const auto expected = times();
+  TimeSteps steps(expected);
+
+  for (std::size_t i = 0; i < expected.size(); i++)
+    if (steps[i] != expected[i] || steps.at(i) != expected[i])
+      TEST_FAILED("Index " + Fmi::to_string(i) + ": expected " + str(expected[i]) + ", got " +
+                  str(steps[i]));
+
+  if (steps.front() != expected.front() || steps.back() != expected.back())
+    TEST_FAILED("front() or back() failed");
+
+  bool accepted = true;
+  try
+  {
+    steps.at(expected.size());
+  }
+  catch (...)
+  {
+    accepted = false;
+  }
+  if (accepted)
+    TEST_FAILED("Index past the end was accepted");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void iterators()
+{
+  const auto expected = times();
+  const TimeSteps steps(expected);
+
+  if (!std::equal(steps.begin(), steps.end(), expected.begin(), expected.end()))
+    TEST_FAILED("Forward iteration differs from the times");
+
+  vector<Fmi::DateTime> reversed(std::make_reverse_iterator(steps.end()),
+                                 std::make_reverse_iterator(steps.begin()));
+  if (!std::equal(reversed.rbegin(), reversed.rend(), expected.begin(), expected.end()))
+    TEST_FAILED("Reverse iteration differs from the times");
+
+  if (std::distance(steps.begin(), steps.end()) != static_cast<std::ptrdiff_t>(expected.size()))
+    TEST_FAILED("Iterator distance differs from the size");
+
+  for (std::size_t i = 0; i < expected.size(); i++)
+  {
+    auto it = steps.begin() + static_cast<std::ptrdiff_t>(i);
+    if (*it != expected[i] || steps.begin()[static_cast<std::ptrdiff_t>(i)] != expected[i])
+      TEST_FAILED("Random access to index " + Fmi::to_string(i) + " failed");
+    if (it - steps.begin() != static_cast<std::ptrdiff_t>(i))
+      TEST_FAILED("Iterator difference failed for index " + Fmi::to_string(i));
+  }
+
+  auto pos = std::lower_bound(steps.begin(), steps.end(), t(11, 20));
+  if (pos == steps.end() || *pos != t(11, 30))
+    TEST_FAILED("lower_bound failed");
+
+  // Vector compatibility
+  vector<Fmi::DateTime> copy = steps;
+  if (copy != expected)
+    TEST_FAILED("Conversion to a vector failed");
+
+  TimeSteps empty;
+  if (empty.begin() != empty.end())
+    TEST_FAILED("Empty timesteps have a nonempty range");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void contains()
+{
+  TimeSteps steps(times());
+
+  for (const auto& time : times())
+    if (!steps.contains(time))
+      TEST_FAILED("Time " + str(time) + " not found");
+
+  const auto before = t(0) - Fmi::Hours(1);
+  for (const auto& time : {t(0, 30), t(9, 30), t(10), t(11, 10), t(12, 15), before})
+    if (steps.contains(time))
+      TEST_FAILED("Time " + str(time) + " should not be found");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void nearest()
+{
+  TimeSteps steps(times());
+
+  const vector<pair<Fmi::DateTime, Fmi::DateTime>> cases = {
+      {t(0) - Fmi::Hours(5), t(0)},  // before the first time
+      {t(3, 20), t(3)},
+      {t(3, 40), t(4)},
+      {t(3, 30), t(3)},        // a tie prefers the earlier time
+      {t(10, 10), t(10, 30)},  // the next run is closer
+      {t(9, 45), t(9)},        // a tie between runs prefers the earlier time
+      {t(11, 7), t(11)},
+      {t(20), t(12)}  // after the last time
+  };
+
+  for (const auto& c : cases)
+  {
+    auto result = steps.nearest(c.first);
+    if (!result || *result != c.second)
+      TEST_FAILED("Nearest to " + str(c.first) + " should be " + str(c.second) + ", got " +
+                  (result ? str(*result) : string("nothing")));
+  }
+
+  if (TimeSteps().nearest(t(0)))
+    TEST_FAILED("Empty timesteps returned a nearest time");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+void slice()
+{
+  const auto all = times();
+  TimeSteps steps(all);
+
+  const vector<pair<optional<Fmi::DateTime>, optional<Fmi::DateTime>>> limits = {
+      {{}, {}},
+      {t(2), t(5)},
+      {t(2, 30), t(5, 30)},
+      {t(9, 30), t(11, 20)},
+      {t(10, 30), t(10, 30)},
+      {t(10, 40), t(10, 50)},
+      {{}, t(3)},
+      {t(11, 15), {}},
+      {t(20), {}}};
+
+  for (const auto& limit : limits)
+  {
+    vector<Fmi::DateTime> expected;
+    for (const auto& time : all)
+      if ((!limit.first || time >= *limit.first) && (!limit.second || time <= *limit.second))
+        expected.push_back(time);
+
+    const auto result = steps.slice(limit.first, limit.second);
+    if (result.expand() != expected)
+      TEST_FAILED("Slice " + (limit.first ? str(*limit.first) : string("-")) + " ... " +
+                  (limit.second ? str(*limit.second) : string("-")) + " failed");
+  }
+
+  // Reversed limits and limits between two times of a run select nothing
+  if (!steps.slice(t(5), t(2)).empty())
+    TEST_FAILED("Slice with reversed limits is not empty");
+  if (!steps.slice(t(11, 20), t(11, 10)).empty())
+    TEST_FAILED("Slice with reversed limits within a run is not empty");
+  if (!steps.slice(t(2, 10), t(2, 50)).empty())
+    TEST_FAILED("Slice between two times is not empty");
+  if (!steps.slice(t(11, 5), t(11, 10)).empty())
+    TEST_FAILED("Slice between two times of the last run is not empty");
+
+  // A slice of a long regular sequence is a single trimmed run
+  TimeSteps regular;
+  for (int i = 0; i < 100000; i++)
+    regular.push_back(t(0) + Fmi::Minutes(i));
+  const auto result = regular.slice(t(1, 30), t(1000));
+  if (result.runs().size() != 1 || result.size() != 1000 * 60 - 90 + 1 ||
+      result.front() != t(1, 30) || result.back() != t(1000))
+    TEST_FAILED("Slice of a regular sequence is not a single trimmed run");
+
+  TEST_PASSED();
+}
+
+// ----------------------------------------------------------------------
+
+// Test driver
+class tests : public tframe::tests
+{
+  // Overridden message separator
+  virtual const char *error_message_prefix() const { return "\n\t"; }
+  // Main test suite
+  void test()
+  {
+    TEST(runs);
+    TEST(indexing);
+    TEST(iterators);
+    TEST(contains);
+    TEST(nearest);
+    TEST(slice);
+  }
+};  // class tests
+
+}  // namespace Tests
+
+int main(void)
+{
+  cout << endl
+       << "TimeSteps tester\n"
+          "================"
+       << endl;
+  Tests::tests t;
+  return t.run();
+}